@@ -59,9 +59,11 @@
 
 // FeatureExtraction.cpp : Defines the entry point for the feature extraction console application.
 #include "CLM_core.h"
+#include "CLM_track_file.h"
 
 #include <fstream>
 #include <sstream>
+#include <climits>
 
 #include <opencv2/videoio/videoio.hpp>  // Video write
 #include <opencv2/videoio/videoio_c.h>  // Video write
@@ -145,7 +147,7 @@ void create_directory(string output_path)
 }
 
 // Extracting the following command line arguments -f, -fd, -op, -of, -ov (and possible ordered repetitions)
-void get_output_feature_params(vector<string> &output_similarity_aligned, bool &vid_output, vector<string> &output_gaze_files, vector<string> &output_hog_aligned_files, vector<string> &output_model_param_files, vector<string> &output_au_files, double &similarity_scale, int &similarity_size, bool &grayscale, bool &rigid, bool& verbose, vector<string> &arguments)
+void get_output_feature_params(vector<string> &output_similarity_aligned, bool &vid_output, vector<string> &output_gaze_files, vector<string> &output_hog_aligned_files, vector<string> &output_model_param_files, vector<string> &output_au_files, double &similarity_scale, int &similarity_size, bool &grayscale, bool &rigid, bool& verbose, string &au_spill_file, int &au_stream_lookahead, bool &two_stage, vector<string> &output_track_files, vector<string> &input_track_files, string &subject_id, string &subject_state_dir, int &num_chunks, int &chunk_overlap, vector<string> &arguments)
 {
 	output_similarity_aligned.clear();
 	vid_output = false;
@@ -263,6 +265,70 @@ void get_output_feature_params(vector<string> &output_similarity_aligned, bool &
 			valid[i+1] = false;			
 			i++;
 		}		
+		else if (arguments[i].compare("-au_spill") == 0) 
+		{                    
+			au_spill_file = output_root + arguments[i + 1];
+			create_directory_from_file(output_root + arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-au_stream") == 0) 
+		{                    
+			au_stream_lookahead = stoi(arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-two_stage") == 0) 
+		{                    
+			two_stage = true;
+			valid[i] = false;
+		}		
+		else if (arguments[i].compare("-otrack") == 0) 
+		{                    
+			output_track_files.push_back(output_root + arguments[i + 1]);
+			create_directory_from_file(output_root + arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-itrack") == 0) 
+		{                    
+			input_track_files.push_back(input_root + arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-chunks") == 0) 
+		{                    
+			num_chunks = stoi(arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-chunk_overlap") == 0) 
+		{                    
+			chunk_overlap = stoi(arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-subject") == 0) 
+		{                    
+			subject_id = arguments[i + 1];
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
+		else if (arguments[i].compare("-subject_dir") == 0) 
+		{                    
+			subject_state_dir = output_root + arguments[i + 1];
+			create_directory(output_root + arguments[i + 1]);
+			valid[i] = false;
+			valid[i+1] = false;			
+			i++;
+		}		
 		else if (arguments[i].compare("-help") == 0)
 		{
 			cout << "Output features are defined as: -simalign <outputfile>\n"; // Inform the user of how to use the program				
@@ -447,6 +513,351 @@ void visualise_tracking(Mat& captured_image, const CLMTracker::CLM& clm_model, c
 	}
 }
 
+// Write a similarity aligned face to the output video, or as an image to the output directory
+void output_similarity_aligned_frame(Mat& sim_warped_img, bool grayscale, bool video_output, VideoWriter& output_similarity_aligned_video, const string& output_dir, int frame_count)
+{
+	if (sim_warped_img.channels() == 3 && grayscale)
+	{
+		cvtColor(sim_warped_img, sim_warped_img, CV_BGR2GRAY);
+	}
+
+	if(video_output)
+	{
+		if(output_similarity_aligned_video.isOpened())
+		{
+			output_similarity_aligned_video << sim_warped_img;
+		}
+	}
+	else
+	{
+		char name[100];
+					
+		// output the frame number
+		std::sprintf(name, "frame_det_%06d.png", frame_count);
+
+		// Construct the output filename
+		boost::filesystem::path slash("/");
+					
+		std::string preferredSlash = slash.make_preferred().string();
+				
+		string out_file = output_dir + preferredSlash + string(name);
+		imwrite(out_file, sim_warped_img);
+	}
+}
+
+// The tracking result of a frame when a video is tracked in chunks
+struct TrackedFrame
+{
+	bool success;
+	double certainty;
+	Vec6d params_global;
+	Mat_<double> params_local;
+
+	// Absolute and head relative gaze of both eyes
+	Point3f gaze[4];
+
+	TrackedFrame() : success(false), certainty(1), params_global(1, 0, 0, 0, 0, 0)
+	{
+		for(int i = 0; i < 4; ++i)
+		{
+			gaze[i] = Point3f(0, 0, -1);
+		}
+	}
+};
+
+// Extracts the appearance features of a batch of frames tracked by a chunk (starting at first_frame of the video) for offline prediction,
+// writing out their HOG descriptors and aligned faces as it goes. Frames with no image are ones the chunk could not read, and count as failed
+void extract_chunk_appearance(const FaceAnalysis::FaceAnalyser& face_analyser, FaceAnalysis::Offline_frames& appearance, const vector<Mat>& frames,
+	const vector<TrackedFrame>& tracked, int first_frame, double fps, const CLMTracker::CLM& clm_model, const CLMTracker::CLMParameters& clm_parameters,
+	std::ofstream* hog_file, const string& aligned_dir, bool grayscale)
+{
+	int num_frames = (int)frames.size();
+
+	vector<Vec6d> params_global(num_frames);
+	vector<Mat_<double>> params_local(num_frames);
+	vector<bool> successes(num_frames);
+	vector<double> certainties(num_frames);
+	vector<double> timestamps(num_frames);
+
+	for(int i = 0; i < num_frames; ++i)
+	{
+		bool tracked_frame = !frames[i].empty() && !tracked[i].params_local.empty();
+
+		params_global[i] = tracked[i].params_global;
+		params_local[i] = tracked_frame ? tracked[i].params_local : Mat_<double>(clm_model.pdm.NumberOfModes(), 1, 0.0);
+		successes[i] = tracked_frame && tracked[i].success;
+		certainties[i] = tracked[i].certainty;
+		timestamps[i] = (double)(first_frame + i) * (1.0 / fps);
+	}
+
+	vector<Mat> aligned_faces;
+	vector<Mat_<double>> hog_descriptors;
+	face_analyser.AddOfflineFrames(appearance, frames, params_global, params_local, successes, certainties, timestamps, clm_model.pdm,
+		clm_parameters.concurrency, aligned_faces, hog_descriptors);
+
+	// Aligned faces can only be written as images here, as the chunks finish in any order
+	VideoWriter no_video;
+	for(int i = 0; i < num_frames; ++i)
+	{
+		if(hog_file != NULL)
+		{
+			output_HOG_frame(hog_file, successes[i], hog_descriptors[i], appearance.num_hog_rows, appearance.num_hog_cols);
+		}
+		if(!aligned_dir.empty())
+		{
+			output_similarity_aligned_frame(aligned_faces[i], grayscale, false, no_video, aligned_dir, first_frame + i);
+		}
+	}
+}
+
+// Where a chunk keeps its HOG descriptors until they are appended to the HOG output in order
+string chunk_hog_location(const string& hog_location, int chunk)
+{
+	std::stringstream location;
+	location << hog_location << ".chunk" << chunk;
+	return location.str();
+}
+
+// Tracks a video file as num_chunks consecutive chunks in parallel, each with its own copy of the model, every chunk starts tracking overlap frames
+// before its first frame so that the tracker has settled by the time it gets there (the frames of the overlap are taken from the previous chunk).
+// The result has a record for every frame up to the last one read, frames that could not be read count as failed ones.
+// If a face analyser is given (prepared with PrepareOfflineFrames) every chunk also extracts the appearance features of its frames while it has
+// them decoded, so that the video does not have to be read again: the HOG descriptors are appended to hog_output_file (if open), the aligned
+// faces are written as images to aligned_dir (if not empty) and the offline frames of every chunk are returned, to be merged in order
+void track_video_chunks(const string& video_file, int total_frames, int num_chunks, int overlap, const CLMTracker::CLM& clm_model, const CLMTracker::CLMParameters& clm_parameters,
+	float fx, float fy, float cx, float cy, double fps, const FaceAnalysis::FaceAnalyser* face_analyser, std::ofstream* hog_output_file, const string& hog_location,
+	const string& aligned_dir, bool grayscale, vector<TrackedFrame>& tracked_frames, vector<FaceAnalysis::Offline_frames>& chunk_appearance)
+{
+	int chunk_length = (total_frames + num_chunks - 1) / num_chunks;
+
+	// The appearance features are extracted a batch of frames at a time
+	const int batch_size = 64;
+
+	bool output_hog = face_analyser != NULL && hog_output_file != NULL && hog_output_file->is_open();
+
+	vector<vector<TrackedFrame> > chunk_frames(num_chunks);
+	chunk_appearance.clear();
+	chunk_appearance.resize(num_chunks);
+
+	CLMTracker::ParallelFor(clm_parameters.concurrency, 0, num_chunks, 1, [&](int chunk)
+	{
+		int chunk_start = chunk * chunk_length;
+		
+		// The last chunk goes on till the end of the video, in case the frame count was underestimated
+		int chunk_end = chunk == num_chunks - 1 ? INT_MAX : chunk_start + chunk_length;
+		int warm_start = max(0, chunk_start - overlap);
+
+		CLMTracker::CLM chunk_model(clm_model);
+		chunk_model.Reset();
+		CLMTracker::CLMParameters chunk_parameters(clm_parameters);
+
+		VideoCapture chunk_capture(video_file);
+		if(warm_start > 0)
+		{
+			chunk_capture.set(CV_CAP_PROP_POS_FRAMES, warm_start);
+
+			// Seeking is not frame accurate with every codec, so check where it ended up and if it is not right decode up to the start from the
+			// beginning of the video instead (slower, but the chunk then has exactly the frames it would have had in sequential tracking)
+			int position = (int)chunk_capture.get(CV_CAP_PROP_POS_FRAMES);
+			if(position != warm_start)
+			{
+				WARN_STREAM("Seeking to frame " << warm_start << " ended at " << position << ", reading the chunk from the start of the video instead");
+
+				if(position > warm_start || position < 0)
+				{
+					chunk_capture.release();
+					chunk_capture.open(video_file);
+					position = 0;
+				}
+
+				// The chunk is left empty if the video ends before its warm-up start
+				for(; position < warm_start; ++position)
+				{
+					if(!chunk_capture.grab())
+					{
+						break;
+					}
+				}
+				if(position < warm_start)
+				{
+					chunk_capture.release();
+				}
+			}
+		}
+
+		std::ofstream chunk_hog_file;
+		if(output_hog)
+		{
+			chunk_hog_file.open(chunk_hog_location(hog_location, chunk), ios_base::out | ios_base::binary);
+		}
+
+		// The frames of the chunk waiting for their appearance features
+		vector<Mat> batch_frames;
+		int batch_start = chunk_start;
+
+		Mat frame;
+		Mat_<uchar> grayscale_frame;
+		for(int f = warm_start; f < chunk_end; ++f)
+		{
+			chunk_capture >> frame;
+			if(frame.empty())
+			{
+				break;
+			}
+
+			if(frame.channels() == 3)
+			{
+				cvtColor(frame, grayscale_frame, CV_BGR2GRAY);
+			}
+			else
+			{
+				grayscale_frame = frame;
+			}
+
+			bool success = CLMTracker::DetectLandmarksInVideo(grayscale_frame, chunk_model, chunk_parameters);
+
+			// Only warming up
+			if(f < chunk_start)
+			{
+				continue;
+			}
+
+			TrackedFrame tracked;
+			tracked.success = success;
+			tracked.certainty = chunk_model.detection_certainty;
+			tracked.params_global = chunk_model.params_global;
+			tracked.params_local = chunk_model.params_local.clone();
+
+			if(chunk_parameters.track_gaze && success)
+			{
+				FaceAnalysis::EstimateGaze(chunk_model, tracked.gaze[0], tracked.gaze[2], fx, fy, cx, cy, true);
+				FaceAnalysis::EstimateGaze(chunk_model, tracked.gaze[1], tracked.gaze[3], fx, fy, cx, cy, false);
+			}
+
+			chunk_frames[chunk].push_back(tracked);
+
+			if(face_analyser != NULL)
+			{
+				// The capture reuses its frame buffer
+				batch_frames.push_back(frame.clone());
+
+				if((int)batch_frames.size() == batch_size)
+				{
+					vector<TrackedFrame> batch_tracked(chunk_frames[chunk].end() - batch_size, chunk_frames[chunk].end());
+					extract_chunk_appearance(*face_analyser, chunk_appearance[chunk], batch_frames, batch_tracked, batch_start, fps, chunk_model, chunk_parameters,
+						output_hog ? &chunk_hog_file : NULL, aligned_dir, grayscale);
+					batch_frames.clear();
+					batch_start = f + 1;
+				}
+			}
+		}
+
+		if(!batch_frames.empty())
+		{
+			vector<TrackedFrame> batch_tracked(chunk_frames[chunk].end() - (int)batch_frames.size(), chunk_frames[chunk].end());
+			extract_chunk_appearance(*face_analyser, chunk_appearance[chunk], batch_frames, batch_tracked, batch_start, fps, chunk_model, chunk_parameters,
+				output_hog ? &chunk_hog_file : NULL, aligned_dir, grayscale);
+		}
+	});
+
+	// The video ends with the last frame any of the chunks could read
+	int video_length = 0;
+	for(int chunk = 0; chunk < num_chunks; ++chunk)
+	{
+		if(!chunk_frames[chunk].empty())
+		{
+			video_length = chunk * chunk_length + (int)chunk_frames[chunk].size();
+		}
+	}
+
+	// Stitch the chunks together (padding the ones that ended early with failed frames, so that the later chunks stay in place)
+	tracked_frames.clear();
+	for(int chunk = 0; chunk < num_chunks && (int)tracked_frames.size() < video_length; ++chunk)
+	{
+		tracked_frames.insert(tracked_frames.end(), chunk_frames[chunk].begin(), chunk_frames[chunk].end());
+		vector<TrackedFrame>().swap(chunk_frames[chunk]);
+
+		int padded_length = min((chunk + 1) * chunk_length, video_length);
+		int num_missing = padded_length - (int)tracked_frames.size();
+		if(num_missing > 0)
+		{
+			int first_missing = (int)tracked_frames.size();
+			tracked_frames.resize(padded_length);
+
+			if(face_analyser != NULL)
+			{
+				std::ofstream chunk_hog_file;
+				if(output_hog)
+				{
+					chunk_hog_file.open(chunk_hog_location(hog_location, chunk), ios_base::out | ios_base::binary | ios_base::app);
+				}
+				vector<TrackedFrame> missing_tracked(tracked_frames.begin() + first_missing, tracked_frames.end());
+				extract_chunk_appearance(*face_analyser, chunk_appearance[chunk], vector<Mat>(num_missing), missing_tracked, first_missing, fps, clm_model, clm_parameters,
+					output_hog ? &chunk_hog_file : NULL, aligned_dir, grayscale);
+			}
+		}
+	}
+
+	// The HOG descriptors of the chunks in order
+	if(output_hog)
+	{
+		for(int chunk = 0; chunk < num_chunks; ++chunk)
+		{
+			string chunk_hog = chunk_hog_location(hog_location, chunk);
+			if(boost::filesystem::exists(chunk_hog) && boost::filesystem::file_size(chunk_hog) > 0)
+			{
+				std::ifstream chunk_hog_file(chunk_hog, ios_base::in | ios_base::binary);
+				*hog_output_file << chunk_hog_file.rdbuf();
+			}
+			boost::filesystem::remove(chunk_hog);
+		}
+	}
+}
+
+// Output all of the frames of AUs that the streaming post-processing has ready
+void output_streamed_AUs(std::ofstream& au_output_file, FaceAnalysis::FaceAnalyser& face_analyser, int& frames_output)
+{
+	vector<pair<string, double>> aus_reg;
+	vector<pair<string, double>> aus_class;
+	double timestamp;
+	double detection_certainty;
+	bool detection_success;
+
+	while(face_analyser.GetNextStreamedAUs(aus_reg, aus_class, timestamp, detection_certainty, detection_success))
+	{
+		double confidence = 0.5 * (1 - detection_certainty);
+
+		au_output_file << ++frames_output << ", " << timestamp << ", " << confidence << ", " << detection_success;
+		
+		for(auto au_reg : aus_reg)
+		{
+			au_output_file << ", " << au_reg.second;
+		}
+
+		if(aus_reg.size() == 0)
+		{
+			for(size_t p = 0; p < face_analyser.GetAURegNames().size(); ++p)
+			{
+				au_output_file << ", 0";
+			}
+		}
+
+		for(auto au_class : aus_class)
+		{
+			au_output_file << ", " << au_class.second;
+		}
+
+		if(aus_class.size() == 0)
+		{
+			for(size_t p = 0; p < face_analyser.GetAUClassNames().size(); ++p)
+			{
+				au_output_file << ", 0";
+			}
+		}
+		au_output_file << endl;
+	}
+}
+
 int main (int argc, char **argv)
 {
 
@@ -463,6 +874,9 @@ int main (int argc, char **argv)
 	// Always track gaze in feature extraction
 	clm_parameters.track_gaze = true;
 
+	// Set up the threading as requested (the number of worker threads or a fully serial run)
+	CLMTracker::InitialiseConcurrency(clm_parameters.concurrency);
+
 	// Get the input output file parameters
 	
 	// Indicates that rotation should be with respect to camera or world coordinates
@@ -511,6 +925,12 @@ int main (int argc, char **argv)
 	// The modules that are being used for tracking
 	CLMTracker::CLM clm_model(clm_parameters.model_location);	
 
+	// The (experimental) validator cascade stage is read in once with the model
+	if(!clm_parameters.validator_cascade_location.empty())
+	{
+		clm_model.landmark_validator.ReadCascadeStage(clm_parameters.validator_cascade_location);
+	}
+
 	vector<string> output_similarity_align;
 	vector<string> output_au_files;
 	vector<string> output_hog_align_files;
@@ -522,10 +942,19 @@ int main (int argc, char **argv)
 	bool grayscale = false;	
 	bool video_output = false;
 	bool rigid = false;	
+	string au_spill_file;
+	int au_stream_lookahead = -1;
+	bool two_stage = false;
+	vector<string> output_track_files;
+	vector<string> input_track_files;
+	string subject_id;
+	string subject_state_dir;
+	int num_chunks = 1;
+	int chunk_overlap = 100;
 	int num_hog_rows;
 	int num_hog_cols;
 
-	get_output_feature_params(output_similarity_align, video_output, gaze_output_files, output_hog_align_files, params_output_files, output_au_files, sim_scale, sim_size, grayscale, rigid, verbose, arguments);
+	get_output_feature_params(output_similarity_align, video_output, gaze_output_files, output_hog_align_files, params_output_files, output_au_files, sim_scale, sim_size, grayscale, rigid, verbose, au_spill_file, au_stream_lookahead, two_stage, output_track_files, input_track_files, subject_id, subject_state_dir, num_chunks, chunk_overlap, arguments);
 	
 	// Used for image masking
 
@@ -588,6 +1017,26 @@ int main (int argc, char **argv)
 
 	// Creating a  face analyser that will be used for AU extraction
 	FaceAnalysis::FaceAnalyser face_analyser(vector<Vec3d>(), 0.7, 112, 112, au_loc, tri_loc);
+
+	// For long videos keep most of the per-frame AU predictions on disk
+	if(!au_spill_file.empty())
+	{
+		face_analyser.SetPredictionSpillFile(au_spill_file);
+	}
+
+	// Or for streams don't keep them at all, correcting them with a delay instead
+	if(au_stream_lookahead >= 0)
+	{
+		face_analyser.SetStreamingPostprocessing(au_stream_lookahead);
+	}
+
+	// The person specific calibration of a recurring subject is kept between sessions
+	string subject_state_file;
+	if(!subject_id.empty() && !subject_state_dir.empty())
+	{
+		boost::filesystem::path slash("/");
+		subject_state_file = subject_state_dir + slash.make_preferred().string() + subject_id + ".state";
+	}
 		
 	while(!done) // this is not a for loop as we might also be reading from a webcam
 	{
@@ -804,6 +1253,39 @@ int main (int argc, char **argv)
 			hog_output_file.open(output_hog_align_files[f_n], ios_base::out | ios_base::binary);
 		}
 
+		// Saving the tracking results for later reanalysis
+		CLMTracker::TrackFileWriter track_writer;
+		if((int)output_track_files.size() > f_n)
+		{
+			double fps = webcam ? 30 : fps_vid_in;
+			track_writer.Open(output_track_files[f_n], clm_model.pdm.NumberOfModes(), fps);
+		}
+
+		// Or reading them instead of tracking
+		CLMTracker::TrackFileReader track_reader;
+		bool replay_track = (int)input_track_files.size() > f_n && !webcam;
+		if(replay_track)
+		{
+			if(!track_reader.Open(input_track_files[f_n]))
+			{
+				return 1;
+			}
+			if(track_reader.NumberOfModes() != clm_model.pdm.NumberOfModes())
+			{
+				FATAL_STREAM("The track file " + input_track_files[f_n] + " was not created with the same landmark model, exiting");
+				return 1;
+			}
+		}
+
+		// Start from the calibration of the earlier sessions of the subject (if there are any)
+		if(!subject_state_file.empty() && boost::filesystem::exists(subject_state_file))
+		{
+			if(face_analyser.LoadSubjectState(subject_state_file, subject_id, clm_model))
+			{
+				INFO_STREAM("Restored the calibration of subject " << subject_id);
+			}
+		}
+
 		// saving the videos
 		VideoWriter writerFace;
 		if(!tracked_videos_output.empty())
@@ -813,12 +1295,32 @@ int main (int argc, char **argv)
 		}
 
 		int frame_count = 0;
+
+		// How many rows of streamed AUs have been output for this video
+		int au_frames_streamed = 0;
 		
 		// This is useful for a second pass run (if want AU predictions)
 		vector<Vec6d> params_global_video;
 		vector<bool> successes_video;
 		vector<Mat_<double>> params_local_video;
 		vector<Mat_<double>> detected_landmarks_video;
+		vector<double> certainties_video;
+		vector<double> timestamps_video;
+
+		// A long video file can be tracked in several chunks at the same time
+		bool chunked_video = num_chunks > 1 && video_input && !webcam && !replay_track && total_frames > num_chunks;
+
+		// In the two stage mode the video is only tracked in the first pass, the appearance features are extracted in a second one (not possible from a webcam),
+		// this is always the case when tracking in chunks, as the appearance features then need to be extracted in parallel as well
+		bool two_stage_video = (two_stage || chunked_video) && !webcam;
+		bool needs_appearance = !output_similarity_align.empty() || hog_output_file.is_open() || !output_au_files.empty();
+
+		// The chunks extract the appearance features of their frames themselves, unless the aligned faces are output as a video (which has to be
+		// written in order, so the appearance features are then extracted in a second pass)
+		bool chunk_appearance = chunked_video && needs_appearance && !(video_output && !output_similarity_align.empty());
+
+		// Once tracked in chunks the video only needs to be decoded again for the visualisation or the tracked video output
+		bool decode_video = !chunked_video || !clm_parameters.quiet_mode || !tracked_videos_output.empty();
 				
 		// Use for timestamping if using a webcam
 		int64 t_initial = cv::getTickCount();
@@ -828,6 +1330,34 @@ int main (int argc, char **argv)
 		// Timestamp in seconds of current processing
 		double time_stamp = 0;
 
+		vector<TrackedFrame> chunked_frames;
+		if(chunked_video)
+		{
+			INFO_STREAM( "Tracking in " << num_chunks << " chunks");
+
+			vector<FaceAnalysis::Offline_frames> chunk_offline_frames;
+			if(chunk_appearance)
+			{
+				face_analyser.PrepareOfflineFrames(clm_model.pdm);
+			}
+			string aligned_dir = chunk_appearance && !output_similarity_align.empty() ? output_similarity_align[f_n] : string();
+			string hog_location = output_hog_align_files.empty() ? string() : output_hog_align_files[f_n];
+
+			track_video_chunks(current_file, total_frames, num_chunks, chunk_overlap, clm_model, clm_parameters, fx, fy, cx, cy, fps_vid_in,
+				chunk_appearance ? &face_analyser : NULL, &hog_output_file, hog_location, aligned_dir, grayscale, chunked_frames, chunk_offline_frames);
+
+			// All of the frames are in, so the AUs can be predicted straight away
+			if(chunk_appearance)
+			{
+				for(size_t chunk = 0; chunk < chunk_offline_frames.size(); ++chunk)
+				{
+					face_analyser.MergeOfflineFrames(chunk_offline_frames[chunk]);
+					chunk_offline_frames[chunk] = FaceAnalysis::Offline_frames();
+				}
+				face_analyser.FinishOfflinePrediction();
+			}
+		}
+
 		INFO_STREAM( "Starting tracking");
 		while(!captured_image.empty())
 		{		
@@ -847,22 +1377,52 @@ int main (int argc, char **argv)
 				time_stamp = 0.0;
 			}
 
-			// Reading the images
+			// Reading the images (not needed if already tracked in chunks)
 			Mat_<uchar> grayscale_image;
 
-			if(captured_image.channels() == 3)
-			{
-				cvtColor(captured_image, grayscale_image, CV_BGR2GRAY);				
-			}
-			else
+			if(!chunked_video)
 			{
-				grayscale_image = captured_image.clone();				
+				if(captured_image.channels() == 3)
+				{
+					cvtColor(captured_image, grayscale_image, CV_BGR2GRAY);				
+				}
+				else
+				{
+					grayscale_image = captured_image.clone();				
+				}
 			}
 		
 			// The actual facial landmark detection / tracking
 			bool detection_success;
 			
-			if(video_input || images_as_video)
+			if(replay_track)
+			{
+				// The landmarks are reconstructed from the stored parameters, frames past the end of the track file count as failures
+				if(!track_reader.ReadFrame(clm_model, time_stamp))
+				{
+					clm_model.detection_success = false;
+				}
+				detection_success = clm_model.detection_success;
+			}
+			else if(chunked_video)
+			{
+				// Already tracked, frames past the end of the last chunk count as failures
+				if(frame_count < (int)chunked_frames.size() && !chunked_frames[frame_count].params_local.empty())
+				{
+					const TrackedFrame& tracked = chunked_frames[frame_count];
+					clm_model.params_global = tracked.params_global;
+					clm_model.params_local = tracked.params_local;
+					clm_model.detection_success = tracked.success;
+					clm_model.detection_certainty = tracked.certainty;
+					clm_model.pdm.CalcShape2D(clm_model.detected_landmarks, clm_model.params_local, clm_model.params_global);
+				}
+				else
+				{
+					clm_model.detection_success = false;
+				}
+				detection_success = clm_model.detection_success;
+			}
+			else if(video_input || images_as_video)
 			{
 				detection_success = CLMTracker::DetectLandmarksInVideo(grayscale_image, clm_model, clm_parameters);
 			}
@@ -870,6 +1430,8 @@ int main (int argc, char **argv)
 			{
 				detection_success = CLMTracker::DetectLandmarksInImage(grayscale_image, clm_model, clm_parameters);
 			}
+
+			track_writer.WriteFrame(clm_model, time_stamp);
 			
 			// Gaze tracking, absolute gaze direction
 			Point3f gazeDirection0(0, 0, -1);
@@ -879,7 +1441,15 @@ int main (int argc, char **argv)
 			Point3f gazeDirection0_head(0, 0, -1);
 			Point3f gazeDirection1_head(0, 0, -1);
 
-			if (clm_parameters.track_gaze && detection_success)
+			// The eye landmarks are not part of a track file
+			if (chunked_video && detection_success)
+			{
+				gazeDirection0 = chunked_frames[frame_count].gaze[0];
+				gazeDirection1 = chunked_frames[frame_count].gaze[1];
+				gazeDirection0_head = chunked_frames[frame_count].gaze[2];
+				gazeDirection1_head = chunked_frames[frame_count].gaze[3];
+			}
+			else if (clm_parameters.track_gaze && detection_success && !replay_track)
 			{
 				FaceAnalysis::EstimateGaze(clm_model, gazeDirection0, gazeDirection0_head, fx, fy, cx, cy, true);
 				FaceAnalysis::EstimateGaze(clm_model, gazeDirection1, gazeDirection1_head, fx, fy, cx, cy, false);
@@ -889,8 +1459,17 @@ int main (int argc, char **argv)
 			Mat sim_warped_img;			
 			Mat_<double> hog_descriptor;
 
+			// Only keep the tracking results for the second pass (if the chunks have not extracted the appearance features already)
+			if(needs_appearance && two_stage_video && !chunk_appearance)
+			{
+				params_global_video.push_back(clm_model.params_global);
+				params_local_video.push_back(clm_model.params_local.clone());
+				successes_video.push_back(detection_success);
+				certainties_video.push_back(clm_model.detection_certainty);
+				timestamps_video.push_back(time_stamp);
+			}
 			// But only if needed in output
-			if(!output_similarity_align.empty() || hog_output_file.is_open() || !output_au_files.empty())
+			else if(needs_appearance && !two_stage_video)
 			{
 				face_analyser.AddNextFrame(captured_image, clm_model, time_stamp, webcam, !clm_parameters.quiet_mode);
 				face_analyser.GetLatestAlignedFace(sim_warped_img);
@@ -924,46 +1503,22 @@ int main (int argc, char **argv)
 				pose_estimate_CLM = CLMTracker::GetCorrectedPoseCamera(clm_model, fx, fy, cx, cy);
 			}
 
-			if(hog_output_file.is_open())
+			if(hog_output_file.is_open() && !two_stage_video)
 			{
 				output_HOG_frame(&hog_output_file, detection_success, hog_descriptor, num_hog_rows, num_hog_cols);
 			}
 
 			// Write the similarity normalised output
-			if(!output_similarity_align.empty())
+			if(!output_similarity_align.empty() && !two_stage_video)
 			{
-
-				if (sim_warped_img.channels() == 3 && grayscale)
-				{
-					cvtColor(sim_warped_img, sim_warped_img, CV_BGR2GRAY);
-				}
-
-				if(video_output)
-				{
-					if(output_similarity_aligned_video.isOpened())
-					{
-						output_similarity_aligned_video << sim_warped_img;
-					}
-				}
-				else
-				{
-					char name[100];
-					
-					// output the frame number
-					std::sprintf(name, "frame_det_%06d.png", frame_count);
-
-					// Construct the output filename
-					boost::filesystem::path slash("/");
-					
-					std::string preferredSlash = slash.make_preferred().string();
-				
-					string out_file = output_similarity_align[f_n] + preferredSlash + string(name);
-					imwrite(out_file, sim_warped_img);
-				}
+				output_similarity_aligned_frame(sim_warped_img, grayscale, video_output, output_similarity_aligned_video, output_similarity_align[f_n], frame_count);
 			}
 
 			// Visualising the tracker
-			visualise_tracking(captured_image, clm_model, clm_parameters, gazeDirection0, gazeDirection1, frame_count, fx, fy, cx, cy);
+			if(decode_video)
+			{
+				visualise_tracking(captured_image, clm_model, clm_parameters, gazeDirection0, gazeDirection1, frame_count, fx, fy, cx, cy);
+			}
 
 			// Output the detected facial landmarks
 			if(!landmark_output_files.empty())
@@ -1026,7 +1581,12 @@ int main (int argc, char **argv)
 			}
 
 
-			if(!output_au_files.empty())
+			if(!output_au_files.empty() && au_stream_lookahead >= 0)
+			{
+				// The AUs of the earlier frames that have been corrected by now
+				output_streamed_AUs(au_output_file, face_analyser, au_frames_streamed);
+			}
+			else if(!output_au_files.empty() && !two_stage_video)
 			{
 				double confidence = 0.5 * (1 - clm_model.detection_certainty);
 
@@ -1069,7 +1629,15 @@ int main (int argc, char **argv)
 				writerFace << captured_image;
 			}
 
-			if(video_input)
+			if(!decode_video)
+			{
+				// Only going through the frames the chunks have tracked
+				if(frame_count + 1 >= (int)chunked_frames.size())
+				{
+					captured_image = Mat();
+				}
+			}
+			else if(video_input)
 			{
 				video_capture >> captured_image;
 			}
@@ -1119,6 +1687,87 @@ int main (int argc, char **argv)
 			cout << endl;
 		}
 
+		// The second pass, decode the frames again and extract the appearance features from the tracked shapes, a batch of frames at a time
+		if(needs_appearance && two_stage_video && !chunk_appearance)
+		{
+			INFO_STREAM( "Extracting appearance features");
+
+			const int batch_size = 64;
+
+			if(video_input)
+			{
+				video_capture = VideoCapture(current_file);
+			}
+
+			int num_tracked = (int)params_global_video.size();
+			for(int batch_start = 0; batch_start < num_tracked; batch_start += batch_size)
+			{
+				vector<Mat> frames;
+				for(int f = batch_start; f < min(batch_start + batch_size, num_tracked); ++f)
+				{
+					Mat frame;
+					if(video_input)
+					{
+						video_capture >> frame;
+					}
+					else
+					{
+						frame = imread(input_image_files[f_n][f], -1);
+					}
+					if(frame.empty())
+					{
+						break;
+					}
+					frames.push_back(frame);
+				}
+
+				if(frames.empty())
+				{
+					break;
+				}
+
+				int batch_end = batch_start + (int)frames.size();
+				vector<Vec6d> params_global_batch(params_global_video.begin() + batch_start, params_global_video.begin() + batch_end);
+				vector<Mat_<double>> params_local_batch(params_local_video.begin() + batch_start, params_local_video.begin() + batch_end);
+				vector<bool> successes_batch(successes_video.begin() + batch_start, successes_video.begin() + batch_end);
+				vector<double> certainties_batch(certainties_video.begin() + batch_start, certainties_video.begin() + batch_end);
+				vector<double> timestamps_batch(timestamps_video.begin() + batch_start, timestamps_video.begin() + batch_end);
+
+				vector<Mat> aligned_faces;
+				vector<Mat_<double>> hog_descriptors;
+				face_analyser.AddOfflineFrames(frames, params_global_batch, params_local_batch, successes_batch, certainties_batch, timestamps_batch,
+					clm_model.pdm, clm_parameters.concurrency, aligned_faces, hog_descriptors);
+
+				Mat_<double> latest_hog;
+				face_analyser.GetLatestHOG(latest_hog, num_hog_rows, num_hog_cols);
+
+				for(int f = batch_start; f < batch_end; ++f)
+				{
+					if(hog_output_file.is_open())
+					{
+						output_HOG_frame(&hog_output_file, successes_video[f], hog_descriptors[f - batch_start], num_hog_rows, num_hog_cols);
+					}
+					if(!output_similarity_align.empty())
+					{
+						output_similarity_aligned_frame(aligned_faces[f - batch_start], grayscale, video_output, output_similarity_aligned_video, output_similarity_align[f_n], f);
+					}
+				}
+
+				if(batch_end < min(batch_start + batch_size, num_tracked))
+				{
+					break;
+				}
+			}
+
+			face_analyser.FinishOfflinePrediction();
+		}
+
+		// Keep the calibration for the next session of the subject
+		if(!subject_state_file.empty() && needs_appearance)
+		{
+			face_analyser.SaveSubjectState(subject_state_file, subject_id, clm_model);
+		}
+
 		frame_count = 0;
 		curr_img = -1;
 
@@ -1128,74 +1777,91 @@ int main (int argc, char **argv)
 		pose_output_file.close();
 		gaze_output_file.close();
 		landmarks_output_file.close();
+		track_writer.Close();
+		track_reader.Close();
 
-		vector<double> certainties;
-		vector<bool> successes;
-		vector<double> timestamps;
-		vector<std::pair<std::string, vector<double>>> predictions_reg;
-		vector<std::pair<std::string, vector<double>>> predictions_class;
-
-		face_analyser.ExtractAllPredictionsOfflineReg(predictions_reg, certainties, successes, timestamps);
-		face_analyser.ExtractAllPredictionsOfflineClass(predictions_class, certainties, successes, timestamps);
+		// When streaming, output the frames that are still waiting for their correction
+		if(!output_au_files.empty() && au_stream_lookahead >= 0)
+		{
+			face_analyser.FlushStreamedAUs();
+			output_streamed_AUs(au_output_file, face_analyser, au_frames_streamed);
+			au_output_file.close();
 
-		// Output all of the AU stuff with offline correction and cleanup
-		if(!output_au_files.empty())
+			face_analyser.Reset();
+		}
+		// Output all of the AU stuff with offline correction and cleanup, going through the stored predictions a chunk at a time
+		else if(!output_au_files.empty())
 		{			
 
 			au_output_file.close();
 
 			au_output_file.open (output_au_files[f_n], ios_base::out);
 
+			FaceAnalysis::AU_prediction_history& au_history = face_analyser.GetAUPredictionHistory();
+			const vector<string>& au_names_reg = au_history.GetAURegNames();
+			const vector<string>& au_names_class = au_history.GetAUClassNames();
+
+			vector<double> offsets_reg;
+			face_analyser.ExtractOfflineRegOffsets(offsets_reg);
+
 			au_output_file << "frame, timestamp, confidence, success";
-			for(auto reg_name : predictions_reg)
+			for(auto reg_name : au_names_reg)
 			{
-				au_output_file << ", " << reg_name.first << "_r";
+				au_output_file << ", " << reg_name << "_r";
 			}
 			
-			for(auto class_name : predictions_class)
+			for(auto class_name : au_names_class)
 			{
-				au_output_file << ", " << class_name.first << "_c";
+				au_output_file << ", " << class_name << "_c";
 			}
 			au_output_file << endl;
 
-			for(size_t frame = 0; frame < certainties.size(); ++frame)
+			auto aus_reg = face_analyser.GetCurrentAUsReg();
+			auto aus_class = face_analyser.GetCurrentAUsClass();
+
+			int frame_number = 0;
+			Mat_<float> au_values;
+			Mat_<double> frame_info;
+			for(int chunk = 0; chunk < au_history.NumChunks(); ++chunk)
 			{
-				double detection_certainty = certainties[frame];
-				bool detection_success = successes[frame];
+				au_history.ReadChunk(chunk, au_values, frame_info);
 
-				double confidence = 0.5 * (1 - detection_certainty);
+				for(int frame = 0; frame < frame_info.cols; ++frame)
+				{
+					double detection_certainty = frame_info(FaceAnalysis::AU_prediction_history::CONFIDENCE, frame);
+					bool detection_success = frame_info(FaceAnalysis::AU_prediction_history::SUCCESS, frame) != 0;
 
-				au_output_file << frame + 1 << ", " << timestamps[frame] << ", " << confidence << ", " << detection_success;
-				auto aus_reg = face_analyser.GetCurrentAUsReg();
+					double confidence = 0.5 * (1 - detection_certainty);
+
+					au_output_file << ++frame_number << ", " << frame_info(FaceAnalysis::AU_prediction_history::TIMESTAMP, frame) << ", " << confidence << ", " << detection_success;
 				
-				for(auto au_reg : predictions_reg)
-				{
-					au_output_file << ", " << au_reg.second[frame];
-				}
+					for(size_t au = 0; au < au_names_reg.size(); ++au)
+					{
+						au_output_file << ", " << FaceAnalysis::FaceAnalyser::CorrectOfflineReg(au_values((int)au, frame), offsets_reg[au], detection_success);
+					}
 
-				if(aus_reg.size() == 0)
-				{
-					for(size_t p = 0; p < face_analyser.GetAURegNames().size(); ++p)
+					if(aus_reg.size() == 0)
 					{
-						au_output_file << ", 0";
+						for(size_t p = 0; p < face_analyser.GetAURegNames().size(); ++p)
+						{
+							au_output_file << ", 0";
+						}
 					}
-				}
 
-				auto aus_class = face_analyser.GetCurrentAUsClass();
-				
-				for(auto au_class : predictions_class)
-				{
-					au_output_file << ", " << au_class.second[frame];
-				}
+					for(size_t au = 0; au < au_names_class.size(); ++au)
+					{
+						au_output_file << ", " << au_values((int)(au_names_reg.size() + au), frame);
+					}
 
-				if(aus_class.size() == 0)
-				{
-					for(size_t p = 0; p < face_analyser.GetAUClassNames().size(); ++p)
+					if(aus_class.size() == 0)
 					{
-						au_output_file << ", 0";
+						for(size_t p = 0; p < face_analyser.GetAUClassNames().size(); ++p)
+						{
+							au_output_file << ", 0";
+						}
 					}
+					au_output_file << endl;
 				}
-				au_output_file << endl;
 			}
 			face_analyser.Reset();
 		}
@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY. OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works (the related one preferrably):
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling
+//		 Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       in IEEE International. Conference on Computer Vision (ICCV), 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// FeatureExtractionTests.cpp : Regression checks of the FeatureExtraction console application, it is run on a bundled video with different
+// settings and the outputs are compared. Usage: FeatureExtractionTests <check> <FeatureExtraction executable> <video> <output directory>
+//   chunks  - tracking in parallel chunks gives the landmarks and AUs of sequential (two stage) tracking around the chunk boundaries
+//   threads - the outputs of a serial run and a multi-threaded run are identical
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define INFO_STREAM( stream ) \
+std::cout << stream << std::endl
+
+#define ERROR_STREAM( stream ) \
+std::cout << "Error: " << stream << std::endl
+
+using namespace std;
+
+// The number of chunks and the warm-up overlap of the chunked run
+const int num_chunks = 3;
+const int chunk_overlap = 50;
+
+// How many frames on either side of a chunk boundary are compared
+const int boundary_window = 5;
+
+// Tolerances of the chunked run: mean absolute landmark difference (in pixels) and regression AU difference of a frame, and the fraction
+// of frames that have to agree on every classification AU
+const double landmark_tolerance = 2.0;
+const double au_reg_tolerance = 0.3;
+const double au_class_agreement = 0.8;
+
+// The thread count of the multi-threaded run
+const int num_threads = 4;
+
+// The outputs compared between the serial and the multi-threaded run
+const char* thread_outputs[] = {"_fp.txt", "_pose.txt", "_gaze.txt", ".params.txt", "_au.txt"};
+
+// Runs FeatureExtraction in quiet mode with the given arguments, returns false if it failed
+bool run_feature_extraction(const string& executable, const string& video, const string& arguments)
+{
+	string command = "\"" + executable + "\" -q -f \"" + video + "\" " + arguments;
+
+#ifdef _WIN32
+	// The command processor strips the outer quotes
+	command = "\"" + command + "\"";
+#endif
+
+	INFO_STREAM("Running " << command);
+	return std::system(command.c_str()) == 0;
+}
+
+// Reads a comma separated output file of FeatureExtraction (the column names followed by a row of values for every frame)
+bool read_output(const string& location, vector<string>& names, vector<vector<double> >& rows)
+{
+	std::ifstream file(location);
+	if(!file.is_open())
+	{
+		ERROR_STREAM("Could not read " << location);
+		return false;
+	}
+
+	names.clear();
+	rows.clear();
+
+	string line;
+	if(getline(file, line))
+	{
+		std::stringstream header(line);
+		string name;
+		while(getline(header, name, ','))
+		{
+			name.erase(0, name.find_first_not_of(' '));
+			names.push_back(name);
+		}
+	}
+
+	while(getline(file, line))
+	{
+		std::stringstream values(line);
+		string value;
+		vector<double> row;
+		while(getline(values, value, ','))
+		{
+			row.push_back(atof(value.c_str()));
+		}
+		if(row.size() == names.size())
+		{
+			rows.push_back(row);
+		}
+	}
+	return true;
+}
+
+// Reads a whole file as it is
+bool read_bytes(const string& location, string& bytes)
+{
+	std::ifstream file(location, ios_base::in | ios_base::binary);
+	if(!file.is_open())
+	{
+		ERROR_STREAM("Could not read " << location);
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	bytes = contents.str();
+	return true;
+}
+
+// Tracking in chunks should give the results of sequential tracking, the frames where that is least likely are the first ones of every chunk
+// (which are tracked straight after the warm-up) and the last ones of the previous chunk. The AUs are compared to a two stage sequential run,
+// as the chunks always predict them offline
+int check_chunks(const string& executable, const string& video, const string& output_dir)
+{
+	string serial_output = output_dir + "/chunks_serial";
+	string chunked_output = output_dir + "/chunks_parallel";
+
+	if(!run_feature_extraction(executable, video, "-two_stage -of \"" + serial_output + "_fp.txt\" -oaus \"" + serial_output + "_au.txt\""))
+	{
+		ERROR_STREAM("The sequential run failed");
+		return 1;
+	}
+
+	std::stringstream chunk_arguments;
+	chunk_arguments << "-chunks " << num_chunks << " -chunk_overlap " << chunk_overlap;
+	if(!run_feature_extraction(executable, video, chunk_arguments.str() + " -of \"" + chunked_output + "_fp.txt\" -oaus \"" + chunked_output + "_au.txt\""))
+	{
+		ERROR_STREAM("The chunked run failed");
+		return 1;
+	}
+
+	vector<string> landmark_names, au_names, names;
+	vector<vector<double> > serial_landmarks, chunked_landmarks, serial_aus, chunked_aus;
+	if(!read_output(serial_output + "_fp.txt", landmark_names, serial_landmarks) || !read_output(chunked_output + "_fp.txt", names, chunked_landmarks) ||
+		!read_output(serial_output + "_au.txt", au_names, serial_aus) || !read_output(chunked_output + "_au.txt", names, chunked_aus))
+	{
+		return 1;
+	}
+
+	int num_frames = (int)serial_landmarks.size();
+	if(num_frames <= num_chunks || chunked_landmarks.size() != serial_landmarks.size() || serial_aus.size() != serial_landmarks.size() || 
+		chunked_aus.size() != serial_aus.size())
+	{
+		ERROR_STREAM("The frame counts differ, " << num_frames << " tracked sequentially and " << chunked_landmarks.size() << " in chunks");
+		return 1;
+	}
+
+	// The first four columns are the frame number, timestamp, confidence and success
+	const int first_value = 4;
+	const int success_column = 3;
+
+	int chunk_length = (num_frames + num_chunks - 1) / num_chunks;
+
+	int num_failures = 0;
+	for(int chunk = 1; chunk < num_chunks; ++chunk)
+	{
+		int boundary = chunk * chunk_length;
+
+		int num_compared = 0;
+		int num_class_agreeing = 0;
+		for(int frame = max(0, boundary - boundary_window); frame < min(num_frames, boundary + boundary_window); ++frame)
+		{
+			if(serial_landmarks[frame][success_column] != chunked_landmarks[frame][success_column])
+			{
+				ERROR_STREAM("Frame " << frame + 1 << " is tracked successfully only in one of the runs");
+				num_failures++;
+				continue;
+			}
+
+			double landmark_difference = 0;
+			for(size_t i = first_value; i < landmark_names.size(); ++i)
+			{
+				landmark_difference += abs(serial_landmarks[frame][i] - chunked_landmarks[frame][i]);
+			}
+			landmark_difference /= (double)(landmark_names.size() - first_value);
+
+			double au_reg_difference = 0;
+			int num_au_reg = 0;
+			bool class_agreeing = true;
+			for(size_t i = first_value; i < au_names.size(); ++i)
+			{
+				if(au_names[i].find("_r") != string::npos)
+				{
+					au_reg_difference += abs(serial_aus[frame][i] - chunked_aus[frame][i]);
+					num_au_reg++;
+				}
+				else if(serial_aus[frame][i] != chunked_aus[frame][i])
+				{
+					class_agreeing = false;
+				}
+			}
+			if(num_au_reg > 0)
+			{
+				au_reg_difference /= num_au_reg;
+			}
+
+			if(landmark_difference > landmark_tolerance)
+			{
+				ERROR_STREAM("The landmarks of frame " << frame + 1 << " differ by " << landmark_difference << " pixels on average");
+				num_failures++;
+			}
+			if(au_reg_difference > au_reg_tolerance)
+			{
+				ERROR_STREAM("The regression AUs of frame " << frame + 1 << " differ by " << au_reg_difference << " on average");
+				num_failures++;
+			}
+
+			num_compared++;
+			if(class_agreeing)
+			{
+				num_class_agreeing++;
+			}
+		}
+
+		if(num_compared > 0 && num_class_agreeing < au_class_agreement * num_compared)
+		{
+			ERROR_STREAM("The classification AUs agree on only " << num_class_agreeing << " of " << num_compared << " frames around frame " << boundary + 1);
+			num_failures++;
+		}
+	}
+
+	if(num_failures > 0)
+	{
+		return 1;
+	}
+
+	INFO_STREAM("The chunked run matches the sequential one around the chunk boundaries");
+	return 0;
+}
+
+// Threading must not change the results, so the outputs of a serial and a multi-threaded run have to be identical
+int check_threads(const string& executable, const string& video, const string& output_dir)
+{
+	const int num_outputs = sizeof(thread_outputs) / sizeof(thread_outputs[0]);
+
+	const string runs[] = {"threads_serial", "threads_parallel"};
+
+	std::stringstream thread_arguments;
+	thread_arguments << "-threads " << num_threads;
+	const string run_arguments[] = {"-serial", thread_arguments.str()};
+
+	for(int run = 0; run < 2; ++run)
+	{
+		string output = output_dir + "/" + runs[run];
+
+		string arguments = run_arguments[run];
+		arguments += " -of \"" + output + thread_outputs[0] + "\" -op \"" + output + thread_outputs[1] + "\"";
+		arguments += " -ogaze \"" + output + thread_outputs[2] + "\" -oparams \"" + output + thread_outputs[3] + "\" -oaus \"" + output + thread_outputs[4] + "\"";
+
+		if(!run_feature_extraction(executable, video, arguments))
+		{
+			ERROR_STREAM("The " << runs[run] << " run failed");
+			return 1;
+		}
+	}
+
+	int num_differing = 0;
+	for(int i = 0; i < num_outputs; ++i)
+	{
+		string serial_bytes, parallel_bytes;
+		if(!read_bytes(output_dir + "/" + runs[0] + thread_outputs[i], serial_bytes) || !read_bytes(output_dir + "/" + runs[1] + thread_outputs[i], parallel_bytes))
+		{
+			return 1;
+		}
+
+		if(serial_bytes.empty() || serial_bytes != parallel_bytes)
+		{
+			ERROR_STREAM("The " << thread_outputs[i] << " output differs between the serial and the " << num_threads << " thread run");
+			num_differing++;
+		}
+	}
+
+	if(num_differing > 0)
+	{
+		return 1;
+	}
+
+	INFO_STREAM("The serial and the " << num_threads << " thread runs give identical outputs");
+	return 0;
+}
+
+int main (int argc, char **argv)
+{
+	if(argc != 5)
+	{
+		ERROR_STREAM("Usage: FeatureExtractionTests <chunks|threads> <FeatureExtraction executable> <video> <output directory>");
+		return 1;
+	}
+
+	string check(argv[1]);
+	string executable(argv[2]);
+	string video(argv[3]);
+	string output_dir(argv[4]);
+
+	if(check.compare("chunks") == 0)
+	{
+		return check_chunks(executable, video, output_dir);
+	}
+	else if(check.compare("threads") == 0)
+	{
+		return check_threads(executable, video, output_dir);
+	}
+
+	ERROR_STREAM("Unknown check " << check);
+	return 1;
+}
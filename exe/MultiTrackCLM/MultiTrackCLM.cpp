@@ -136,6 +136,9 @@ int main (int argc, char **argv)
 	// This is so that the model would not try re-initialising itself
 	clm_params.reinit_video_every = -1;
 
+	// Set up the threading as requested (the number of worker threads or a fully serial run)
+	CLMTracker::InitialiseConcurrency(clm_params.concurrency);
+
 	clm_params.curr_face_detector = CLMTracker::CLMParameters::HOG_SVM_DETECTOR;
 
 	vector<CLMTracker::CLMParameters> clm_parameters;
@@ -156,6 +159,12 @@ int main (int argc, char **argv)
 	CLMTracker::CLM clm_model(clm_parameters[0].model_location);
 	clm_model.face_detector_HAAR.load(clm_parameters[0].face_detector_location);
 	clm_model.face_detector_location = clm_parameters[0].face_detector_location;
+
+	// The (experimental) validator cascade stage is read in once with the model
+	if(!clm_parameters[0].validator_cascade_location.empty())
+	{
+		clm_model.landmark_validator.ReadCascadeStage(clm_parameters[0].validator_cascade_location);
+	}
 	
 	clm_models.reserve(num_faces_max);
 
@@ -169,6 +178,13 @@ int main (int argc, char **argv)
 		clm_parameters.push_back(clm_params);
 	}
 	
+	// Running the face detector on a background thread if requested (-async_detect), so that the tracking does not stall while detecting
+	cv::Ptr<CLMTracker::FaceDetectorAsync> face_detector_async;
+	if(clm_parameters[0].async_face_detection)
+	{
+		face_detector_async = cv::makePtr<CLMTracker::FaceDetectorAsync>(clm_parameters[0].curr_face_detector, clm_parameters[0].face_detector_location);
+	}
+
 	// If multiple video files are tracked, use this to indicate if we are done
 	bool done = false;	
 	int f_n = -1;
@@ -304,8 +320,24 @@ int main (int argc, char **argv)
 				}
 			}
 						
-			// Get the detections (every 8th frame and when there are free models available for tracking)
-			if(frame_count % 8 == 0 && !all_models_active)
+			// Get the detections (when there are free models available for tracking), the background detector is fed every frame and 
+			// its newest result picked up when ready, the synchronous one is only run every 8th frame
+			if(!face_detector_async.empty())
+			{
+				if(!all_models_active)
+				{
+					int current_frame_id = face_detector_async->PushFrame(grayscale_image);
+
+					vector<double> confidences;
+					int detection_frame_id;
+					if(face_detector_async->GetDetections(face_detections, confidences, detection_frame_id) &&
+						current_frame_id - detection_frame_id > clm_parameters[0].async_detection_max_age)
+					{
+						face_detections.clear();
+					}
+				}
+			}
+			else if(frame_count % 8 == 0 && !all_models_active)
 			{				
 				if(clm_parameters[0].curr_face_detector == CLMTracker::CLMParameters::HOG_SVM_DETECTOR)
 				{
@@ -322,50 +354,44 @@ int main (int argc, char **argv)
 			// Keep only non overlapping detections (also convert to a concurrent vector
 			NonOverlapingDetections(clm_models, face_detections);
 
-			vector<tbb::atomic<bool> > face_detections_used(face_detections.size());
-
-			// Go through every model and update the tracking TODO pull out as a separate parallel/non-parallel method
-			tbb::parallel_for(0, (int)clm_models.size(), [&](int model){
-			//for(unsigned int model = 0; model < clm_models.size(); ++model)
-			//{
-
-				bool detection_success = false;
-
+			// Hand the free detections out to the inactive models in model order before the models are updated in parallel, so that which model 
+			// picks up which face does not depend on how the models are scheduled (and the results do not depend on the number of threads)
+			vector<int> model_detections(clm_models.size(), -1);
+			size_t next_detection = 0;
+			for(size_t model = 0; model < clm_models.size(); ++model)
+			{
 				// If the current model has failed more than 4 times in a row, remove it
 				if(clm_models[model].failures_in_a_row > 4)
 				{				
 					active_models[model] = false;
 					clm_models[model].Reset();
-
 				}
 
 				// If the model is inactive reactivate it with new detections
-				if(!active_models[model])
+				if(!active_models[model] && next_detection < face_detections.size())
 				{
-					
-					for(size_t detection_ind = 0; detection_ind < face_detections.size(); ++detection_ind)
-					{
-						// if it was not taken by another tracker take it (if it is false swap it to true and enter detection, this makes it parallel safe)
-						if(face_detections_used[detection_ind].compare_and_swap(true, false) == false)
-						{
-					
-							// Reinitialise the model
-							clm_models[model].Reset();
+					model_detections[model] = (int)next_detection++;
 
-							// This ensures that a wider window is used for the initial landmark localisation
-							clm_models[model].detection_success = false;
-							detection_success = CLMTracker::DetectLandmarksInVideo(grayscale_image, depth_image, face_detections[detection_ind], clm_models[model], clm_parameters[model]);
-													
-							// This activates the model
-							active_models[model] = true;
+					// This activates the model
+					active_models[model] = true;
+				}
+			}
 
-							// break out of the loop as the tracker has been reinitialised
-							break;
-						}
+			// Go through every model and update the tracking
+			CLMTracker::ParallelFor(clm_params.concurrency, 0, (int)clm_models.size(), clm_params.concurrency.grain_faces, [&](int model){
 
-					}
+				bool detection_success = false;
+
+				if(model_detections[model] >= 0)
+				{
+					// Reinitialise the model
+					clm_models[model].Reset();
+
+					// This ensures that a wider window is used for the initial landmark localisation
+					clm_models[model].detection_success = false;
+					detection_success = CLMTracker::DetectLandmarksInVideo(grayscale_image, depth_image, face_detections[model_detections[model]], clm_models[model], clm_parameters[model]);
 				}
-				else
+				else if(active_models[model])
 				{
 					// The actual facial landmark detection / tracking
 					detection_success = CLMTracker::DetectLandmarksInVideo(grayscale_image, depth_image, clm_models[model], clm_parameters[model]);
@@ -485,6 +511,13 @@ int main (int argc, char **argv)
 			clm_models[model].Reset();
 			active_models[model] = false;
 		}
+
+		// Make sure detections from this video are not picked up in the next one
+		if(!face_detector_async.empty())
+		{
+			face_detector_async = cv::makePtr<CLMTracker::FaceDetectorAsync>(clm_parameters[0].curr_face_detector, clm_parameters[0].face_detector_location);
+		}
+
 		pose_output_file.close();
 		landmarks_output_file.close();
 
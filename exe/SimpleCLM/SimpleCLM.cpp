@@ -171,6 +171,9 @@ int main (int argc, char **argv)
 
 	CLMTracker::CLMParameters clm_parameters(arguments);
 
+	// Set up the threading as requested (the number of worker threads or a fully serial run)
+	CLMTracker::InitialiseConcurrency(clm_parameters.concurrency);
+
 	// Get the input output file parameters
 	
 	// Indicates that rotation should be with respect to world or camera coordinates
@@ -180,6 +183,12 @@ int main (int argc, char **argv)
 	// The modules that are being used for tracking
 	CLMTracker::CLM clm_model(clm_parameters.model_location);	
 
+	// The (experimental) validator cascade stage is read in once with the model
+	if(!clm_parameters.validator_cascade_location.empty())
+	{
+		clm_model.landmark_validator.ReadCascadeStage(clm_parameters.validator_cascade_location);
+	}
+
 	// Grab camera parameters, if they are not defined (approximate values will be used)
 	float fx = 0, fy = 0, cx = 0, cy = 0;
 	// Get camera parameters
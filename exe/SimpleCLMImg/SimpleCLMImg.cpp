@@ -78,6 +78,29 @@ vector<string> get_arguments(int argc, char **argv)
 	return arguments;
 }
 
+// Runs both stages of the validator cascade on the current landmarks, counting how often the cheap stage would decide on its own (without escalating to the
+// full validator) and how often those decisions agree with the full validator
+void benchmark_validator_cascade(CLMTracker::CLM& clm_model, const Mat_<uchar>& grayscale_image, const CLMTracker::CLMParameters& params, int& total, int& decided, int& agreed)
+{
+	Vec3d orientation(clm_model.params_global[1], clm_model.params_global[2], clm_model.params_global[3]);
+
+	double cheap_certainty = clm_model.landmark_validator.cascade_stage->Check(orientation, grayscale_image, clm_model.detected_landmarks);
+	double full_certainty = clm_model.landmark_validator.Check(orientation, grayscale_image, clm_model.detected_landmarks);
+
+	// The cheap stage is calibrated on its own output scale
+	const CLMTracker::DetectionValidator& validator = clm_model.landmark_validator;
+
+	total++;
+	if(abs(cheap_certainty - validator.cascade_boundary) > validator.cascade_margin)
+	{
+		decided++;
+		if((cheap_certainty < validator.cascade_boundary) == (full_certainty < params.validation_boundary))
+		{
+			agreed++;
+		}
+	}
+}
+
 void convert_to_grayscale(const Mat& in, Mat& out)
 {
 	if(in.channels() == 3)
@@ -271,11 +294,24 @@ int main (int argc, char **argv)
 	// Bounding boxes for a face in each image (optional)
 	vector<Rect_<double> > bounding_boxes;
 	
+	// Should the validator cascade be benchmarked against the full validator (needs a cascade stage, in the model file or through -validator_cascade)
+	bool validator_bench = false;
+	for(size_t i = 0; i < arguments.size(); ++i)
+	{
+		if(arguments[i].compare("-validator_bench") == 0)
+		{
+			validator_bench = true;
+		}
+	}
+
 	CLMTracker::get_image_input_output_params(files, depth_files, output_landmark_locations, output_pose_locations, output_images, bounding_boxes, arguments);
 	CLMTracker::CLMParameters clm_parameters(arguments);	
 	// No need to validate detections, as we're not doing tracking
 	clm_parameters.validate_detections = false;
 
+	// Set up the threading as requested (the number of worker threads or a fully serial run)
+	CLMTracker::InitialiseConcurrency(clm_parameters.concurrency);
+
 	// Grab camera parameters if provided (only used for pose and eye gaze and are quite important for accurate estimates)
 	float fx = 0, fy = 0, cx = 0, cy = 0;
 	int device = -1;
@@ -297,6 +333,20 @@ int main (int argc, char **argv)
 	cout << "Loading the model" << endl;
 	CLMTracker::CLM clm_model(clm_parameters.model_location);
 	cout << "Model loaded" << endl;
+
+	// The (experimental) validator cascade stage is read in once with the model
+	if(!clm_parameters.validator_cascade_location.empty())
+	{
+		clm_model.landmark_validator.ReadCascadeStage(clm_parameters.validator_cascade_location);
+	}
+
+	if(validator_bench && clm_model.landmark_validator.cascade_stage.empty())
+	{
+		cout << "No validator cascade stage loaded, nothing to benchmark" << endl;
+		validator_bench = false;
+	}
+
+	int bench_total = 0, bench_decided = 0, bench_agreed = 0;
 	
 	CascadeClassifier classifier(clm_parameters.face_detector_location);	
 	dlib::frontal_face_detector face_detector_hog = dlib::get_frontal_face_detector();
@@ -368,6 +418,11 @@ int main (int argc, char **argv)
 				// if there are multiple detections go through them
 				bool success = CLMTracker::DetectLandmarksInImage(grayscale_image, depth_image, face_detections[face], clm_model, clm_parameters);
 
+				if(validator_bench)
+				{
+					benchmark_validator_cascade(clm_model, grayscale_image, clm_parameters, bench_total, bench_decided, bench_agreed);
+				}
+
 				// Estimate head pose and eye gaze				
 				Vec6d headPose = CLMTracker::GetCorrectedPoseWorld(clm_model, fx, fy, cx, cy);
 
@@ -480,6 +535,11 @@ int main (int argc, char **argv)
 			// Have provided bounding boxes
 			CLMTracker::DetectLandmarksInImage(grayscale_image, bounding_boxes[i], clm_model, clm_parameters);
 
+			if(validator_bench)
+			{
+				benchmark_validator_cascade(clm_model, grayscale_image, clm_parameters, bench_total, bench_decided, bench_agreed);
+			}
+
 			// Estimate head pose and eye gaze				
 			Vec6d headPose = CLMTracker::GetCorrectedPoseWorld(clm_model, fx, fy, cx, cy);
 
@@ -543,6 +603,16 @@ int main (int argc, char **argv)
 		}				
 
 	}
+
+	if(validator_bench && bench_total > 0)
+	{
+		cout << "Validator cascade: " << bench_total << " validations, escalated to the full validator: " << 100.0 * (bench_total - bench_decided) / bench_total << "%";
+		if(bench_decided > 0)
+		{
+			cout << ", agreement of the cascade stage decisions with the full validator: " << 100.0 * bench_agreed / bench_decided << "%";
+		}
+		cout << endl;
+	}
 	
 	return 0;
 }
@@ -8,6 +8,7 @@
 #include <vector>
 #include "box_overlap_testing.h"
 #include "full_object_detection.h"
+#include <tbb/tbb.h>
 
 namespace dlib
 {
@@ -433,12 +434,21 @@ namespace dlib
     ) 
     {
         scanner.load(img);
-        std::vector<std::pair<double, rectangle> > dets;
+
+        // The pyramid is shared, so the filter banks (e.g. the different views of the frontal face detector) can be
+        // evaluated in parallel, they are collected in order afterwards so the result is the same as a serial scan
+        std::vector<std::vector<std::pair<double, rectangle> > > dets_per_filter(w.size());
+        tbb::parallel_for(0, (int)w.size(), [&](int i)
+        {
+            const double thresh = w[i].w(scanner.get_num_dimensions());
+            scanner.detect(w[i].get_detect_argument(), dets_per_filter[i], thresh + adjust_threshold);
+        });
+
         std::vector<rect_detection> dets_accum;
         for (unsigned long i = 0; i < w.size(); ++i)
         {
             const double thresh = w[i].w(scanner.get_num_dimensions());
-            scanner.detect(w[i].get_detect_argument(), dets, thresh + adjust_threshold);
+            const std::vector<std::pair<double, rectangle> >& dets = dets_per_filter[i];
             for (unsigned long j = 0; j < dets.size(); ++j)
             {
                 rect_detection temp;
@@ -528,18 +528,22 @@ namespace dlib
 				saliency_image.set_size(feats[0].nr(), feats[0].nc());
 				assign_all_pixels(saliency_image, 0);
 
-				// TODO this could be optimised?
-				// Sum across the saliency images
-				for(unsigned int i = 0; i < saliency_images.size(); ++i)
+				// Sum across the saliency images, in horizontal bands of rows so that large pyramid levels are split across threads
+				tbb::parallel_for(tbb::blocked_range<int>(0, (int)saliency_image.nr()), [&](const tbb::blocked_range<int>& rows)
 				{
-					for(int y = 0; y < saliency_image.nr(); ++y)
+					for(unsigned int i = 0; i < saliency_images.size(); ++i)
 					{
-						for(int x = 0; x < saliency_image.nc(); ++x)
+						for(int y = rows.begin(); y < rows.end(); ++y)
 						{
-							saliency_image[y][x] += saliency_images[i][y][x];
+							float* out = &saliency_image[y][0];
+							const float* in = &saliency_images[i][y][0];
+							for(int x = 0; x < saliency_image.nc(); ++x)
+							{
+								out[x] += in[x];
+							}
 						}
-					}					
-				}
+					}
+				});
 				
             }
             return area;
@@ -732,11 +736,18 @@ namespace dlib
 			
 			typedef typename image_traits<image_type>::pixel_type pixel_type;
 			
-			// First create the pyramids
+			// Create the pyramid, the features of each level are computed as soon as its image is ready so that
+			// the (largest and slowest) first levels are being processed while the rest of the pyramid is built
 			array<array2d<pixel_type> > image_pyramid;
 			image_pyramid.set_max_size(levels-1);
             image_pyramid.set_size(levels-1);
 
+			tbb::task_group feature_tasks;
+
+			feature_tasks.run([&]{
+				fe(img, feats[0], cell_size,filter_rows_padding,filter_cols_padding);
+			});
+
 			for(unsigned int pyr_level = 0; pyr_level < levels - 1; ++pyr_level)
 			{
 				array2d<pixel_type> temp;
@@ -749,18 +760,13 @@ namespace dlib
 					pyr(image_pyramid[pyr_level-1], temp);
 				}
 				swap(temp, image_pyramid[pyr_level]);
+
+				feature_tasks.run([&, pyr_level]{
+					fe(image_pyramid[pyr_level], feats[pyr_level+1], cell_size,filter_rows_padding,filter_cols_padding);
+				});
 			}
 
-			tbb::parallel_for(0, (int)levels, [&](int pyr_level){
-				if(pyr_level == 0)
-				{
-					fe(img, feats[pyr_level], cell_size,filter_rows_padding,filter_cols_padding);
-				}
-				else
-				{
-					fe(image_pyramid[pyr_level-1], feats[pyr_level], cell_size,filter_rows_padding,filter_cols_padding);
-				}
-			});
+			feature_tasks.wait();
         }
 
     }
@@ -984,10 +990,12 @@ namespace dlib
 
             pyramid_type pyr;
 
-			tbb::concurrent_vector<std::pair<double, rectangle>> dets_conc;
-
 			int num_features = feats.size();
 
+			// The detections are collected per pyramid level and concatenated in order afterwards, so that they (and the order of
+			// equally scored ones after sorting) do not depend on how the levels were scheduled
+			std::vector<std::vector<std::pair<double, rectangle> > > dets_per_level(num_features);
+
 			tbb::parallel_for(0, num_features, [&](int l){
 
 				array2d<float> saliency_image;
@@ -1008,15 +1016,15 @@ namespace dlib
                             rectangle rect = fe.feats_to_image(centered_rect(point(c,r),det_box_width,det_box_height), 
                                 cell_size, filter_rows_padding, filter_cols_padding);
                             rect = pyr.rect_up(rect, l);
-                            dets_conc.push_back(std::make_pair(saliency_image[r][c], rect));
+                            dets_per_level[l].push_back(std::make_pair(saliency_image[r][c], rect));
                         }
                     }
                 }
 			});	
 
-			for(size_t i = 0; i < dets_conc.size(); ++i)
+			for(int l = 0; l < num_features; ++l)
 			{
-				dets.push_back(dets_conc[i]);
+				dets.insert(dets.end(), dets_per_level[l].begin(), dets_per_level[l].end());
 			}
 
             std::sort(dets.rbegin(), dets.rend(), compare_pair_rect);
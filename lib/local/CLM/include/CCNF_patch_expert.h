@@ -96,8 +96,12 @@ public:
 	}
 
 	void Read(std::ifstream &stream);
+
+	// Precomputes the weight dft for responses on images of the given size
+	void Prepare(int im_width, int im_height);
+
 	// The im_dft, integral_img, and integral_img_sq are precomputed images for convolution speedups (they get set if passed in empty values)
-	void Response(Mat_<float> &im, Mat_<double> &im_dft, Mat &integral_img, Mat &integral_img_sq, Mat_<float> &resp);
+	void Response(Mat_<float> &im, Mat_<double> &im_dft, Mat &integral_img, Mat &integral_img_sq, Mat_<float> &resp) const;
 
 };
 
@@ -145,11 +149,14 @@ public:
 
 	void Read(std::ifstream &stream, std::vector<int> window_sizes, std::vector<std::vector<Mat_<float> > > sigma_components);
 
-	// actual work (can pass in an image and a potential depth image, if the CCNF is trained with depth)
-	void Response(Mat_<float> &area_of_interest, Mat_<float> &response);    
+	// actual work (can pass in an image and a potential depth image, if the CCNF is trained with depth), Prepare has to be called for the window size first
+	void Response(Mat_<float> &area_of_interest, Mat_<float> &response) const;
 
 	// Helper function to compute relevant sigmas
 	void ComputeSigmas(std::vector<Mat_<float> > sigma_components, int window_size);
+
+	// Computes what the responses at a window size need (the sigmas and the neuron weight dfts), after this Response does not modify the patch expert
+	void Prepare(const std::vector<Mat_<float> >& sigma_components, int window_size);
 	
 };
   //===========================================================================
@@ -53,6 +53,7 @@
 #include "Patch_experts.h"
 #include "DetectionValidator.h"
 #include "CLMParameters.h"
+#include "FaceDetectorAsync.h"
 
 using namespace std;
 using namespace cv;
@@ -60,6 +61,23 @@ using namespace cv;
 namespace CLMTracker
 {
 
+// The state of a fit of a CLM (the parameters being optimised and how well they fit), the model itself is only read while fitting
+// so several states can be fitted against the same model at once (e.g. the multi-view hypotheses, see CLM::FitHypotheses)
+struct CLM_fit_state
+{
+	Vec6d			params_global;
+	Mat_<double>	params_local;
+
+	// The landmark detection likelihoods after the last fitted scale (combined and per patch expert)
+	double			model_likelihood;
+	Mat_<double>	landmark_likelihoods;
+
+	// The PDM evaluated at the most recent parameters (shape and Jacobian), shared by the patch response and optimisation steps
+	PDM_evaluation	pdm_evaluation;
+
+	CLM_fit_state() : model_likelihood(0) {;}
+};
+
 class CLM{
 
 public:
@@ -80,6 +98,10 @@ public:
 	// Global parameters describing the rigid shape [scale, euler_x, euler_y, euler_z, tx, ty]
     Vec6d           params_global;
 
+	// Person specific non-rigid shape to start from when (re)initialising from a face detection in videos instead of the mean shape,
+	// e.g. restored from an earlier session with the same subject (empty by default, and kept on Reset)
+	Mat_<double>    params_local_prior;
+
 	// A collection of hierarchical CLM models that can be used for refinement
 	vector<CLM>						hierarchical_models;
 	vector<string>					hierarchical_model_names;
@@ -95,6 +117,9 @@ public:
 	// A HOG SVM-struct based face detector
 	dlib::frontal_face_detector face_detector_HOG;
 
+	// A background face detector used for reinitialisation in videos if CLMParameters::async_face_detection is set
+	// (created on first use, and not shared between copies of the model)
+	cv::Ptr<FaceDetectorAsync> face_detector_async;
 
 	// Validate if the detected landmarks are correct using an SVR regressor
 	DetectionValidator	landmark_validator; 
@@ -108,6 +133,12 @@ public:
 	// The actual output of the regressor (-1 is perfect detection 1 is worst detection)
 	double				detection_certainty; 
 
+	// When validation is not run on every frame (see CLMParameters::validate_every) the last certainty is reused, these keep track of 
+	// how often the validator was run and reused, and how often it disagreed with the quick likelihood test
+	int					validation_runs;
+	int					validation_reuses;
+	int					validation_disagreements;
+
 	// the triangulation per each view (for drawing purposes only)
 	vector<Mat_<int> >	triangulations;
 	
@@ -154,6 +185,15 @@ public:
 
 	// Does the actual work - landmark detection
 	bool DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CLMParameters& params);
+
+	// Fits several initialisations of the model (e.g. different orientations) in parallel, without copying the model, using params.window_sizes_current.
+	// The states are fitted scale by scale, and the ones more than params.multi_view_cancel_margin behind the best after their first scale are abandoned.
+	// Returns the index of the state with the highest likelihood among the ones not abandoned, fit_success tells which fits succeeded.
+	// The result is not stored in the model, this is followed by FinishDetection once the chosen state is stored in the model parameters
+	int FitHypotheses(vector<CLM_fit_state>& states, vector<int>& fit_success, const Mat_<uchar> &image, const Mat_<float> &depth, const CLMParameters& params);
+
+	// The rest of DetectLandmarks after the main model is fitted: the hierarchical refinement and the validation of the current parameters
+	bool FinishDetection(const Mat_<uchar> &image, const Mat_<float> &depth, bool fit_success, CLMParameters& params);
 	
 	// Gets the shape of the current detected landmarks in camera space (given camera calibration)
 	// Can only be called after a call to DetectLandmarksInVideo or DetectLandmarksInImage
@@ -176,24 +216,61 @@ public:
 	
 private:
 
+	// Validation scheduling state, frames since the validator was last run and the running statistics of the likelihood of good fits
+	int		frames_since_validation;
+	double	likelihood_mean;
+	double	likelihood_var;
+	int		likelihood_samples;
+
+	// Decides if the validator needs to be run on the current fit
+	bool ValidationNeeded(const CLMParameters& params) const;
+
+	// Updates the running likelihood statistics with a successful fit
+	void UpdateLikelihoodStatistics();
+
+	// The state of the hierarchical part models for skipping stable parts: the main model landmarks mapped to each part (n x 2)
+	// and the part landmarks at its last refit, and how many frames ago that was
+	vector<Mat_<double> >	hierarchical_anchor_landmarks;
+	vector<Mat_<double> >	hierarchical_anchor_part_landmarks;
+	vector<int>				hierarchical_frames_since_fit;
+
+	// Decides if the last fit of a part model can be reused on the current frame
+	bool PartStable(int part_model, const Mat_<double>& current_anchor, const CLMParameters& params) const;
+
 	// the speedup of RLMS using precalculated KDE responses (described in Saragih 2011 RLMS paper)
 	map<int, Mat_<float> >		kde_resp_precalc; 
 
 	// The model fitting: patch response computation and optimisation steps
     bool Fit(const Mat_<uchar>& intensity_image, const Mat_<float>& depth_image, const std::vector<int>& window_sizes, const CLMParameters& parameters);
 
+	// The scale Fit continues with after the given one (the first one with a window size the face is large enough for), -1 if there is none left
+	int NextScale(const CLM_fit_state& state, const std::vector<int>& window_sizes, int scale) const;
+
+	// Precomputes what fitting a scale needs (the patch expert caches and the KDE), after this FitScale at that scale, view and window size only reads the model
+	void PrepareScale(int scale, int view_id, int window_size, const CLMParameters& parameters);
+
+	// A single scale of the fitting of a state (patch responses, rigid and non-rigid optimisation), returns false if the face became too small to fit
+	bool FitScale(CLM_fit_state& state, const Mat_<uchar>& intensity_image, const Mat_<float>& depth_image, int scale, int window_size, const CLMParameters& parameters) const;
+
+	// The fitting parameters adapted to a scale (if parameters.refine_parameters is set)
+	CLMParameters ScaleParameters(const CLMParameters& parameters, int scale) const;
+
 	// Mean shift computation that uses precalculated kernel density estimators (the one actually used)
-	void NonVectorisedMeanShift_precalc_kde(Mat_<float>& out_mean_shifts, const vector<Mat_<float> >& patch_expert_responses, const Mat_<float> &dxs, const Mat_<float> &dys, int resp_size, float a, int scale, int view_id, map<int, Mat_<float> >& mean_shifts);
+	void NonVectorisedMeanShift_precalc_kde(Mat_<float>& out_mean_shifts, const vector<Mat_<float> >& patch_expert_responses, const Mat_<float> &dxs, const Mat_<float> &dys, int resp_size, float a, int scale, int view_id) const;
 
 	// The actual model optimisation (update step), returns the model likelihood
-    double NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector<Mat_<float> >& patch_expert_responses, const Vec6d& initial_global, const Mat_<double>& initial_local,
-		          const Mat_<double>& base_shape, const Matx22d& sim_img_to_ref, const Matx22f& sim_ref_to_img, int resp_size, int view_idx, bool rigid, int scale, Mat_<double>& landmark_lhoods, const CLMParameters& parameters);
+    double NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, PDM_evaluation& pdm_evaluation, const vector<Mat_<float> >& patch_expert_responses, const Vec6d& initial_global, const Mat_<double>& initial_local,
+		          const Mat_<double>& base_shape, const Matx22d& sim_img_to_ref, const Matx22f& sim_ref_to_img, int resp_size, int view_idx, bool rigid, int scale, Mat_<double>& landmark_lhoods, const CLMParameters& parameters) const;
 
-	// Removing background image from the depth
-	bool RemoveBackground(Mat_<float>& out_depth_image, const Mat_<float>& depth_image);
+	// Removing background image from the depth (around the face described by the state)
+	bool RemoveBackground(Mat_<float>& out_depth_image, const Mat_<float>& depth_image, const CLM_fit_state& state) const;
 
 	// Generating the weight matrix for the Weighted least squares
-	void GetWeightMatrix(Mat_<float>& WeightMatrix, int scale, int view_id, const CLMParameters& parameters);
+	void GetWeightMatrix(Mat_<float>& WeightMatrix, int scale, int view_id, const CLMParameters& parameters) const;
+
+	// Cropping the image regions used by the hierarchical part models (shared between the part models covering the same region)
+	void PrepareHierarchicalCrops(const Mat_<uchar>& image, const Mat_<float>& depth, const vector<int>& part_active, vector<int>& part_crop, vector<Mat_<uchar> >& crops,
+								  vector<Mat_<float> >& depth_crops, vector<Rect>& crop_rois, vector<double>& crop_scales) const;
 
 	//=======================================================
 	// Legacy functions that are not used at the moment
@@ -54,6 +54,8 @@
 #ifndef __CLM_PARAM_H
 #define __CLM_PARAM_H
 
+#include "CLM_concurrency.h"
+
 using namespace cv;
 using namespace std;
 
@@ -75,6 +77,16 @@ struct CLMParameters
 	// Landmark detection validator boundary for correct detection, the regressor output -1 (perfect alignment) 1 (bad alignment), 
 	double validation_boundary;
 
+	// In videos the validator can be run at least every n frames instead of every frame (1 means every frame), it is also run on (re)initialisation and
+	// when the model likelihood drops more than validation_likelihood_margin standard deviations below its running average, otherwise the last result is reused
+	int validate_every;
+	double validation_likelihood_margin;
+
+	// Experimental, a cheaper validator (SVR or NN) to run before the main one, its result is used directly if it is clearly on one side of its
+	// own calibrated boundary, and only the remaining cases are passed on to the main validator (see DetectionValidator::ReadCascadeStage for the
+	// file, it can also be set in the model file). No cascade stage is shipped with the models. It is read in with the model, not when tracking
+	string validator_cascade_location;
+
 	// Used when tracking is going well
 	vector<int> window_sizes_small;
 
@@ -99,6 +111,10 @@ struct CLMParameters
 
 	// should multiple views be considered during reinit
 	bool multi_view;
+
+	// Multiple views are fitted in parallel, views whose likelihood after the first scale is more than this behind the best one are 
+	// not fitted further (the likelihood is an average log likelihood per landmark, set to negative to always fit all of the views)
+	double multi_view_cancel_margin;
 	
 	// How often should face detection be used to attempt reinitialisation, every n frames (set to negative not to reinit)
 	int reinit_video_every;
@@ -110,18 +126,45 @@ struct CLMParameters
 	string face_detector_location;
 	FaceDetector curr_face_detector;
 
+	// Should face (re)detection in videos be done on a background thread, if so the tracker does not wait for the detector but
+	// picks up its latest result once available (the detection will be a few frames old by then)
+	bool async_face_detection;
+
+	// How many frames old can an asynchronous face detection be before it is discarded as stale
+	int async_detection_max_age;
+
+	// When reinitialising a lost face, should the area around its last location be searched first (only for faces of similar size) before 
+	// falling back to scanning the whole image, the padding is relative to the last face size and the scale band is the allowed size ratio.
+	// Off by default, as it can pick a different face than a scan of the whole image would (e.g. another person close to the last location)
+	bool roi_redetection;
+	double roi_redetection_padding;
+	double roi_redetection_scale_band;
+
 	// Should the results be visualised and reported to console
 	bool quiet_mode;
 
 	// Should the model be refined hierarchically (if available)
 	bool refine_hierarchical;
 
+	// Should the part models of the hierarchical refinement be fitted on a crop of their region (sampled once per frame and shared
+	// by the part models covering the same region), rather than on the full image. Off by default, as the crop is downscaled with area
+	// interpolation and so the part fits (and landmarks) differ slightly from the ones on the full image
+	bool hierarchical_shared_crop;
+
+	// In videos the last fit of a part model is reused (moved along with the main model) if the main model landmarks it covers moved less than
+	// hierarchical_stability_threshold pixels since it was last refit and that fit was good, the parts are refit at least every hierarchical_refit_every frames (0 threshold to always refit)
+	double hierarchical_stability_threshold;
+	int hierarchical_refit_every;
+
 	// Should the parameters be refined for different scales
 	bool refine_parameters;
 
 	// Using the brand new and experimental gaze tracker
 	bool track_gaze;
 
+	// How the parallel parts of the tracking are scheduled (thread count, arena isolation, grain sizes, serial mode)
+	ConcurrencyParameters concurrency;
+
 	CLMParameters()
 	{
 		// initialise the default values
@@ -189,6 +232,14 @@ struct CLMParameters
 				valid[i+1] = false;
 				i++;
 			}
+			else if (arguments[i].compare("-mv_cancel_margin") == 0) 
+			{
+				stringstream data(arguments[i + 1]);
+				data >> multi_view_cancel_margin;
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
 			else if(arguments[i].compare("-validate_detections") == 0)
 			{
 				stringstream data(arguments[i + 1]);
@@ -200,6 +251,22 @@ struct CLMParameters
 				valid[i+1] = false;
 				i++;
 			}
+			else if(arguments[i].compare("-validate_every") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> validate_every;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if(arguments[i].compare("-validator_cascade") == 0)
+			{
+				validator_cascade_location = arguments[i + 1];
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
 			else if(arguments[i].compare("-n_iter") == 0)
 			{
 				stringstream data(arguments[i + 1]);											
@@ -216,6 +283,99 @@ struct CLMParameters
 				valid[i] = false;
 				i++;
 			}
+			else if (arguments[i].compare("-async_detect") == 0)
+			{
+				async_face_detection = true;
+
+				valid[i] = false;
+			}
+			else if (arguments[i].compare("-roi_redetect") == 0)
+			{
+				roi_redetection = true;
+
+				valid[i] = false;
+			}
+			else if (arguments[i].compare("-part_crop") == 0)
+			{
+				hierarchical_shared_crop = true;
+
+				valid[i] = false;
+			}
+			else if (arguments[i].compare("-part_stable") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> hierarchical_stability_threshold;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-part_refit_every") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> hierarchical_refit_every;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-threads") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> concurrency.num_threads;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-serial") == 0)
+			{
+				concurrency.serial = true;
+
+				valid[i] = false;
+			}
+			else if (arguments[i].compare("-isolate_arena") == 0)
+			{
+				concurrency.isolate_arena = true;
+
+				valid[i] = false;
+			}
+			else if (arguments[i].compare("-grain_faces") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> concurrency.grain_faces;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-grain_hypotheses") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> concurrency.grain_hypotheses;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-grain_parts") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> concurrency.grain_parts;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
+			else if (arguments[i].compare("-grain_landmarks") == 0)
+			{
+				stringstream data(arguments[i + 1]);
+				data >> concurrency.grain_landmarks;
+
+				valid[i] = false;
+				valid[i+1] = false;
+				i++;
+			}
 			else if (arguments[i].compare("-q") == 0) 
 			{                    
 
@@ -242,7 +402,7 @@ struct CLMParameters
 			}
 			else if (arguments[i].compare("-help") == 0)
 			{
-				cout << "CLM parameters are defined as follows: -mloc <location of model file> -pdm_loc <override pdm location> -w_reg <weight term for patch rel.> -reg <prior regularisation> -clm_sigma <float sigma term> -fcheck <should face checking be done 0/1> -n_iter <num EM iterations> -clwild (for in the wild images) -q (quiet mode)" << endl; // Inform the user of how to use the program				
+				cout << "CLM parameters are defined as follows: -mloc <location of model file> -pdm_loc <override pdm location> -w_reg <weight term for patch rel.> -reg <prior regularisation> -clm_sigma <float sigma term> -fcheck <should face checking be done 0/1> -n_iter <num EM iterations> -validate_every <validate landmarks at least every n frames> -validator_cascade <location of a cheap validator cascade stage to run first (experimental)> -clwild (for in the wild images) -async_detect (face detection in a background thread) -roi_redetect (search around the last face location first when reinitialising) -part_crop (fit the part models on shared crops of their regions) -part_stable <reuse part fits if their landmarks moved less than this many pixels> -part_refit_every <refit the part models at least every n frames> -threads <number of threads, 0 for automatic> -serial (do not use any parallelism) -isolate_arena (run in a separate TBB task arena) -grain_faces/-grain_hypotheses/-grain_parts/-grain_landmarks <minimum iterations per task at that level> -q (quiet mode)" << endl; // Inform the user of how to use the program				
 			}
 		}
 
@@ -264,6 +424,11 @@ struct CLMParameters
 			}
 		}
 
+		if(!validator_cascade_location.empty() && !boost::filesystem::exists(boost::filesystem::path(validator_cascade_location)))
+		{
+			validator_cascade_location = (root / validator_cascade_location).string();
+		}
+
 	}
 
 	private:
@@ -279,6 +444,13 @@ struct CLMParameters
 			// Using hierarchical refinement by default (can be turned off)
 			refine_hierarchical = true;
 
+			// The part models work on the full image by default
+			hierarchical_shared_crop = false;
+
+			// The part models are refit on every frame by default
+			hierarchical_stability_threshold = 0;
+			hierarchical_refit_every = 5;
+
 			// Refining parameters by default
 			refine_parameters = true;
 
@@ -312,8 +484,13 @@ struct CLMParameters
 
 			validation_boundary = -0.45;
 
+			// Validate every frame by default
+			validate_every = 1;
+			validation_likelihood_margin = 3;
+
 			limit_pose = true;
 			multi_view = false;
+			multi_view_cancel_margin = 0.5;
 
 			reinit_video_every = 4;
 						
@@ -329,8 +506,20 @@ struct CLMParameters
 			// By default use HOG SVM
 			curr_face_detector = HOG_SVM_DETECTOR;
 
+			// Face detection in videos is synchronous by default (so that results are repeatable)
+			async_face_detection = false;
+			async_detection_max_age = 15;
+
+			// Lost faces are searched for in the whole image by default
+			roi_redetection = false;
+			roi_redetection_padding = 1.0;
+			roi_redetection_scale_band = 1.5;
+
 			// The gaze tracking has to be explicitly initialised
 			track_gaze = false;
+
+			// The concurrency defaults (all threads, grain size of one) are set by ConcurrencyParameters itself
+			concurrency = ConcurrencyParameters();
 		}
 };
 
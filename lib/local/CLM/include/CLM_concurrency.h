@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __CLM_CONCURRENCY_h_
+#define __CLM_CONCURRENCY_h_
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_arena.h>
+
+namespace CLMTracker
+{
+
+// How the parallel loops of the library (over faces, hypotheses, part models and landmarks) are scheduled, the results do not depend on
+// these settings, as each iteration only writes its own outputs and anything combined across iterations is combined in order after the loop
+struct ConcurrencyParameters
+{
+	// The number of threads the library may use (0 lets TBB decide, usually one per core)
+	int num_threads;
+
+	// Run everything on the calling thread
+	bool serial;
+
+	// Run the parallel loops of the library in its own task arena (of num_threads slots), so that they neither
+	// take part in nor wait on other TBB work of the application (e.g. when several trackers share a process)
+	bool isolate_arena;
+
+	// The minimum number of iterations handed to a task at each level of parallelism
+	int grain_faces;
+	int grain_hypotheses;
+	int grain_parts;
+	int grain_landmarks;
+
+	ConcurrencyParameters()
+	{
+		num_threads = 0;
+		serial = false;
+		isolate_arena = false;
+		grain_faces = 1;
+		grain_hypotheses = 1;
+		grain_parts = 1;
+		grain_landmarks = 1;
+	}
+};
+
+// Sets up the TBB scheduler of the calling thread (usually the main one) according to the parameters, this is what limits the number
+// of worker threads, so should be called before any tracking is done (can be called again to change the settings)
+void InitialiseConcurrency(const ConcurrencyParameters& concurrency);
+
+// The task arena the library runs in when isolate_arena is set (one per thread count, created on first use)
+tbb::task_arena& LibraryArena(int num_threads);
+
+// Calls body(i) for every i in [begin, end), in parallel unless serial mode is on, in chunks of at least grain_size iterations
+template<typename Body>
+void ParallelFor(const ConcurrencyParameters& concurrency, int begin, int end, int grain_size, const Body& body)
+{
+	if(concurrency.serial || end - begin <= 1)
+	{
+		for(int i = begin; i < end; ++i)
+		{
+			body(i);
+		}
+		return;
+	}
+
+	auto run = [&]()
+	{
+		tbb::parallel_for(tbb::blocked_range<int>(begin, end, grain_size > 0 ? grain_size : 1), [&](const tbb::blocked_range<int>& range)
+		{
+			for(int i = range.begin(); i < range.end(); ++i)
+			{
+				body(i);
+			}
+		});
+	};
+
+	// Nested loops are already running in the arena, in which case this just runs them directly
+	if(concurrency.isolate_arena)
+	{
+		LibraryArena(concurrency.num_threads).execute(run);
+	}
+	else
+	{
+		run();
+	}
+}
+
+}
+#endif
@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __CLM_TRACK_FILE_h_
+#define __CLM_TRACK_FILE_h_
+
+#include "CLM.h"
+
+using namespace std;
+using namespace cv;
+
+namespace CLMTracker
+{
+//===========================================================================
+//
+// Compact binary files with the tracking results of a video, so that the appearance based analysis can be rerun without tracking again
+// A file starts with a header (the magic "CLMT", the version, a byte order marker, the number of non-rigid modes and the frame rate as a double) and
+// is followed by a record per frame of the timestamp as an 8 byte double (floats lose precision on long recordings) and then success, detection
+// certainty, the 6 global parameters and the local parameters as 4 byte floats. Everything is written in the byte order of the writing machine,
+// the marker (0x01020304 as a 4 byte integer) lets the reader detect files from a machine of the other byte order and swap them on reading
+//===========================================================================
+class TrackFileWriter
+{
+
+public:
+
+	TrackFileWriter();
+
+	// Closes the file if it is still open
+	~TrackFileWriter();
+
+	// Creates the file and writes the header, returns false if the file could not be created
+	bool Open(const string& location, int num_modes, double fps);
+
+	bool IsOpen() const;
+
+	void WriteFrame(bool success, double certainty, double timestamp, const Vec6d& params_global, const Mat_<double>& params_local);
+
+	// The current tracking result of a model
+	void WriteFrame(const CLM& clm_model, double timestamp);
+
+	void Close();
+
+private:
+
+	// An open file can't be shared
+	TrackFileWriter(const TrackFileWriter& other);
+	TrackFileWriter & operator= (const TrackFileWriter& other);
+
+	std::ofstream track_file;
+
+	int num_modes;
+
+	// Reused for every record
+	vector<float> record;
+
+};
+
+class TrackFileReader
+{
+
+public:
+
+	TrackFileReader();
+
+	~TrackFileReader();
+
+	// Opens the file and reads the header, returns false if the file can't be read or is not a track file
+	bool Open(const string& location);
+
+	bool IsOpen() const;
+
+	// From the header
+	int NumberOfModes() const;
+	double FPS() const;
+
+	// Reads the next frame, returns false once there are no more frames
+	bool ReadFrame(bool& success, double& certainty, double& timestamp, Vec6d& params_global, Mat_<double>& params_local);
+
+	// Sets the tracking result of the model from the next frame, including the 2D landmarks, instead of tracking it (the number of
+	// modes of the model has to match the file), returns false once there are no more frames
+	bool ReadFrame(CLM& clm_model, double& timestamp);
+
+	void Close();
+
+private:
+
+	TrackFileReader(const TrackFileReader& other);
+	TrackFileReader & operator= (const TrackFileReader& other);
+
+	std::ifstream track_file;
+
+	int num_modes;
+	double fps;
+
+	// Was the file written on a machine of the other byte order
+	bool swap_bytes;
+
+	vector<float> record;
+
+};
+
+}
+#endif
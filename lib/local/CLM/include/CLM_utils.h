@@ -82,8 +82,11 @@ namespace CLMTracker
 	//===========================================================================
 	// This is a modified version of openCV code that allows for precomputed dfts of templates and for precomputed dfts of an image
 	// _img is the input img, _img_dft it's dft (optional), _integral_img the images integral image (optional), squared integral image (optional), 
-	// templ is the template we are convolving with, templ_dfts it's dfts at varying windows sizes (optional),  _result - the output, method the type of convolution
-	void matchTemplate_m( const Mat_<float>& input_img, Mat_<double>& img_dft, cv::Mat& _integral_img, cv::Mat& _integral_img_sq, const Mat_<float>&  templ, map<int, Mat_<double> >& templ_dfts, Mat_<float>& result, int method );
+	// templ is the template we are convolving with, templ_dfts it's dfts at varying windows sizes (optional, the dft is computed on the spot if missing),  _result - the output, method the type of convolution
+	void matchTemplate_m( const Mat_<float>& input_img, Mat_<double>& img_dft, cv::Mat& _integral_img, cv::Mat& _integral_img_sq, const Mat_<float>&  templ, const map<int, Mat_<double> >& templ_dfts, Mat_<float>& result, int method );
+
+	// Adds the dft of the template needed by matchTemplate_m for an input image of the given size to templ_dfts (if not there already)
+	void PrecomputeTemplateDFT(const Mat_<float>& templ, map<int, Mat_<double> >& templ_dfts, int input_width, int input_height);
 
 	//===========================================================================
 	// Point set and landmark manipulation functions
@@ -139,6 +142,8 @@ namespace CLMTracker
 	// Face detection using Haar cascade classifier
 	bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity);
 	bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity, CascadeClassifier& classifier);
+	// Only considering faces between min_size and max_size (of the Haar detection box, an empty max_size means no limit)
+	bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity, CascadeClassifier& classifier, Size min_size, Size max_size);
 	// The preference point allows for disambiguation if multiple faces are present (pick the closest one), if it is not set the biggest face is chosen
 	bool DetectSingleFace(Rect_<double>& o_region, const Mat_<uchar>& intensity, CascadeClassifier& classifier, const cv::Point preference = Point(-1,-1));
 
@@ -148,6 +153,11 @@ namespace CLMTracker
 	// The preference point allows for disambiguation if multiple faces are present (pick the closest one), if it is not set the biggest face is chosen
 	bool DetectSingleFaceHOG(Rect_<double>& o_region, const Mat_<uchar>& intensity, dlib::frontal_face_detector& classifier, double& confidence, const cv::Point preference = Point(-1,-1));
 
+	// Re-detection of a face that was lost, only searching the area around where it was last seen (the previous box expanded by padding times its size 
+	// on each side) and only for faces within scale_band times of the previous size, a lot cheaper than scanning the whole image
+	bool DetectSingleFaceInROI(Rect_<double>& o_region, const Mat_<uchar>& intensity, CascadeClassifier& classifier, const Rect_<double>& previous_face, double padding = 1.0, double scale_band = 1.5);
+	bool DetectSingleFaceHOGInROI(Rect_<double>& o_region, const Mat_<uchar>& intensity, dlib::frontal_face_detector& classifier, double& confidence, const Rect_<double>& previous_face, double padding = 1.0, double scale_band = 1.5);
+
 	//============================================================================
 	// Matrix reading functionality
 	//============================================================================
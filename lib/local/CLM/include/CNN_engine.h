@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __CNN_ENGINE_h_
+#define __CNN_ENGINE_h_
+
+using namespace std;
+using namespace cv;
+
+namespace CLMTracker
+{
+//===========================================================================
+//
+// A small convolutional neural network evaluator (used by the CNN based landmark detection validator)
+// All of the maps of a layer are kept in a single float matrix (one map per row), convolutional layers are
+// evaluated as a single matrix multiplication over all of the kernels (im2col), with the bias and the sigmoid
+// applied in the same pass, and subsampling is done in place
+//===========================================================================
+class CNN_engine
+{
+
+public:
+
+	// Default constructor
+	CNN_engine(){;}
+
+	// Sets up the network for a fixed input size from the layers read in by the DetectionValidator
+	// layer types: 0 - convolutional, 1 - subsampling, 2 - fully connected
+	// the convolutional kernels are indexed as [layer][input map][kernel]
+	void Init(const vector<int>& layer_types, const vector<vector<vector<Mat_<float> > > >& conv_kernels, const vector<vector<float> >& conv_biases,
+		const vector<int>& subsampling_scales, const vector<Mat_<float> >& fc_weights, const vector<float>& fc_biases, int input_rows, int input_cols);
+
+	// Evaluates the network on an input image (of the size the network was set up for), returning the first output of the last layer
+	float Forward(const Mat_<float>& input) const;
+
+	bool Empty() const { return layers.empty(); }
+
+private:
+
+	struct Layer
+	{
+		// 0 - convolutional, 1 - subsampling, 2 - fully connected
+		int type;
+
+		// The shapes of the maps coming in and going out
+		int in_maps, in_rows, in_cols;
+		int out_maps, out_rows, out_cols;
+
+		// The convolution kernel size
+		int kernel_rows, kernel_cols;
+
+		// The subsampling scale
+		int scale;
+
+		// The weights as a (outputs x inputs) matrix, for convolutional layers a row contains a kernel for every input map,
+		// for fully connected layers the inputs are ordered as the maps are stored
+		Mat_<float> weights;
+
+		// Bias per output (fully connected layers share a single bias)
+		vector<float> biases;
+	};
+
+	vector<Layer> layers;
+
+};
+
+}
+#endif
@@ -50,6 +50,7 @@
 #define __DValid_h_
 
 #include "PAW.h"
+#include "CNN_engine.h"
 
 using namespace std;
 using namespace cv;
@@ -102,14 +103,15 @@ public:
 	// CNN layers for each view
 	// view -> layer -> input maps -> kernels
 	vector<vector<vector<vector<Mat_<float> > > > > cnn_convolutional_layers;
-	// Bit ugly with so much nesting, but oh well
-	vector<vector<vector<vector<pair<int, Mat_<double> > > > > > cnn_convolutional_layers_dft;
 	vector<vector<vector<float > > > cnn_convolutional_layers_bias;
 	vector< vector<int> > cnn_subsampling_layers;
 	vector< vector<Mat_<float> > > cnn_fully_connected_layers;
 	vector< vector<float > > cnn_fully_connected_layers_bias;
 	// 0 - convolutional, 1 - subsampling, 2 - fully connected
 	vector<vector<int> > cnn_layer_types;
+
+	// The networks used for evaluation (one per view, built from the above layers)
+	vector<CNN_engine> cnn_engines;
 	
 	//==========================================
 
@@ -117,13 +119,31 @@ public:
 	vector<Mat_<double> > mean_images;
 	vector<Mat_<double> > standard_deviations;
 
+	//==========================================
+	// Cascade
+
+	// A cheaper validator (usually an SVR or NN) that decides the clear-cut cases before the full one is run (experimental, no stage is shipped with the models)
+	cv::Ptr<DetectionValidator> cascade_stage;
+	string cascade_stage_location;
+
+	// The decision boundary of the cascade stage calibrated on its own output (which is not on the scale of the full validator), and how far
+	// from it the output of the stage has to be for the stage to decide on its own
+	double cascade_boundary;
+	double cascade_margin;
+
+	// How many checks were decided by the cascade stage and how many were passed on to the full validator
+	int cascade_decided;
+	int cascade_escalated;
+
 	// Default constructor
-	DetectionValidator(){;}
+	DetectionValidator() : cascade_boundary(0), cascade_margin(0), cascade_decided(0), cascade_escalated(0) {;}
 
 	// Copy constructor
 	DetectionValidator(const DetectionValidator& other): orientations(other.orientations), bs(other.bs), paws(other.paws),
 		cnn_subsampling_layers(other.cnn_subsampling_layers),cnn_layer_types(other.cnn_layer_types), cnn_fully_connected_layers_bias(other.cnn_fully_connected_layers_bias),
-		cnn_convolutional_layers_bias(other.cnn_convolutional_layers_bias), cnn_convolutional_layers_dft(other.cnn_convolutional_layers_dft)
+		cnn_convolutional_layers_bias(other.cnn_convolutional_layers_bias), cnn_engines(other.cnn_engines),
+		cascade_stage_location(other.cascade_stage_location), cascade_boundary(other.cascade_boundary), cascade_margin(other.cascade_margin),
+		cascade_decided(other.cascade_decided), cascade_escalated(other.cascade_escalated)
 	{
 	
 		this->validator_type = other.validator_type;
@@ -198,33 +218,47 @@ public:
 			// Make sure the matrix is copied.
 			this->standard_deviations[i] = other.standard_deviations[i].clone();
 		}
+
+		if(!other.cascade_stage.empty())
+		{
+			this->cascade_stage = cv::makePtr<DetectionValidator>(*other.cascade_stage);
+		}
 	
 	}
 
 	// Given an image, orientation and detected landmarks output the result of the appropriate regressor
 	double Check(const Vec3d& orientation, const Mat_<uchar>& intensity_img, Mat_<double>& detected_landmarks);
 
+	// The same, but if a cascade stage is loaded its output is used directly when it is further than cascade_margin from cascade_boundary,
+	// only the ambiguous cases are passed on to the full validator. The decided outputs are shifted so that they fall on the same side of
+	// the boundary of the full validator (boundary) as they do of cascade_boundary
+	double Check(const Vec3d& orientation, const Mat_<uchar>& intensity_img, Mat_<double>& detected_landmarks, double boundary);
+
 	// Reading in the model
 	void Read(string location);
+
+	// Reading in the cheaper validator used as the first stage of the cascade, from a text file with the lines
+	// "validator <location of the validator, relative to the file>", "boundary <decision boundary>" and "margin <margin>"
+	void ReadCascadeStage(string location);
 			
 	// Getting the closest view center based on orientation
 	int GetViewId(const cv::Vec3d& orientation) const;
 
 private:
 
-	// The actual regressor application on the image
+	// The actual regressor application on the normalised face region (see WarpToNormalisedVector)
 
 	// Support Vector Regression (linear kernel)
-	double CheckSVR(const Mat_<double>& warped_img, int view_id);
+	double CheckSVR(const Mat_<double>& feature_vec, int view_id);
 
 	// Feed-forward Neural Network
-	double CheckNN(const Mat_<double>& warped_img, int view_id);
+	double CheckNN(const Mat_<double>& feature_vec, int view_id);
 
 	// Convolutional Neural Network
-	double CheckCNN(const Mat_<double>& warped_img, int view_id);
+	double CheckCNN(const Mat_<double>& feature_vec, int view_id);
 
-	// A normalisation helper
-	void NormaliseWarpedToVector(const Mat_<double>& warped_img, Mat_<double>& feature_vec, int view_id);
+	// Warping the face region inside the landmarks and normalising it (locally and using the view mean and standard deviation) into a feature vector
+	void WarpToNormalisedVector(const Mat_<uchar>& intensity_img, const Mat_<double>& detected_landmarks, Mat_<double>& feature_vec, int view_id);
 
 };
 
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#ifndef __FACE_DETECTOR_ASYNC_h_
+#define __FACE_DETECTOR_ASYNC_h_
+
+#include "CLMParameters.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+using namespace cv;
+
+namespace CLMTracker
+{
+//===========================================================================
+//
+// A face detector running on a background thread, so that (re)detection does not stall the frame loop
+// The caller keeps pushing the most recent frame, the worker only ever looks at the newest frame it has been given
+// (older pending frames are dropped) and publishes its detections together with the id of the frame they came from
+//===========================================================================
+class FaceDetectorAsync
+{
+
+public:
+
+	// Starts the worker thread, the HAAR cascade is only loaded if that detector is used
+	FaceDetectorAsync(CLMParameters::FaceDetector detector_type, const string& face_detector_location);
+
+	// Stops and joins the worker thread
+	~FaceDetectorAsync();
+
+	// Hand over the latest frame (does not block on the detection), returns the id assigned to the frame
+	int PushFrame(const Mat_<uchar>& grayscale_image);
+
+	// The newest published detections that have not been consumed yet, returns false if there is nothing new
+	// detection_frame_id is the id of the frame the detections were computed on
+	bool GetDetections(vector<Rect_<double> >& o_regions, vector<double>& o_confidences, int& detection_frame_id);
+
+	// The same as above, but picks one face: the closest one to the preference point if it is set, 
+	// otherwise the most confident one (HOG) or the biggest one (HAAR)
+	bool GetSingleDetection(Rect_<double>& o_region, double& confidence, int& detection_frame_id, const cv::Point preference = Point(-1,-1));
+
+	// The id of the most recently pushed frame
+	int LatestFrameId();
+
+	// Is the detector currently processing a frame
+	bool Busy();
+
+private:
+
+	// Copying a running thread does not make sense
+	FaceDetectorAsync(const FaceDetectorAsync& other);
+	FaceDetectorAsync & operator= (const FaceDetectorAsync& other);
+
+	void DetectionLoop();
+
+	CLMParameters::FaceDetector detector_type;
+
+	// The detectors are owned by the worker thread
+	CascadeClassifier face_detector_HAAR;
+	dlib::frontal_face_detector face_detector_HOG;
+
+	// The frame waiting to be processed (only the newest one is kept)
+	Mat_<uchar> pending_frame;
+	int pending_frame_id;
+	int latest_frame_id;
+
+	// The latest published detections
+	vector<Rect_<double> > detections;
+	vector<double> detection_confidences;
+	int detections_frame_id;
+	int consumed_frame_id;
+
+	bool busy;
+	bool stop;
+
+	std::mutex state_mutex;
+	std::condition_variable frame_available;
+	std::thread worker;
+
+};
+
+}
+#endif
@@ -108,8 +108,12 @@ public:
 	// y-source of warped points
     Mat_<float> map_y;   
 
+	// Vertical runs of valid destination pixels lying in the same triangle, in column-major order
+	// Each row is (x, first y, last y, triangle), used for sampling straight into a vector
+	Mat_<int> column_spans;
+
 	// Default constructor
-    PAW(){;}
+    PAW():number_of_pixels(0), min_x(0), min_y(0){;}
 
 	// Construct a warp from a destination shape and triangulation
 	PAW(const Mat_<double>& destination_shape, const Mat_<int>& triangulation);
@@ -119,7 +123,8 @@ public:
 
 	// Copy constructor
 	PAW(const PAW& other): destination_landmarks(other.destination_landmarks.clone()), source_landmarks(other.source_landmarks.clone()), triangulation(other.triangulation.clone()),
-		triangle_id(other.triangle_id.clone()), pixel_mask(other.pixel_mask.clone()), coefficients(other.coefficients.clone()), alpha(other.alpha.clone()), beta(other.beta.clone()), map_x(other.map_x.clone()), map_y(other.map_y.clone())
+		triangle_id(other.triangle_id.clone()), pixel_mask(other.pixel_mask.clone()), coefficients(other.coefficients.clone()), alpha(other.alpha.clone()), beta(other.beta.clone()), map_x(other.map_x.clone()), map_y(other.map_y.clone()),
+		column_spans(other.column_spans.clone())
 	{
 		this->number_of_pixels = other.number_of_pixels; 
 		this->min_x = other.min_x;
@@ -128,9 +133,17 @@ public:
 
 	void Read(std::ifstream &s);
 
+	// Recompute the mask, triangle ids and alphas/betas for a new destination shape (keeping the triangulation), reusing the allocated buffers
+	// This allows a single PAW to be cached when the destination changes from frame to frame
+	void SetDestination(const Mat_<double>& destination_shape, double in_min_x, double in_min_y, double in_max_x, double in_max_y);
+
 	// The actual warping
     void Warp(const Mat& image_to_warp, Mat& destination_image, const Mat_<double>& landmarks_to_warp);
 	
+	// Warping only the valid destination pixels, sampled with bilinear interpolation straight into a column vector (in column-major
+	// pixel order), this avoids computing the warp maps and the full warped image
+	void WarpToVector(const Mat_<uchar>& image_to_warp, Mat_<double>& sampled, const Mat_<double>& landmarks_to_warp);
+
 	// Compute coefficients needed for warping
     void CalcCoeff();
 
@@ -146,7 +159,11 @@ public:
     
 private:
 
-	int findTriangle(const cv::Point_<double>& point, const std::vector<std::vector<double>>& control_points, int guess = -1) const;
+	// Collect the column_spans from the pixel mask and triangle ids
+	void BuildColumnSpans();
+
+	// Fill in the pixel mask and triangle ids covered by a destination triangle
+	void RasteriseTriangle(int tri, const double* tri_xs, const double* tri_ys);
 
   };
   //===========================================================================
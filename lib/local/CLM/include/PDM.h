@@ -91,7 +91,7 @@ class PDM{
 		// Listing the number of modes of variation
 		inline int NumberOfModes() const {return princ_comp.cols;}
 
-		void Clamp(Mat_<float>& params_local, Vec6d& params_global, const CLMParameters& params);
+		void Clamp(Mat_<float>& params_local, Vec6d& params_global, const CLMParameters& params) const;
 
 		// Compute shape in object space (3D)
 		void CalcShape3D(Mat_<double>& out_shape, const Mat_<double>& params_local) const;
@@ -100,22 +100,70 @@ class PDM{
 		void CalcShape2D(Mat_<double>& out_shape, const Mat_<double>& params_local, const Vec6d& params_global) const;
     
 		// provided the bounding box of a face and the local parameters (with optional rotation), generates the global parameters that can generate the face with the provided bounding box
-		void CalcParams(Vec6d& out_params_global, const Rect_<double>& bounding_box, const Mat_<double>& params_local, const Vec3d rotation = Vec3d(0.0));
+		void CalcParams(Vec6d& out_params_global, const Rect_<double>& bounding_box, const Mat_<double>& params_local, const Vec3d rotation = Vec3d(0.0)) const;
 
 		// Provided the landmark location compute global and local parameters best fitting it (can provide optional rotation for potentially better results)
-		void CalcParams(Vec6d& out_params_global, const Mat_<double>& out_params_local, const Mat_<double>& landmark_locations, const Vec3d rotation = Vec3d(0.0));
+		// Landmarks with an x coordinate of 0 are treated as invisible and ignored, the PDM itself is not modified so this is safe to call concurrently
+		void CalcParams(Vec6d& out_params_global, const Mat_<double>& out_params_local, const Mat_<double>& landmark_locations, const Vec3d rotation = Vec3d(0.0)) const;
 
 		// provided the model parameters, compute the bounding box of a face
-		void CalcBoundingBox(Rect& out_bounding_box, const Vec6d& params_global, const Mat_<double>& params_local);
+		void CalcBoundingBox(Rect& out_bounding_box, const Vec6d& params_global, const Mat_<double>& params_local) const;
 
 		// Helpers for computing Jacobians, and Jacobians with the weight matrix
 		void ComputeRigidJacobian(const Mat_<float>& params_local, const Vec6d& params_global, Mat_<float> &Jacob, const Mat_<float> W, cv::Mat_<float> &Jacob_t_w);
 		void ComputeJacobian(const Mat_<float>& params_local, const Vec6d& params_global, Mat_<float> &Jacobian, const Mat_<float> W, cv::Mat_<float> &Jacob_t_w);
 
 		// Given the current parameters, and the computed delta_p compute the updated parameters
-		void UpdateModelParameters(const Mat_<float>& delta_p, Mat_<float>& params_local, Vec6d& params_global);
+		void UpdateModelParameters(const Mat_<float>& delta_p, Mat_<float>& params_local, Vec6d& params_global) const;
 
   };
+
+//===========================================================================
+// An evaluation of a PDM at a set of parameters: the 3D shape, the rotation, the 2D (image) shape and, if requested, the Jacobian
+// These are computed together in a single pass over the points, and kept until different parameters are evaluated,
+// so repeated requests for the same parameters (e.g. by the patch experts and the optimiser) are not recomputed
+class PDM_evaluation{
+	public:
+
+		// The 3D shape in object space [x1,..,xn,y1,...yn,z1,...,zn]
+		cv::Mat_<double> shape_3D;
+
+		// The rotation matrix corresponding to the global parameters
+		cv::Matx33d rotation;
+
+		// The 2D shape in image space [x1,..,xn,y1,...yn]
+		cv::Mat_<double> shape_2D;
+
+		// The Jacobian (2n x 6 if rigid, 2n x (6 + m) otherwise, same as PDM::ComputeRigidJacobian and PDM::ComputeJacobian without the weighting)
+		cv::Mat_<float> jacobian;
+
+		PDM_evaluation() : pdm_shape_data(0), has_shape(false), has_jacobian(false), jacobian_rigid(false) {;}
+
+		// Evaluate the shape (and optionally the Jacobian) at the given parameters, reusing the previous results where the parameters have not changed
+		void Evaluate(const PDM& pdm, const cv::Mat& params_local, const Vec6d& params_global, bool compute_jacobian = false, bool rigid = false);
+
+		// Project the most recently evaluated 3D shape using different global parameters
+		void Project(Mat_<double>& out_shape, const Vec6d& params_global) const;
+
+		// Forget the cached results
+		inline void Invalidate() { has_shape = false; has_jacobian = false; }
+
+	private:
+
+		// What the cached results correspond to
+		const uchar* pdm_shape_data;
+		cv::Mat_<double> cached_local;
+		Vec6d cached_global;
+
+		bool has_shape;
+		bool has_jacobian;
+		bool jacobian_rigid;
+
+		// A buffer for the local parameters in double precision
+		cv::Mat_<double> local_buffer;
+
+		void ComputeJacobian(const PDM& pdm, bool rigid);
+};
   //===========================================================================
 }
 #endif
@@ -52,6 +52,7 @@
 #include "SVR_patch_expert.h"
 #include "CCNF_patch_expert.h"
 #include "PDM.h"
+#include "CLM_concurrency.h"
 
 namespace CLMTracker
 {
@@ -119,12 +120,20 @@ public:
 		}
 	}
 
-	// Returns the patch expert responses given a grayscale and an optional depth image.
+	// Computes what the responses at a scale, view and window size need (CCNF sigmas and the dfts of the expert weights), after this Response at that
+	// scale, view and window size does not modify the patch experts, and can be called from several threads at once
+	void Prepare(int scale, int view_id, int window_size);
+
+	// Returns the patch expert responses given a grayscale and an optional depth image (Prepare has to be called for the scale, view and window size first).
 	// Additionally returns the transform from the image coordinates to the response coordinates (and vice versa).
 	// The computation also requires the current landmark locations to compute response around, the PDM corresponding to the desired model, and the parameters describing its instance
-	// Also need to provide the size of the area of interest and the desired scale of analysis
+	// Also need to provide the size of the area of interest and the desired scale of analysis, the landmarks are processed in parallel as set by concurrency
+	void Response(vector<cv::Mat_<float> >& patch_expert_responses, Matx22f& sim_ref_to_img, Matx22d& sim_img_to_ref, const Mat_<uchar>& grayscale_image, const Mat_<float>& depth_image,
+							 const PDM& pdm, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale, const ConcurrencyParameters& concurrency = ConcurrencyParameters()) const;
+
+	// The same, but using (and updating) a cached evaluation of the PDM at the current parameters
 	void Response(vector<cv::Mat_<float> >& patch_expert_responses, Matx22f& sim_ref_to_img, Matx22d& sim_img_to_ref, const Mat_<uchar>& grayscale_image, const Mat_<float>& depth_image,
-							 const PDM& pdm, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale);
+							 const PDM& pdm, PDM_evaluation& pdm_evaluation, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale, const ConcurrencyParameters& concurrency = ConcurrencyParameters()) const;
 
 	// Getting the best view associated with the current orientation
 	int GetViewIdx(const Vec6d& params_global, int scale) const;
@@ -99,9 +99,12 @@ class SVR_patch_expert{
 		// Reading in the patch expert
 		void Read(std::ifstream &stream);
 
+		// Precomputes the weight dft for responses on areas of interest of the given size
+		void Prepare(int area_width, int area_height);
+
 		// The actual response computation from intensity or depth (for CLM-Z)
-		void Response(const Mat_<float> &area_of_interest, Mat_<float> &response);    
-		void ResponseDepth(const Mat_<float> &area_of_interest, Mat_<float> &response);
+		void Response(const Mat_<float> &area_of_interest, Mat_<float> &response) const;
+		void ResponseDepth(const Mat_<float> &area_of_interest, Mat_<float> &response) const;
 
 };
 //===========================================================================
@@ -130,9 +133,12 @@ class Multi_SVR_patch_expert{
 
 		void Read(std::ifstream &stream);
 
+		// Precomputes what the responses at a window size need, after this Response does not modify the patch expert
+		void Prepare(int window_size);
+
 		// actual response computation from intensity of depth (for CLM-Z)
-		void Response(const Mat_<float> &area_of_interest, Mat_<float> &response);
-		void ResponseDepth(const Mat_<float> &area_of_interest, Mat_<float> &response);
+		void Response(const Mat_<float> &area_of_interest, Mat_<float> &response) const;
+		void ResponseDepth(const Mat_<float> &area_of_interest, Mat_<float> &response) const;
 
 };
 }
@@ -90,6 +90,20 @@ void CCNF_patch_expert::ComputeSigmas(std::vector<Mat_<float> > sigma_components
 
 }
 
+void CCNF_patch_expert::Prepare(const std::vector<Mat_<float> >& sigma_components, int window_size)
+{
+	ComputeSigmas(sigma_components, window_size);
+
+	// The area of interest for a response of window size
+	for(size_t i = 0; i < neurons.size(); i++)
+	{
+		if(neurons[i].alpha > 1e-4)
+		{
+			neurons[i].Prepare(window_size + width - 1, window_size + height - 1);
+		}
+	}
+}
+
 //===========================================================================
 void CCNF_neuron::Read(ifstream &stream)
 {
@@ -108,7 +122,13 @@ void CCNF_neuron::Read(ifstream &stream)
 }
 
 //===========================================================================
-void CCNF_neuron::Response(Mat_<float> &im, Mat_<double> &im_dft, Mat &integral_img, Mat &integral_img_sq, Mat_<float> &resp)
+void CCNF_neuron::Prepare(int im_width, int im_height)
+{
+	PrecomputeTemplateDFT(weights, weights_dfts, im_width, im_height);
+}
+
+//===========================================================================
+void CCNF_neuron::Response(Mat_<float> &im, Mat_<double> &im_dft, Mat &integral_img, Mat &integral_img_sq, Mat_<float> &resp) const
 {
 
 	int h = im.rows - weights.rows + 1;
@@ -234,7 +254,7 @@ void CCNF_patch_expert::Read(ifstream &stream, std::vector<int> window_sizes, st
 }
 
 //===========================================================================
-void CCNF_patch_expert::Response(Mat_<float> &area_of_interest, Mat_<float> &response)
+void CCNF_patch_expert::Response(Mat_<float> &area_of_interest, Mat_<float> &response) const
 {
 	
 	int response_height = area_of_interest.rows - height + 1;
@@ -277,6 +297,8 @@ void CCNF_patch_expert::Response(Mat_<float> &area_of_interest, Mat_<float> &res
 		}
 	}
 
+	assert(s_to_use != -1);
+
 	Mat_<float> resp_vec_f = response.reshape(1, response_height * response_width);
 
 	Mat out = Sigmas[s_to_use] * resp_vec_f;
@@ -71,7 +71,7 @@ CLM::CLM(string fname)
 }
 
 // Copy constructor (makes a deep copy of CLM)
-CLM::CLM(const CLM& other): pdm(other.pdm), params_local(other.params_local.clone()), params_global(other.params_global), detected_landmarks(other.detected_landmarks.clone()),
+CLM::CLM(const CLM& other): pdm(other.pdm), params_local(other.params_local.clone()), params_global(other.params_global), params_local_prior(other.params_local_prior.clone()), detected_landmarks(other.detected_landmarks.clone()),
 	landmark_likelihoods(other.landmark_likelihoods.clone()), patch_experts(other.patch_experts), landmark_validator(other.landmark_validator), face_detector_location(other.face_detector_location),
 	hierarchical_mapping(other.hierarchical_mapping), hierarchical_models(other.hierarchical_models), hierarchical_model_names(other.hierarchical_model_names),
 	hierarchical_params(other.hierarchical_params)
@@ -81,6 +81,17 @@ CLM::CLM(const CLM& other): pdm(other.pdm), params_local(other.params_local.clon
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->likelihood_mean = other.likelihood_mean;
+	this->likelihood_var = other.likelihood_var;
+	this->likelihood_samples = other.likelihood_samples;
+	this->validation_runs = other.validation_runs;
+	this->validation_reuses = other.validation_reuses;
+	this->validation_disagreements = other.validation_disagreements;
+
+	this->hierarchical_anchor_landmarks = other.hierarchical_anchor_landmarks;
+	this->hierarchical_anchor_part_landmarks = other.hierarchical_anchor_part_landmarks;
+	this->hierarchical_frames_since_fit = other.hierarchical_frames_since_fit;
 	
 	// Load the CascadeClassifier (as it does not have a proper copy constructor)
 	if(!face_detector_location.empty())
@@ -114,6 +125,7 @@ CLM & CLM::operator= (const CLM& other)
 		pdm = PDM(other.pdm);
 		params_local = other.params_local.clone();
 		params_global = other.params_global;
+		params_local_prior = other.params_local_prior.clone();
 		detected_landmarks = other.detected_landmarks.clone();
 		
 		landmark_likelihoods =other.landmark_likelihoods.clone();
@@ -126,6 +138,13 @@ CLM & CLM::operator= (const CLM& other)
 		this->detection_certainty = other.detection_certainty;
 		this->model_likelihood = other.model_likelihood;
 		this->failures_in_a_row = other.failures_in_a_row;
+		this->frames_since_validation = other.frames_since_validation;
+		this->likelihood_mean = other.likelihood_mean;
+		this->likelihood_var = other.likelihood_var;
+		this->likelihood_samples = other.likelihood_samples;
+		this->validation_runs = other.validation_runs;
+		this->validation_reuses = other.validation_reuses;
+		this->validation_disagreements = other.validation_disagreements;
 
 		// Load the CascadeClassifier (as it does not have a proper copy constructor)
 		if(!face_detector_location.empty())
@@ -161,10 +180,18 @@ CLM::CLM(const CLM&& other)
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->likelihood_mean = other.likelihood_mean;
+	this->likelihood_var = other.likelihood_var;
+	this->likelihood_samples = other.likelihood_samples;
+	this->validation_runs = other.validation_runs;
+	this->validation_reuses = other.validation_reuses;
+	this->validation_disagreements = other.validation_disagreements;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
 	params_global = other.params_global;
+	params_local_prior = other.params_local_prior;
 	detected_landmarks = other.detected_landmarks;
 	landmark_likelihoods = other.landmark_likelihoods;
 	patch_experts = other.patch_experts;
@@ -188,10 +215,18 @@ CLM & CLM::operator= (const CLM&& other)
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->likelihood_mean = other.likelihood_mean;
+	this->likelihood_var = other.likelihood_var;
+	this->likelihood_samples = other.likelihood_samples;
+	this->validation_runs = other.validation_runs;
+	this->validation_reuses = other.validation_reuses;
+	this->validation_disagreements = other.validation_disagreements;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
 	params_global = other.params_global;
+	params_local_prior = other.params_local_prior;
 	detected_landmarks = other.detected_landmarks;
 	landmark_likelihoods = other.landmark_likelihoods;
 	patch_experts = other.patch_experts;
@@ -311,7 +346,7 @@ void CLM::Read(string main_location)
 {
 
 	cout << "Reading the CLM landmark detector/tracker from: " << main_location << endl;
-	
+
 	ifstream locations(main_location.c_str(), ios_base::in);
 	if(!locations.is_open())
 	{
@@ -481,6 +516,12 @@ void CLM::Read(string main_location)
 			landmark_validator.Read(location);
 			cout << "Done" << endl;
 		}
+		else if (module.compare("DetectionValidatorCascade") == 0)
+		{            
+			cout << "Reading the landmark validation cascade stage....";
+			landmark_validator.ReadCascadeStage(location);
+			cout << "Done" << endl;
+		}
 	}
  
 	detected_landmarks.create(2 * pdm.NumberOfPoints(), 1);
@@ -502,6 +543,15 @@ void CLM::Read(string main_location)
 
 	failures_in_a_row = -1;
 
+	frames_since_validation = 0;
+	likelihood_mean = 0;
+	likelihood_var = 0;
+	likelihood_samples = 0;
+
+	validation_runs = 0;
+	validation_reuses = 0;
+	validation_disagreements = 0;
+
 }
 
 // Resetting the model (for a new video, or complet reinitialisation
@@ -521,7 +571,20 @@ void CLM::Reset()
 	params_global = Vec6d(1, 0, 0, 0, 0, 0);
 
 	failures_in_a_row = -1;
+
+	frames_since_validation = 0;
+	likelihood_mean = 0;
+	likelihood_var = 0;
+	likelihood_samples = 0;
 	face_template = Mat_<uchar>();
+
+	// The part models have to be refit after a reset
+	hierarchical_anchor_landmarks.clear();
+	hierarchical_anchor_part_landmarks.clear();
+	hierarchical_frames_since_fit.clear();
+
+	// Do not want to pick up detections from the previous video
+	face_detector_async.release();
 }
 
 // Resetting the model, choosing the face nearest (x,y)
@@ -544,15 +607,40 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 	// Fits from the current estimate of local and global parameters in clm_model
 	bool fit_success = Fit(image, depth, params.window_sizes_current, params);
 
+	return FinishDetection(image, depth, fit_success, params);
+}
+
+//=============================================================================
+bool CLM::FinishDetection(const Mat_<uchar> &image, const Mat_<float> &depth, bool fit_success, CLMParameters& params)
+{
 	// Store the landmarks converged on in detected_landmarks
 	pdm.CalcShape2D(detected_landmarks, params_local, params_global);	
 	
 	if(params.refine_hierarchical && hierarchical_models.size() > 0)
 	{
-		bool parts_used = false;		
+		int n_parts = (int)hierarchical_models.size();
 
-		// Do the hierarchical models in parallel
-		tbb::parallel_for(0, (int)hierarchical_models.size(), [&](int part_model){
+		// Which of the part models are refitted (1), moved along with their previous fit as they are stable (2), or only follow the main model (0)
+		vector<int> part_active(n_parts, 0);
+
+		// The main model landmarks mapped to each part on this frame (as n x 2 matrices)
+		vector<Mat_<double> > part_anchors(n_parts);
+
+		if((int)hierarchical_anchor_landmarks.size() != n_parts)
+		{
+			hierarchical_anchor_landmarks.assign(n_parts, Mat_<double>());
+			hierarchical_anchor_part_landmarks.assign(n_parts, Mat_<double>());
+			hierarchical_frames_since_fit.assign(n_parts, 0);
+		}
+
+		// The part models are scheduled the same way as the main one
+		for(int part_model = 0; part_model < n_parts; ++part_model)
+		{
+			hierarchical_params[part_model].concurrency = params.concurrency;
+		}
+
+		// Initialise the part models from the main model landmarks, in parallel
+		ParallelFor(params.concurrency, 0, n_parts, params.concurrency.grain_parts, [&](int part_model){
 		{
 			// Only do the synthetic eye models if we're doing gaze
 			if (!((hierarchical_model_names[part_model].compare("right_eye_28") == 0 ||
@@ -562,7 +650,7 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 
 				int n_part_points = hierarchical_models[part_model].pdm.NumberOfPoints();
 
-				vector<pair<int, int>> mappings = this->hierarchical_mapping[part_model];
+				const vector<pair<int, int>>& mappings = this->hierarchical_mapping[part_model];
 
 				Mat_<double> part_model_locs(n_part_points * 2, 1, 0.0);
 
@@ -573,24 +661,51 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 					part_model_locs.at<double>(mappings[mapping_ind].second + n_part_points) = detected_landmarks.at<double>(mappings[mapping_ind].first + this->pdm.NumberOfPoints());
 				}
 
+				part_anchors[part_model] = Mat_<double>((int)mappings.size(), 2);
+				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
+				{
+					part_anchors[part_model].at<double>((int)mapping_ind, 0) = detected_landmarks.at<double>(mappings[mapping_ind].first);
+					part_anchors[part_model].at<double>((int)mapping_ind, 1) = detected_landmarks.at<double>(mappings[mapping_ind].first + this->pdm.NumberOfPoints());
+				}
+
 				// Fit the part based model PDM
 				hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
 
 				// Only do this if we don't need to upsample
 				if (params_global[0] > 0.9 * hierarchical_models[part_model].patch_experts.patch_scaling[0])
 				{
-					parts_used = true;
+					if(PartStable(part_model, part_anchors[part_model], params))
+					{
+						// Move the last fit of the part along with the landmarks it covers (similarity transform), rather than refitting it
+						const Mat_<double>& anchor = hierarchical_anchor_landmarks[part_model];
+						const Mat_<double>& anchor_part = hierarchical_anchor_part_landmarks[part_model];
 
-					this->hierarchical_params[part_model].window_sizes_current = this->hierarchical_params[part_model].window_sizes_init;
+						Mat_<double> anchor_copy = anchor.clone();
+						Matx22d A = AlignShapesWithScale(anchor_copy, part_anchors[part_model]);
 
-					// Do the actual landmark detection
-					hierarchical_models[part_model].DetectLandmarks(image, depth, hierarchical_params[part_model]);
+						double mean_src_x = cv::mean(anchor.col(0))[0];
+						double mean_src_y = cv::mean(anchor.col(1))[0];
+						double mean_dst_x = cv::mean(part_anchors[part_model].col(0))[0];
+						double mean_dst_y = cv::mean(part_anchors[part_model].col(1))[0];
+
+						Mat_<double>& part_landmarks = hierarchical_models[part_model].detected_landmarks;
+						part_landmarks.create(anchor_part.rows, 1);
+
+						for(int i = 0; i < n_part_points; ++i)
+						{
+							double x = anchor_part.at<double>(i) - mean_src_x;
+							double y = anchor_part.at<double>(i + n_part_points) - mean_src_y;
 
-					// Reincorporate the models into main tracker
-					for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
+							part_landmarks.at<double>(i) = A(0,0) * x + A(0,1) * y + mean_dst_x;
+							part_landmarks.at<double>(i + n_part_points) = A(1,0) * x + A(1,1) * y + mean_dst_y;
+						}
+
+						hierarchical_frames_since_fit[part_model]++;
+						part_active[part_model] = 2;
+					}
+					else
 					{
-						detected_landmarks.at<double>(mappings[mapping_ind].first) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second);
-						detected_landmarks.at<double>(mappings[mapping_ind].first + pdm.NumberOfPoints()) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second + hierarchical_models[part_model].pdm.NumberOfPoints());
+						part_active[part_model] = 1;
 					}
 				}
 				else
@@ -601,6 +716,98 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 		}
 		});
 
+		// The part models covering the same region share a crop of the image around it, sampled once (no finer than the part patch experts need)
+		vector<int> part_crop(n_parts, -1);
+		vector<Mat_<uchar> > crops;
+		vector<Mat_<float> > depth_crops;
+		vector<Rect> crop_rois;
+		vector<double> crop_scales;
+
+		if(params.hierarchical_shared_crop)
+		{
+			vector<int> part_refit(n_parts);
+			for(int part_model = 0; part_model < n_parts; ++part_model)
+			{
+				part_refit[part_model] = part_active[part_model] == 1;
+			}
+			PrepareHierarchicalCrops(image, depth, part_refit, part_crop, crops, depth_crops, crop_rois, crop_scales);
+		}
+
+		bool parts_used = false;
+		for(int part_model = 0; part_model < n_parts; ++part_model)
+		{
+			parts_used = parts_used || part_active[part_model] != 0;
+		}
+
+		// Do the hierarchical models in parallel
+		ParallelFor(params.concurrency, 0, n_parts, params.concurrency.grain_parts, [&](int part_model){
+		{
+			if(part_active[part_model] == 1)
+			{
+				CLM& part = hierarchical_models[part_model];
+
+				this->hierarchical_params[part_model].window_sizes_current = this->hierarchical_params[part_model].window_sizes_init;
+
+				int crop_id = part_crop[part_model];
+
+				if(crop_id >= 0)
+				{
+					double f = crop_scales[crop_id];
+					Rect roi = crop_rois[crop_id];
+
+					// Move the part model into the frame of the crop
+					part.params_global[0] *= f;
+					part.params_global[4] = (part.params_global[4] - roi.x + 0.5) * f - 0.5;
+					part.params_global[5] = (part.params_global[5] - roi.y + 0.5) * f - 0.5;
+
+					// Do the actual landmark detection
+					part.DetectLandmarks(crops[crop_id], depth_crops[crop_id], hierarchical_params[part_model]);
+
+					// And move it back to the image frame
+					part.params_global[0] /= f;
+					part.params_global[4] = (part.params_global[4] + 0.5) / f - 0.5 + roi.x;
+					part.params_global[5] = (part.params_global[5] + 0.5) / f - 0.5 + roi.y;
+
+					int n_part_points = part.pdm.NumberOfPoints();
+					for(int i = 0; i < n_part_points; ++i)
+					{
+						part.detected_landmarks.at<double>(i) = (part.detected_landmarks.at<double>(i) + 0.5) / f - 0.5 + roi.x;
+						part.detected_landmarks.at<double>(i + n_part_points) = (part.detected_landmarks.at<double>(i + n_part_points) + 0.5) / f - 0.5 + roi.y;
+					}
+				}
+				else
+				{
+					// Do the actual landmark detection
+					part.DetectLandmarks(image, depth, hierarchical_params[part_model]);
+				}
+
+				// Remember what the part was fit to, for the stability test on the following frames
+				hierarchical_anchor_landmarks[part_model] = part_anchors[part_model];
+				hierarchical_anchor_part_landmarks[part_model] = part.detected_landmarks.clone();
+				hierarchical_frames_since_fit[part_model] = 0;
+				part.UpdateLikelihoodStatistics();
+			}
+		}
+		});
+
+		// Reincorporate the models into main tracker, serially and in part order as the mappings overlap (e.g. the eyes and the inner face),
+		// so that the later parts take precedence regardless of how the fitting above was scheduled
+		for(int part_model = 0; part_model < n_parts; ++part_model)
+		{
+			if(part_active[part_model])
+			{
+				CLM& part = hierarchical_models[part_model];
+
+				const vector<pair<int, int>>& mappings = this->hierarchical_mapping[part_model];
+
+				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
+				{
+					detected_landmarks.at<double>(mappings[mapping_ind].first) = part.detected_landmarks.at<double>(mappings[mapping_ind].second);
+					detected_landmarks.at<double>(mappings[mapping_ind].first + pdm.NumberOfPoints()) = part.detected_landmarks.at<double>(mappings[mapping_ind].second + part.pdm.NumberOfPoints());
+				}
+			}
+		}
+
 		// Recompute main model based on the fit part models
 		if(parts_used)
 		{
@@ -612,11 +819,39 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 	// Check detection correctness
 	if(params.validate_detections && fit_success)
 	{
-		Vec3d orientation(params_global[1], params_global[2], params_global[3]);
+		if(ValidationNeeded(params))
+		{
+			Vec3d orientation(params_global[1], params_global[2], params_global[3]);
 
-		detection_certainty = landmark_validator.Check(orientation, image, detected_landmarks);
+			detection_certainty = landmark_validator.Check(orientation, image, detected_landmarks, params.validation_boundary);
+
+			// Keep track of how well the likelihood test would have done on its own
+			if(likelihood_samples >= 10)
+			{
+				bool likelihood_drop = model_likelihood < likelihood_mean - params.validation_likelihood_margin * sqrt(likelihood_var);
+				bool validator_success = detection_certainty < params.validation_boundary;
+				if(likelihood_drop == validator_success)
+				{
+					validation_disagreements++;
+				}
+			}
+
+			frames_since_validation = 0;
+			validation_runs++;
+		}
+		else
+		{
+			// Reuse the certainty of the last validated frame
+			frames_since_validation++;
+			validation_reuses++;
+		}
 
 		detection_success = detection_certainty < params.validation_boundary;
+
+		if(detection_success)
+		{
+			UpdateLikelihoodStatistics();
+		}
 	}
 	else
 	{
@@ -635,23 +870,164 @@ bool CLM::DetectLandmarks(const Mat_<uchar> &image, const Mat_<float> &depth, CL
 	return detection_success;
 }
 
+//=============================================================================
+bool CLM::ValidationNeeded(const CLMParameters& params) const
+{
+	// Always validate in images, on (re)initialisation, and after a failure (detection_success still refers to the previous frame here)
+	if(params.validate_every <= 1 || !tracking_initialised || !detection_success)
+	{
+		return true;
+	}
+
+	if(frames_since_validation + 1 >= params.validate_every)
+	{
+		return true;
+	}
+
+	// Need to know what a good fit looks like before trusting the likelihood
+	if(likelihood_samples < 10)
+	{
+		return true;
+	}
+
+	// A considerable drop in likelihood indicates that the tracking might be drifting
+	return model_likelihood < likelihood_mean - params.validation_likelihood_margin * sqrt(likelihood_var);
+}
+
+void CLM::UpdateLikelihoodStatistics()
+{
+	// A running average and variance, with the older frames forgotten over time
+	likelihood_samples++;
+	double rate = std::max(1.0 / likelihood_samples, 0.05);
+
+	double diff = model_likelihood - likelihood_mean;
+	likelihood_mean = likelihood_mean + rate * diff;
+	likelihood_var = (1 - rate) * (likelihood_var + rate * diff * diff);
+}
+
+//=============================================================================
+int CLM::FitHypotheses(vector<CLM_fit_state>& states, vector<int>& fit_success, const Mat_<uchar> &image, const Mat_<float> &depth, const CLMParameters& params)
+{
+	// Making sure it is a single channel image
+	assert(image.channels() == 1);
+
+	int num_states = (int)states.size();
+	const vector<int>& window_sizes = params.window_sizes_current;
+
+	fit_success.assign(num_states, 1);
+
+	// The scale each state is fitted at next (-1 once it is done, failed or abandoned), and the states that were abandoned
+	vector<int> next_scale(num_states, -1);
+	vector<int> abandoned(num_states, 0);
+
+	// The depth images with the background around each state removed
+	vector<Mat_<float> > depth_no_background(num_states);
+
+	for(int s = 0; s < num_states; ++s)
+	{
+		if(!depth.empty() && !RemoveBackground(depth_no_background[s], depth, states[s]))
+		{
+			// The attempted background removal can fail leading to tracking failure (and the state is not fitted, so rank it last)
+			fit_success[s] = 0;
+			states[s].model_likelihood = -DBL_MAX;
+			continue;
+		}
+
+		next_scale[s] = NextScale(states[s], window_sizes, -1);
+	}
+
+	// The states are fitted a scale at a time, first preparing (serially) what the scales and views they are at need, so that the model is then
+	// only read while the states are fitted in parallel
+	for(int round = 0; ; ++round)
+	{
+		bool any_left = false;
+		for(int s = 0; s < num_states; ++s)
+		{
+			if(next_scale[s] >= 0)
+			{
+				PrepareScale(next_scale[s], patch_experts.GetViewIdx(states[s].params_global, next_scale[s]), window_sizes[next_scale[s]], params);
+				any_left = true;
+			}
+		}
+
+		if(!any_left)
+		{
+			break;
+		}
+
+		ParallelFor(params.concurrency, 0, num_states, params.concurrency.grain_hypotheses, [&](int s){
+			
+			int scale = next_scale[s];
+
+			if(scale < 0)
+			{
+				return;
+			}
+
+			// Do not use depth for the final iteration as it is not as accurate
+			const Mat_<float>& scale_depth = scale != (int)window_sizes.size() - 1 ? depth_no_background[s] : Mat_<float>();
+
+			if(!FitScale(states[s], image, scale_depth, scale, window_sizes[scale], params))
+			{
+				fit_success[s] = 0;
+				next_scale[s] = -1;
+			}
+			else
+			{
+				next_scale[s] = NextScale(states[s], window_sizes, scale);
+			}
+		});
+
+		// After the first scale only continue with the states that are not clearly behind the best one (the likelihood is an average per landmark log likelihood)
+		if(round == 0 && params.multi_view_cancel_margin >= 0)
+		{
+			double best_first_scale_likelihood = states[0].model_likelihood;
+			for(int s = 1; s < num_states; ++s)
+			{
+				best_first_scale_likelihood = std::max(best_first_scale_likelihood, states[s].model_likelihood);
+			}
+
+			for(int s = 0; s < num_states; ++s)
+			{
+				if(best_first_scale_likelihood - states[s].model_likelihood > params.multi_view_cancel_margin)
+				{
+					abandoned[s] = 1;
+					next_scale[s] = -1;
+				}
+			}
+		}
+	}
+
+	int best = -1;
+	for(int s = 0; s < num_states; ++s)
+	{
+		if(!abandoned[s] && (best < 0 || states[best].model_likelihood < states[s].model_likelihood))
+		{
+			best = s;
+		}
+	}
+
+	return best;
+}
+
 //=============================================================================
 bool CLM::Fit(const Mat_<uchar>& im, const Mat_<float>& depthImg, const std::vector<int>& window_sizes, const CLMParameters& clm_parameters)
 {
 	// Making sure it is a single channel image
 	assert(im.channels() == 1);	
-	
-	// Placeholder for the landmarks
-	Mat_<double> current_shape(2 * pdm.NumberOfPoints() , 1, 0.0);
 
-	int n = pdm.NumberOfPoints(); 
+	CLM_fit_state state;
+	state.params_global = params_global;
+	state.params_local = params_local;
+	state.model_likelihood = model_likelihood;
+	state.landmark_likelihoods = landmark_likelihoods;
 	
 	Mat_<float> depth_img_no_background;	
 	
 	// Background elimination from the depth image
 	if(!depthImg.empty())
 	{
-		bool success = RemoveBackground(depth_img_no_background, depthImg);
+		bool success = RemoveBackground(depth_img_no_background, depthImg, state);
 
 		// The attempted background removal can fail leading to tracking failure
 		if(!success)
@@ -660,118 +1036,173 @@ bool CLM::Fit(const Mat_<uchar>& im, const Mat_<float>& depthImg, const std::vec
 		}
 	}
 
-	int num_scales = patch_experts.patch_scaling.size();
-
-	// Storing the patch expert response maps
-	vector<Mat_<float> > patch_expert_responses(n);
-
-	// Converting from image space to patch expert space (normalised for rotation and scale)
-	Matx22f sim_ref_to_img;
-	Matx22d sim_img_to_ref;
-
-	CLMParameters tmp_parameters = clm_parameters;
+	bool success = true;
 
 	// Optimise the model across a number of areas of interest (usually in descending window size and ascending scale size)
-	for(int scale = 0; scale < num_scales; scale++)
+	for(int scale = NextScale(state, window_sizes, -1); scale >= 0; scale = NextScale(state, window_sizes, scale))
 	{
+		PrepareScale(scale, patch_experts.GetViewIdx(state.params_global, scale), window_sizes[scale], clm_parameters);
 
-		int window_size = window_sizes[scale];
+		// Do not use depth for the final iteration as it is not as accurate
+		const Mat_<float>& scale_depth = scale != (int)window_sizes.size() - 1 ? depth_img_no_background : Mat_<float>();
 
-		if(window_size == 0 ||  0.9 * patch_experts.patch_scaling[scale] > params_global[0])
-			continue;
+		success = FitScale(state, im, scale_depth, scale, window_sizes[scale], clm_parameters);
 
-		// The patch expert response computation
-		if(scale != window_sizes.size() - 1)
-		{
-			patch_experts.Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, im, depth_img_no_background, pdm, params_global, params_local, window_size, scale);
-		}
-		else
-		{
-			// Do not use depth for the final iteration as it is not as accurate
-			patch_experts.Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, im, Mat(), pdm, params_global, params_local, window_size, scale);
-		}
-		
-		if(clm_parameters.refine_parameters == true)
+		if(!success)
 		{
-			// Adapt the parameters based on scale (wan't to reduce regularisation as scale increases, but increa sigma and tikhonov)
-			tmp_parameters.reg_factor = clm_parameters.reg_factor - 15 * log(patch_experts.patch_scaling[scale]/0.25)/log(2);
-			
-			if(tmp_parameters.reg_factor <= 0)
-				tmp_parameters.reg_factor = 0.001;
-
-			tmp_parameters.sigma = clm_parameters.sigma + 0.25 * log(patch_experts.patch_scaling[scale]/0.25)/log(2);
-			tmp_parameters.weight_factor = clm_parameters.weight_factor + 2 * clm_parameters.weight_factor *  log(patch_experts.patch_scaling[scale]/0.25)/log(2);
+			break;
 		}
+	}
 
-		// Get the current landmark locations
-		pdm.CalcShape2D(current_shape, params_local, params_global);
+	params_global = state.params_global;
+	params_local = state.params_local;
+	model_likelihood = state.model_likelihood;
+	landmark_likelihoods = state.landmark_likelihoods;
 
-		// Get the view used by patch experts
-		int view_id = patch_experts.GetViewIdx(params_global, scale);
+	return success;
+}
 
-		// the actual optimisation step
-		this->NU_RLMS(params_global, params_local, patch_expert_responses, Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, this->landmark_likelihoods, tmp_parameters);
+int CLM::NextScale(const CLM_fit_state& state, const std::vector<int>& window_sizes, int scale) const
+{
+	int num_scales = std::min((int)window_sizes.size(), (int)patch_experts.patch_scaling.size());
 
-		// non-rigid optimisation
-		this->model_likelihood = this->NU_RLMS(params_global, params_local, patch_expert_responses, Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters);
-		
-		// Can't track very small images reliably (less than ~30px across)
-		if(params_global[0] < 0.25)
+	for(++scale; scale < num_scales; ++scale)
+	{
+		if(window_sizes[scale] != 0 && 0.9 * patch_experts.patch_scaling[scale] <= state.params_global[0])
 		{
-			cout << "Detection too small for CLM" << endl;
-			return false;
+			return scale;
 		}
 	}
-
-	return true;
+	return -1;
 }
 
-void CLM::NonVectorisedMeanShift_precalc_kde(Mat_<float>& out_mean_shifts, const vector<Mat_<float> >& patch_expert_responses, const Mat_<float> &dxs, const Mat_<float> &dys, int resp_size, float a, int scale, int view_id, map<int, Mat_<float> >& kde_resp_precalc)
+// The kernel density estimates at every step_size x step_size offset within a response window, for the mean shift computation
+static const float KDE_STEP_SIZE = 0.1f;
+
+static Mat_<float> ComputeKDE(int resp_size, float a)
 {
-	
-	int n = dxs.rows;
-	
-	Mat_<float> kde_resp;
-	float step_size = 0.1;
+	float step_size = KDE_STEP_SIZE;
 
-	// if this has not been precomputer, precompute it, otherwise use it
-	if(kde_resp_precalc.find(resp_size) == kde_resp_precalc.end())
-	{		
-		kde_resp = Mat_<float>((int)((resp_size / step_size)*(resp_size/step_size)), resp_size * resp_size);
-		MatIterator_<float> kde_it = kde_resp.begin();
+	Mat_<float> kde_resp((int)((resp_size / step_size)*(resp_size/step_size)), resp_size * resp_size);
+	MatIterator_<float> kde_it = kde_resp.begin();
 
-		for(int x = 0; x < resp_size/step_size; x++)
+	for(int x = 0; x < resp_size/step_size; x++)
+	{
+		float dx = x * step_size;
+		for(int y = 0; y < resp_size/step_size; y++)
 		{
-			float dx = x * step_size;
-			for(int y = 0; y < resp_size/step_size; y++)
-			{
-				float dy = y * step_size;
+			float dy = y * step_size;
 
-				int ii,jj;
-				float v,vx,vy;
+			int ii,jj;
+			float v,vx,vy;
 			
-				for(ii = 0; ii < resp_size; ii++)
+			for(ii = 0; ii < resp_size; ii++)
+			{
+				vx = (dy-ii)*(dy-ii);
+				for(jj = 0; jj < resp_size; jj++)
 				{
-					vx = (dy-ii)*(dy-ii);
-					for(jj = 0; jj < resp_size; jj++)
-					{
-						vy = (dx-jj)*(dx-jj);
+					vy = (dx-jj)*(dx-jj);
 
-						// the KDE evaluation of that point
-						v = exp(a*(vx+vy));
+					// the KDE evaluation of that point
+					v = exp(a*(vx+vy));
 						
-						*kde_it++ = v;
-					}
+					*kde_it++ = v;
 				}
 			}
 		}
+	}
+
+	return kde_resp;
+}
+
+void CLM::PrepareScale(int scale, int view_id, int window_size, const CLMParameters& parameters)
+{
+	patch_experts.Prepare(scale, view_id, window_size);
+
+	// The KDE used by the mean shifts at this window size (with the sigma NU_RLMS will use)
+	if(kde_resp_precalc.find(window_size) == kde_resp_precalc.end())
+	{
+		double sigma = ScaleParameters(parameters, scale).sigma;
+		kde_resp_precalc[window_size] = ComputeKDE(window_size, -0.5/(sigma * sigma));
+	}
+}
+
+CLMParameters CLM::ScaleParameters(const CLMParameters& clm_parameters, int scale) const
+{
+	CLMParameters tmp_parameters = clm_parameters;
+
+	if(clm_parameters.refine_parameters == true)
+	{
+		// Adapt the parameters based on scale (wan't to reduce regularisation as scale increases, but increa sigma and tikhonov)
+		tmp_parameters.reg_factor = clm_parameters.reg_factor - 15 * log(patch_experts.patch_scaling[scale]/0.25)/log(2);
+			
+		if(tmp_parameters.reg_factor <= 0)
+			tmp_parameters.reg_factor = 0.001;
+
+		tmp_parameters.sigma = clm_parameters.sigma + 0.25 * log(patch_experts.patch_scaling[scale]/0.25)/log(2);
+		tmp_parameters.weight_factor = clm_parameters.weight_factor + 2 * clm_parameters.weight_factor *  log(patch_experts.patch_scaling[scale]/0.25)/log(2);
+	}
 
-		kde_resp_precalc[resp_size] = kde_resp.clone();
+	return tmp_parameters;
+}
+
+bool CLM::FitScale(CLM_fit_state& state, const Mat_<uchar>& im, const Mat_<float>& depth_img_no_background, int scale, int window_size, const CLMParameters& clm_parameters) const
+{
+	int n = pdm.NumberOfPoints(); 
+
+	// Storing the patch expert response maps
+	vector<Mat_<float> > patch_expert_responses(n);
+
+	// Converting from image space to patch expert space (normalised for rotation and scale)
+	Matx22f sim_ref_to_img;
+	Matx22d sim_img_to_ref;
+
+	// The patch expert response computation
+	patch_experts.Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, im, depth_img_no_background, pdm, state.pdm_evaluation, state.params_global, state.params_local, window_size, scale, clm_parameters.concurrency);
+		
+	CLMParameters tmp_parameters = ScaleParameters(clm_parameters, scale);
+
+	// Get the current landmark locations (already evaluated for the patch expert responses)
+	Mat_<double> current_shape;
+	state.pdm_evaluation.Evaluate(pdm, state.params_local, state.params_global);
+	state.pdm_evaluation.shape_2D.copyTo(current_shape);
+
+	// Get the view used by patch experts
+	int view_id = patch_experts.GetViewIdx(state.params_global, scale);
+
+	// the actual optimisation step
+	this->NU_RLMS(state.params_global, state.params_local, state.pdm_evaluation, patch_expert_responses, Vec6d(state.params_global), state.params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, state.landmark_likelihoods, tmp_parameters);
+
+	// non-rigid optimisation
+	state.model_likelihood = this->NU_RLMS(state.params_global, state.params_local, state.pdm_evaluation, patch_expert_responses, Vec6d(state.params_global), state.params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, state.landmark_likelihoods, tmp_parameters);
+		
+	// Can't track very small images reliably (less than ~30px across)
+	if(state.params_global[0] < 0.25)
+	{
+		cout << "Detection too small for CLM" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+void CLM::NonVectorisedMeanShift_precalc_kde(Mat_<float>& out_mean_shifts, const vector<Mat_<float> >& patch_expert_responses, const Mat_<float> &dxs, const Mat_<float> &dys, int resp_size, float a, int scale, int view_id) const
+{
+	
+	int n = dxs.rows;
+	
+	Mat_<float> kde_resp;
+	float step_size = KDE_STEP_SIZE;
+
+	// use the precomputed version if available (see PrepareScale), otherwise compute it for this call only
+	map<int, Mat_<float> >::const_iterator precomputed = kde_resp_precalc.find(resp_size);
+	if(precomputed != kde_resp_precalc.end())
+	{
+		kde_resp = precomputed->second;
 	}
 	else
 	{
-		// use the precomputed version
-		kde_resp = kde_resp_precalc.find(resp_size)->second;
+		kde_resp = ComputeKDE(resp_size, a);
 	}
 
 	// for every point (patch) calculating mean-shift
@@ -840,7 +1271,163 @@ void CLM::NonVectorisedMeanShift_precalc_kde(Mat_<float>& out_mean_shifts, const
 
 }
 
-void CLM::GetWeightMatrix(Mat_<float>& WeightMatrix, int scale, int view_id, const CLMParameters& parameters)
+//=============================================================================
+// Can the last fit of a part model be reused: the main model landmarks it covers have moved less than the stability threshold since it was
+// last refit, that fit was good (its likelihood was not considerably below its running average), and it has not been reused for too long
+bool CLM::PartStable(int part_model, const Mat_<double>& current_anchor, const CLMParameters& params) const
+{
+	if(params.hierarchical_stability_threshold <= 0)
+	{
+		return false;
+	}
+
+	const Mat_<double>& anchor = hierarchical_anchor_landmarks[part_model];
+
+	if(anchor.empty() || anchor.rows != current_anchor.rows || hierarchical_frames_since_fit[part_model] + 1 >= params.hierarchical_refit_every)
+	{
+		return false;
+	}
+
+	const CLM& part = hierarchical_models[part_model];
+
+	if(part.likelihood_samples < 10 || part.model_likelihood < part.likelihood_mean - params.validation_likelihood_margin * sqrt(part.likelihood_var))
+	{
+		return false;
+	}
+
+	for(int i = 0; i < anchor.rows; ++i)
+	{
+		double dx = current_anchor.at<double>(i, 0) - anchor.at<double>(i, 0);
+		double dy = current_anchor.at<double>(i, 1) - anchor.at<double>(i, 1);
+
+		if(dx * dx + dy * dy > params.hierarchical_stability_threshold * params.hierarchical_stability_threshold)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//=============================================================================
+// Cropping the regions covered by the active part models, part models mapped to the same main model landmarks share a crop.
+// A crop covers the mapped landmarks and the patch expert search areas around them, and is downscaled if the face is larger than
+// the finest patch expert scale of its part models requires. part_crop is -1 for parts that should use the full image
+void CLM::PrepareHierarchicalCrops(const Mat_<uchar>& image, const Mat_<float>& depth, const vector<int>& part_active, vector<int>& part_crop, vector<Mat_<uchar> >& crops,
+								   vector<Mat_<float> >& depth_crops, vector<Rect>& crop_rois, vector<double>& crop_scales) const
+{
+	int n = pdm.NumberOfPoints();
+
+	// The support of the patch experts, added to the search window when computing the area needed around a landmark
+	const int patch_support = 11;
+
+	// Group the part models by the main model landmarks they map to
+	vector<vector<int> > crop_landmarks;
+	for(size_t part_model = 0; part_model < hierarchical_models.size(); ++part_model)
+	{
+		if(!part_active[part_model])
+		{
+			continue;
+		}
+
+		vector<int> mapped;
+		for(size_t mapping_ind = 0; mapping_ind < hierarchical_mapping[part_model].size(); ++mapping_ind)
+		{
+			mapped.push_back(hierarchical_mapping[part_model][mapping_ind].first);
+		}
+		std::sort(mapped.begin(), mapped.end());
+
+		size_t crop_id = std::find(crop_landmarks.begin(), crop_landmarks.end(), mapped) - crop_landmarks.begin();
+		if(crop_id == crop_landmarks.size())
+		{
+			crop_landmarks.push_back(mapped);
+		}
+		part_crop[part_model] = (int)crop_id;
+	}
+
+	crops.resize(crop_landmarks.size());
+	depth_crops.resize(crop_landmarks.size());
+	crop_rois.resize(crop_landmarks.size());
+	crop_scales.resize(crop_landmarks.size());
+
+	for(size_t crop_id = 0; crop_id < crop_landmarks.size(); ++crop_id)
+	{
+		double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+		for(size_t i = 0; i < crop_landmarks[crop_id].size(); ++i)
+		{
+			double x = detected_landmarks.at<double>(crop_landmarks[crop_id][i]);
+			double y = detected_landmarks.at<double>(crop_landmarks[crop_id][i] + n);
+			min_x = std::min(min_x, x);
+			max_x = std::max(max_x, x);
+			min_y = std::min(min_y, y);
+			max_y = std::max(max_y, y);
+		}
+
+		// The area searched by the part models, and the resolution they need
+		double search_extent = 0;
+		double scale = 0;
+		for(size_t part_model = 0; part_model < hierarchical_models.size(); ++part_model)
+		{
+			if(part_crop[part_model] != (int)crop_id)
+			{
+				continue;
+			}
+
+			const vector<double>& patch_scaling = hierarchical_models[part_model].patch_experts.patch_scaling;
+			const vector<int>& window_sizes = hierarchical_params[part_model].window_sizes_init;
+			double part_scale = hierarchical_models[part_model].params_global[0];
+
+			for(size_t s = 0; s < window_sizes.size() && s < patch_scaling.size(); ++s)
+			{
+				search_extent = std::max(search_extent, (window_sizes[s] + patch_support) * part_scale / patch_scaling[s]);
+				scale = std::max(scale, patch_scaling[s] / part_scale);
+			}
+		}
+
+		// The part landmarks not mapped to the main model and the movement during fitting are covered by extra padding
+		double margin = search_extent / 2.0 + 0.5 * std::max(max_x - min_x, max_y - min_y);
+
+		Rect roi((int)(min_x - margin), (int)(min_y - margin), (int)(max_x - min_x + 2 * margin) + 1, (int)(max_y - min_y + 2 * margin) + 1);
+		roi = roi & Rect(0, 0, image.cols, image.rows);
+
+		double f = std::min(1.0, scale);
+
+		if(roi.width < 2 || roi.height < 2 || f <= 0)
+		{
+			// Nothing sensible to crop, use the full image instead
+			for(size_t part_model = 0; part_model < part_crop.size(); ++part_model)
+			{
+				if(part_crop[part_model] == (int)crop_id)
+				{
+					part_crop[part_model] = -1;
+				}
+			}
+			continue;
+		}
+
+		if(f < 1.0)
+		{
+			cv::resize(image(roi), crops[crop_id], Size(), f, f, INTER_AREA);
+			if(!depth.empty())
+			{
+				cv::resize(depth(roi), depth_crops[crop_id], Size(), f, f, INTER_NEAREST);
+			}
+		}
+		else
+		{
+			image(roi).copyTo(crops[crop_id]);
+			if(!depth.empty())
+			{
+				depth(roi).copyTo(depth_crops[crop_id]);
+			}
+		}
+
+		crop_rois[crop_id] = roi;
+		crop_scales[crop_id] = f;
+	}
+}
+
+void CLM::GetWeightMatrix(Mat_<float>& WeightMatrix, int scale, int view_id, const CLMParameters& parameters) const
 {
 	int n = pdm.NumberOfPoints();  
 
@@ -883,9 +1470,9 @@ void CLM::GetWeightMatrix(Mat_<float>& WeightMatrix, int scale, int view_id, con
 }
 
 //=============================================================================
-double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector<Mat_<float> >& patch_expert_responses, const Vec6d& initial_global, const Mat_<double>& initial_local,
+double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, PDM_evaluation& pdm_evaluation, const vector<Mat_<float> >& patch_expert_responses, const Vec6d& initial_global, const Mat_<double>& initial_local,
 		          const Mat_<double>& base_shape, const Matx22d& sim_img_to_ref, const Matx22f& sim_ref_to_img, int resp_size, int view_id, bool rigid, int scale, Mat_<double>& landmark_lhoods,
-				  const CLMParameters& parameters)
+				  const CLMParameters& parameters) const
 {		
 
 	int n = pdm.NumberOfPoints();  
@@ -902,7 +1489,6 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 	Mat_<float> current_local;
 	initial_local.convertTo(current_local, CV_32F);
 
-	Mat_<double> current_shape;
 	Mat_<double> previous_shape;
 
 	// Pre-calculate the regularisation term
@@ -925,6 +1511,18 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 	Mat_<float> WeightMatrix;
 	GetWeightMatrix(WeightMatrix, scale, view_id, parameters);
 
+	// The weights of the individual coordinates (the diagonal of the weight matrix), landmarks without a patch expert are not used
+	Mat_<float> weights(2 * n, 1);
+	for(int i = 0; i < n; ++i)
+	{
+		bool visible = patch_experts.visibilities[scale][view_id].at<int>(i,0) != 0;
+		weights.at<float>(i) = visible ? WeightMatrix.at<float>(i, i) : 0.0f;
+		weights.at<float>(i + n) = visible ? WeightMatrix.at<float>(i + n, i + n) : 0.0f;
+	}
+
+	// The weighted Jacobian and the normal equations, reused across iterations
+	Mat_<float> J_w, J_w_t_m, Hessian;
+
 	Mat_<float> dxs, dys;
 	
 	// The preallocated memory for the mean shifts
@@ -933,8 +1531,9 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 	// Number of iterations
 	for(int iter = 0; iter < parameters.num_optimisation_iteration; iter++)
 	{
-		// get the current estimates of x
-		pdm.CalcShape2D(current_shape, current_local, current_global);
+		// get the current estimates of x, and the Jacobian in the same pass
+		pdm_evaluation.Evaluate(pdm, current_local, current_global, true, rigid);
+		const Mat_<double>& current_shape = pdm_evaluation.shape_2D;
 		
 		if(iter > 0)
 		{
@@ -947,18 +1546,8 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 
 		current_shape.copyTo(previous_shape);
 		
-		// Jacobian, and transposed weighted jacobian
-		Mat_<float> J, J_w_t;
-
-		// calculate the appropriate Jacobians in 2D, even though the actual behaviour is in 3D, using small angle approximation and oriented shape
-		if(rigid)
-		{
-			pdm.ComputeRigidJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
-		}
-		else
-		{
-			pdm.ComputeJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
-		}
+		// The appropriate Jacobian in 2D, even though the actual behaviour is in 3D, using small angle approximation and oriented shape
+		const Mat_<float>& J = pdm_evaluation.jacobian;
 		
 		// useful for mean shift calculation
 		float a = -0.5/(parameters.sigma * parameters.sigma);
@@ -972,7 +1561,7 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 		dxs = offsets.col(0) + (resp_size-1)/2;
 		dys = offsets.col(1) + (resp_size-1)/2;
 		
-		NonVectorisedMeanShift_precalc_kde(mean_shifts, patch_expert_responses, dxs, dys, resp_size, a, scale, view_id, kde_resp_precalc);
+		NonVectorisedMeanShift_precalc_kde(mean_shifts, patch_expert_responses, dxs, dys, resp_size, a, scale, view_id);
 
 		// Now transform the mean shifts to the the image reference frame, as opposed to one of ref shape (object space)
 		Mat_<float> mean_shifts_2D = (mean_shifts.reshape(1, 2)).t();
@@ -980,23 +1569,33 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 		mean_shifts_2D = mean_shifts_2D * Mat(sim_ref_to_img).t();
 		mean_shifts = Mat(mean_shifts_2D.t()).reshape(1, n*2);		
 
-		// remove non-visible observations
+		// remove non-visible observations (their Jacobian rows are removed by the zero weights)
 		for(int i = 0; i < n; ++i)
 		{
 			// if patch unavailable for current index
 			if(patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
 			{				
-				Mat Jx = J.row(i);
-				Jx = cvScalar(0);
-				Mat Jy = J.row(i+n);
-				Jy = cvScalar(0);
 				mean_shifts.at<float>(i,0) = 0.0f;
 				mean_shifts.at<float>(i+n,0) = 0.0f;
 			}
 		}
 
+		// Weight the Jacobian rows
+		J_w.create(J.rows, J.cols);
+		for(int r = 0; r < J.rows; ++r)
+		{
+			float w = weights.at<float>(r);
+			const float* J_row = J.ptr<float>(r);
+			float* J_w_row = J_w.ptr<float>(r);
+
+			for(int c = 0; c < J.cols; ++c)
+			{
+				J_w_row[c] = J_row[c] * w;
+			}
+		}
+
 		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		Mat_<float> J_w_t_m = J_w_t * mean_shifts;
+		cv::gemm(J_w, mean_shifts, 1, noArray(), 0, J_w_t_m, GEMM_1_T);
 
 		// Add the regularisation term
 		if(!rigid)
@@ -1004,11 +1603,8 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 			J_w_t_m(Rect(0,6,1, m)) = J_w_t_m(Rect(0,6,1, m)) - regTerm(Rect(6,6, m, m)) * current_local;
 		}
 
-		// Calculating the Hessian approximation
-		Mat_<float> Hessian = J_w_t * J;
-
-		// Add the Tikhonov regularisation
-		Hessian = Hessian + regTerm;
+		// Calculating the Hessian approximation, with the Tikhonov regularisation added
+		cv::gemm(J_w, J, 1, regTerm, 1, Hessian, GEMM_1_T);
 
 		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
 		Mat_<float> param_update;
@@ -1075,11 +1671,11 @@ double CLM::NU_RLMS(Vec6d& final_global, Mat_<double>& final_local, const vector
 }
 
 
-bool CLM::RemoveBackground(Mat_<float>& out_depth_image, const Mat_<float>& depth_image)
+bool CLM::RemoveBackground(Mat_<float>& out_depth_image, const Mat_<float>& depth_image, const CLM_fit_state& state) const
 {
 	// use the current estimate of the face location to determine what is foreground and background
-	double tx = this->params_global[4];
-	double ty = this->params_global[5];
+	double tx = state.params_global[4];
+	double ty = state.params_global[5];
 
 	// if we are too close to the edge fail
 	if(tx - 9 <= 0 || ty - 9 <= 0 || tx + 9 >= depth_image.cols || ty + 9 >= depth_image.rows)
@@ -1090,7 +1686,7 @@ bool CLM::RemoveBackground(Mat_<float>& out_depth_image, const Mat_<float>& dept
 
 	Mat_<double> current_shape;
 
-	pdm.CalcShape2D(current_shape, params_local, params_global);
+	pdm.CalcShape2D(current_shape, state.params_local, state.params_global);
 
 	double min_x, max_x, min_y, max_y;
 
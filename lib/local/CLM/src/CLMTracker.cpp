@@ -210,6 +210,19 @@ Vec6d CLMTracker::GetCorrectedPoseCamera(const CLM& clm_model, double fx, double
 	}
 }
 
+// The shape to start fitting from after a face detection, the mean one or the person specific prior if it has been set
+void InitialiseLocalParams(CLM& clm_model)
+{
+	if(clm_model.params_local_prior.rows == clm_model.params_local.rows && !clm_model.params_local_prior.empty())
+	{
+		clm_model.params_local_prior.copyTo(clm_model.params_local);
+	}
+	else
+	{
+		clm_model.params_local.setTo(0);
+	}
+}
+
 // If landmark detection in video succeeded create a template for use in simple tracking
 void UpdateTemplate(const Mat_<uchar> &grayscale_image, CLM& clm_model)
 {
@@ -309,10 +322,15 @@ bool CLMTracker::DetectLandmarksInVideo(const Mat_<uchar> &grayscale_image, cons
 		}
 	}
 
+	// With asynchronous detection the frame is just handed over to the background detector whenever we are not tracking,
+	// and reinitialisation is attempted as soon as it comes back with a (recent enough) detection
+	bool async_reinit = params.async_face_detection && (!clm_model.tracking_initialised || (!clm_model.detection_success && params.reinit_video_every > 0));
+
 	// This is used for both detection (if it the tracking has not been initialised yet) or if the tracking failed (however we do this every n frames, for speed)
 	// This also has the effect of an attempt to reinitialise just after the tracking has failed, which is useful during large motions
-	if((!clm_model.tracking_initialised && (clm_model.failures_in_a_row + 1) % (params.reinit_video_every * 6) == 0) 
-		|| (clm_model.tracking_initialised && !clm_model.detection_success && params.reinit_video_every > 0 && clm_model.failures_in_a_row % params.reinit_video_every == 0))
+	if(async_reinit || (!params.async_face_detection && 
+		((!clm_model.tracking_initialised && (clm_model.failures_in_a_row + 1) % (params.reinit_video_every * 6) == 0) 
+		|| (clm_model.tracking_initialised && !clm_model.detection_success && params.reinit_video_every > 0 && clm_model.failures_in_a_row % params.reinit_video_every == 0))))
 	{
 
 		Rect_<double> bounding_box;
@@ -329,18 +347,68 @@ bool CLMTracker::DetectLandmarksInVideo(const Mat_<uchar> &grayscale_image, cons
 		{
 			preference_det.x = clm_model.preference_det.x * grayscale_image.cols;
 			preference_det.y = clm_model.preference_det.y * grayscale_image.rows;
-			clm_model.preference_det = Point(-1, -1);
 		}
 
-		bool face_detection_success;
-		if(params.curr_face_detector == CLMParameters::HOG_SVM_DETECTOR)
+		bool face_detection_success = false;
+		if(async_reinit)
 		{
+			if(clm_model.face_detector_async.empty())
+			{
+				clm_model.face_detector_async = cv::makePtr<FaceDetectorAsync>(params.curr_face_detector, params.face_detector_location);
+			}
+
+			int current_frame_id = clm_model.face_detector_async->PushFrame(grayscale_image);
+
 			double confidence;
-			face_detection_success = CLMTracker::DetectSingleFaceHOG(bounding_box, grayscale_image, clm_model.face_detector_HOG, confidence, preference_det);
+			int detection_frame_id;
+			face_detection_success = clm_model.face_detector_async->GetSingleDetection(bounding_box, confidence, detection_frame_id, preference_det);
+
+			// The face might have moved too much since the detection
+			if(face_detection_success && current_frame_id - detection_frame_id > params.async_detection_max_age)
+			{
+				face_detection_success = false;
+			}
+
+			// Keep the preference until a detection actually gets used
+			if(face_detection_success)
+			{
+				clm_model.preference_det = Point(-1, -1);
+			}
 		}
-		else if(params.curr_face_detector == CLMParameters::HAAR_DETECTOR)
+		else
 		{
-			face_detection_success = CLMTracker::DetectSingleFace(bounding_box, grayscale_image, clm_model.face_detector_HAAR, preference_det);
+			clm_model.preference_det = Point(-1, -1);
+
+			// If the face was lost it is most likely still close to where it was last seen and of similar size, so look there first
+			if(params.roi_redetection && clm_model.tracking_initialised)
+			{
+				Rect previous_face;
+				clm_model.pdm.CalcBoundingBox(previous_face, clm_model.params_global, clm_model.params_local);
+
+				if(params.curr_face_detector == CLMParameters::HOG_SVM_DETECTOR)
+				{
+					double confidence;
+					face_detection_success = CLMTracker::DetectSingleFaceHOGInROI(bounding_box, grayscale_image, clm_model.face_detector_HOG, confidence, previous_face, params.roi_redetection_padding, params.roi_redetection_scale_band);
+				}
+				else if(params.curr_face_detector == CLMParameters::HAAR_DETECTOR)
+				{
+					face_detection_success = CLMTracker::DetectSingleFaceInROI(bounding_box, grayscale_image, clm_model.face_detector_HAAR, previous_face, params.roi_redetection_padding, params.roi_redetection_scale_band);
+				}
+			}
+
+			// Fall back to scanning the whole image
+			if(!face_detection_success)
+			{
+				if(params.curr_face_detector == CLMParameters::HOG_SVM_DETECTOR)
+				{
+					double confidence;
+					face_detection_success = CLMTracker::DetectSingleFaceHOG(bounding_box, grayscale_image, clm_model.face_detector_HOG, confidence, preference_det);
+				}
+				else if(params.curr_face_detector == CLMParameters::HAAR_DETECTOR)
+				{
+					face_detection_success = CLMTracker::DetectSingleFace(bounding_box, grayscale_image, clm_model.face_detector_HAAR, preference_det);
+				}
+			}
 		}
 
 		// Attempt to detect landmarks using the detected face (if unseccessful the detection will be ignored)
@@ -356,8 +424,8 @@ bool CLMTracker::DetectLandmarksInVideo(const Mat_<uchar> &grayscale_image, cons
 			Mat_<double> detected_landmarks_init = clm_model.detected_landmarks.clone();
 			Mat_<double> landmark_likelihoods_init = clm_model.landmark_likelihoods.clone();
 
-			// Use the detected bounding box and empty local parameters
-			clm_model.params_local.setTo(0);
+			// Use the detected bounding box and empty (or the person specific) local parameters
+			InitialiseLocalParams(clm_model);
 			clm_model.pdm.CalcParams(clm_model.params_global, bounding_box, clm_model.params_local);		
 
 			// Make sure the search size is large
@@ -412,7 +480,7 @@ bool CLMTracker::DetectLandmarksInVideo(const Mat_<uchar> &grayscale_image, cons
 	if(bounding_box.width > 0)
 	{
 		// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
-		clm_model.params_local.setTo(0);
+		InitialiseLocalParams(clm_model);
 		clm_model.pdm.CalcParams(clm_model.params_global, bounding_box, clm_model.params_local);		
 
 		// indicate that face was detected so initialisation is not necessary
@@ -463,78 +531,45 @@ bool CLMTracker::DetectLandmarksInImage(const Mat_<uchar> &grayscale_image, cons
 	
 	// Use the initialisation size for the landmark detection
 	params.window_sizes_current = params.window_sizes_init;
-	
-	// Store the current best estimate
-	double best_likelihood;
-	Vec6d best_global_parameters;
-	Mat_<double> best_local_parameters;
-	Mat_<double> best_detected_landmarks;
-	Mat_<double> best_landmark_likelihoods;
-	bool best_success;
-
-	// The hierarchical model parameters
-	vector<double> best_likelihood_h(clm_model.hierarchical_models.size());
-	vector<Vec6d> best_global_parameters_h(clm_model.hierarchical_models.size());
-	vector<Mat_<double>> best_local_parameters_h(clm_model.hierarchical_models.size());
-	vector<Mat_<double>> best_detected_landmarks_h(clm_model.hierarchical_models.size());
-	vector<Mat_<double>> best_landmark_likelihoods_h(clm_model.hierarchical_models.size());
 
-	for(size_t hypothesis = 0; hypothesis < rotation_hypotheses.size(); ++hypothesis)
-	{
-		// Reset the potentially set clm_model parameters
-		clm_model.params_local.setTo(0.0);
+	// Reset the potentially set clm_model parameters
+	clm_model.params_local.setTo(0.0);
 
-		for (size_t part = 0; part < clm_model.hierarchical_models.size(); ++part)
-		{
-			clm_model.hierarchical_models[part].params_local.setTo(0.0);
-		}
+	for (size_t part = 0; part < clm_model.hierarchical_models.size(); ++part)
+	{
+		clm_model.hierarchical_models[part].params_local.setTo(0.0);
+	}
 
+	if(rotation_hypotheses.size() == 1)
+	{
 		// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
-		clm_model.pdm.CalcParams(clm_model.params_global, bounding_box, clm_model.params_local, rotation_hypotheses[hypothesis]);
-	
-		bool success = clm_model.DetectLandmarks(grayscale_image, depth_image, params);	
-
-		if(hypothesis == 0 || best_likelihood < clm_model.model_likelihood)
-		{
-			best_likelihood = clm_model.model_likelihood;
-			best_global_parameters = clm_model.params_global;
-			best_local_parameters = clm_model.params_local.clone();
-			best_detected_landmarks = clm_model.detected_landmarks.clone();
-			best_landmark_likelihoods = clm_model.landmark_likelihoods.clone();
-			best_success = success;
-		}
-
-		for (size_t part = 0; part < clm_model.hierarchical_models.size(); ++part)
-		{
-			if (hypothesis == 0 || best_likelihood < clm_model.hierarchical_models[part].model_likelihood)
-			{
-				best_likelihood_h[part] = clm_model.hierarchical_models[part].model_likelihood;
-				best_global_parameters_h[part] = clm_model.hierarchical_models[part].params_global;
-				best_local_parameters_h[part] = clm_model.hierarchical_models[part].params_local.clone();
-				best_detected_landmarks_h[part] = clm_model.hierarchical_models[part].detected_landmarks.clone();
-				best_landmark_likelihoods_h[part] = clm_model.hierarchical_models[part].landmark_likelihoods.clone();
-			}
-		}
+		clm_model.pdm.CalcParams(clm_model.params_global, bounding_box, clm_model.params_local, rotation_hypotheses[0]);
 
+		return clm_model.DetectLandmarks(grayscale_image, depth_image, params);
 	}
 
-	// Store the best estimates in the clm_model
-	clm_model.model_likelihood = best_likelihood;
-	clm_model.params_global = best_global_parameters;
-	clm_model.params_local = best_local_parameters.clone();
-	clm_model.detected_landmarks = best_detected_landmarks.clone();
-	clm_model.detection_success = best_success;
-	clm_model.landmark_likelihoods = best_landmark_likelihoods.clone();
+	// The hypotheses are fitted in parallel on their own fitting states against the shared model
+	vector<CLM_fit_state> hypotheses(rotation_hypotheses.size());
 
-	for (size_t part = 0; part < clm_model.hierarchical_models.size(); ++part)
+	for(size_t hypothesis = 0; hypothesis < rotation_hypotheses.size(); ++hypothesis)
 	{
-		clm_model.hierarchical_models[part].params_global = best_global_parameters_h[part];
-		clm_model.hierarchical_models[part].params_local = best_local_parameters_h[part].clone();
-		clm_model.hierarchical_models[part].detected_landmarks = best_detected_landmarks_h[part].clone();
-		clm_model.hierarchical_models[part].landmark_likelihoods = best_landmark_likelihoods_h[part].clone();
+		CLM_fit_state& state = hypotheses[hypothesis];
+
+		state.params_local = Mat_<double>::zeros(clm_model.params_local.rows, clm_model.params_local.cols);
+
+		clm_model.pdm.CalcParams(state.params_global, bounding_box, state.params_local, rotation_hypotheses[hypothesis]);
 	}
 
-	return best_success;
+	vector<int> fit_success;
+	int best = clm_model.FitHypotheses(hypotheses, fit_success, grayscale_image, depth_image, params);
+
+	// Store the best estimate in the clm_model, and refine and validate only that one
+	clm_model.params_global = hypotheses[best].params_global;
+	clm_model.params_local = hypotheses[best].params_local;
+	clm_model.model_likelihood = hypotheses[best].model_likelihood;
+	clm_model.landmark_likelihoods = hypotheses[best].landmark_likelihoods;
+
+	return clm_model.FinishDetection(grayscale_image, depth_image, fit_success[best] != 0, params);
 }
 
 bool CLMTracker::DetectLandmarksInImage(const Mat_<uchar> &grayscale_image, const Mat_<float> depth_image, CLM& clm_model, CLMParameters& params)
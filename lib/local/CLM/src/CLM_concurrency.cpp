@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+
+#include "CLM_concurrency.h"
+
+#include <tbb/task_scheduler_init.h>
+
+#include <mutex>
+#include <memory>
+
+namespace CLMTracker
+{
+
+namespace
+{
+	std::mutex concurrency_mutex;
+
+	// The scheduler of the thread that called InitialiseConcurrency
+	std::unique_ptr<tbb::task_scheduler_init> scheduler;
+
+	// The arenas are never destroyed, as loops might still be running in them while the process shuts down
+	std::map<int, tbb::task_arena*> arenas;
+}
+
+void InitialiseConcurrency(const ConcurrencyParameters& concurrency)
+{
+	std::lock_guard<std::mutex> lock(concurrency_mutex);
+
+	int num_threads = tbb::task_scheduler_init::automatic;
+	if(concurrency.serial)
+	{
+		num_threads = 1;
+	}
+	else if(concurrency.num_threads > 0)
+	{
+		num_threads = concurrency.num_threads;
+	}
+
+	// Only one scheduler can be active on a thread at a time
+	scheduler.reset();
+	scheduler.reset(new tbb::task_scheduler_init(num_threads));
+}
+
+tbb::task_arena& LibraryArena(int num_threads)
+{
+	std::lock_guard<std::mutex> lock(concurrency_mutex);
+
+	if(num_threads <= 0)
+	{
+		num_threads = tbb::task_arena::automatic;
+	}
+
+	std::map<int, tbb::task_arena*>::iterator arena = arenas.find(num_threads);
+	if(arena == arenas.end())
+	{
+		// The calling thread occupies one of the slots
+		arena = arenas.insert(std::make_pair(num_threads, new tbb::task_arena(num_threads))).first;
+	}
+	return *arena->second;
+}
+
+}
@@ -0,0 +1,302 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+
+#include "CLM_track_file.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace CLMTracker
+{
+
+namespace
+{
+	const char track_file_magic[4] = {'C', 'L', 'M', 'T'};
+	const int track_file_version = 2;
+
+	// Reads back as 0x04030201 if the file comes from a machine of the other byte order
+	const unsigned int track_file_byte_order = 0x01020304;
+
+	// success and certainty precede the parameters (the timestamp is stored separately as a double)
+	const int record_prefix = 2;
+
+	// Reverse the bytes of each of the count values of the given size
+	void SwapBytes(void* data, size_t size, size_t count)
+	{
+		char* bytes = (char*)data;
+		for(size_t i = 0; i < count; ++i, bytes += size)
+		{
+			std::reverse(bytes, bytes + size);
+		}
+	}
+}
+
+TrackFileWriter::TrackFileWriter() : num_modes(0)
+{
+}
+
+TrackFileWriter::~TrackFileWriter()
+{
+	Close();
+}
+
+bool TrackFileWriter::Open(const string& location, int num_modes, double fps)
+{
+	Close();
+
+	track_file.open(location, ios_base::out | ios_base::binary);
+	if(!track_file.is_open())
+	{
+		cout << "Could not create the track file " << location << endl;
+		return false;
+	}
+
+	this->num_modes = num_modes;
+	record.resize(record_prefix + 6 + num_modes);
+
+	track_file.write(track_file_magic, 4);
+	track_file.write((char*)&track_file_version, 4);
+	track_file.write((char*)&track_file_byte_order, 4);
+	track_file.write((char*)&num_modes, 4);
+	track_file.write((char*)&fps, 8);
+
+	return true;
+}
+
+bool TrackFileWriter::IsOpen() const
+{
+	return track_file.is_open();
+}
+
+void TrackFileWriter::WriteFrame(bool success, double certainty, double timestamp, const Vec6d& params_global, const Mat_<double>& params_local)
+{
+	if(!track_file.is_open())
+	{
+		return;
+	}
+
+	record[0] = success ? 1.0f : -1.0f;
+	record[1] = (float)certainty;
+
+	for(int i = 0; i < 6; ++i)
+	{
+		record[record_prefix + i] = (float)params_global[i];
+	}
+
+	// Frames before the first detection might not have any local parameters yet
+	for(int i = 0; i < num_modes; ++i)
+	{
+		record[record_prefix + 6 + i] = i < (int)params_local.total() ? (float)params_local.at<double>(i) : 0.0f;
+	}
+
+	track_file.write((char*)&timestamp, sizeof(double));
+	track_file.write((char*)&record[0], record.size() * sizeof(float));
+}
+
+void TrackFileWriter::WriteFrame(const CLM& clm_model, double timestamp)
+{
+	WriteFrame(clm_model.detection_success, clm_model.detection_certainty, timestamp, clm_model.params_global, clm_model.params_local);
+}
+
+void TrackFileWriter::Close()
+{
+	if(track_file.is_open())
+	{
+		track_file.close();
+	}
+}
+
+TrackFileReader::TrackFileReader() : num_modes(0), fps(0), swap_bytes(false)
+{
+}
+
+TrackFileReader::~TrackFileReader()
+{
+	Close();
+}
+
+bool TrackFileReader::Open(const string& location)
+{
+	Close();
+
+	track_file.open(location, ios_base::in | ios_base::binary);
+	if(!track_file.is_open())
+	{
+		cout << "Could not open the track file " << location << endl;
+		return false;
+	}
+
+	char magic[4];
+	int version;
+	unsigned int byte_order;
+	track_file.read(magic, 4);
+	track_file.read((char*)&version, 4);
+	track_file.read((char*)&byte_order, 4);
+	track_file.read((char*)&num_modes, 4);
+	track_file.read((char*)&fps, 8);
+
+	if(!track_file || std::memcmp(magic, track_file_magic, 4) != 0)
+	{
+		cout << location << " is not a track file" << endl;
+		Close();
+		return false;
+	}
+
+	swap_bytes = byte_order != track_file_byte_order;
+	if(swap_bytes)
+	{
+		SwapBytes(&version, 4, 1);
+		SwapBytes(&byte_order, 4, 1);
+		SwapBytes(&num_modes, 4, 1);
+		SwapBytes(&fps, 8, 1);
+	}
+
+	if(version != track_file_version || byte_order != track_file_byte_order || num_modes < 0)
+	{
+		cout << "The track file " << location << " is of an unsupported version or damaged, expected version " << track_file_version << endl;
+		Close();
+		return false;
+	}
+
+	record.resize(record_prefix + 6 + num_modes);
+
+	return true;
+}
+
+bool TrackFileReader::IsOpen() const
+{
+	return track_file.is_open();
+}
+
+int TrackFileReader::NumberOfModes() const
+{
+	return num_modes;
+}
+
+double TrackFileReader::FPS() const
+{
+	return fps;
+}
+
+bool TrackFileReader::ReadFrame(bool& success, double& certainty, double& timestamp, Vec6d& params_global, Mat_<double>& params_local)
+{
+	if(!track_file.is_open())
+	{
+		return false;
+	}
+
+	track_file.read((char*)&timestamp, sizeof(double));
+	track_file.read((char*)&record[0], record.size() * sizeof(float));
+	if(!track_file)
+	{
+		return false;
+	}
+
+	if(swap_bytes)
+	{
+		SwapBytes(&timestamp, sizeof(double), 1);
+		SwapBytes(&record[0], sizeof(float), record.size());
+	}
+
+	success = record[0] > 0;
+	certainty = record[1];
+
+	for(int i = 0; i < 6; ++i)
+	{
+		params_global[i] = record[record_prefix + i];
+	}
+
+	params_local.create(num_modes, 1);
+	for(int i = 0; i < num_modes; ++i)
+	{
+		params_local.at<double>(i) = record[record_prefix + 6 + i];
+	}
+
+	return true;
+}
+
+bool TrackFileReader::ReadFrame(CLM& clm_model, double& timestamp)
+{
+	if(clm_model.pdm.NumberOfModes() != num_modes)
+	{
+		cout << "The track file does not match the model, " << num_modes << " modes instead of " << clm_model.pdm.NumberOfModes() << endl;
+		return false;
+	}
+
+	bool success;
+	double certainty;
+	Vec6d params_global;
+	Mat_<double> params_local;
+
+	if(!ReadFrame(success, certainty, timestamp, params_global, params_local))
+	{
+		return false;
+	}
+
+	clm_model.params_global = params_global;
+	clm_model.params_local = params_local;
+	clm_model.detection_success = success;
+	clm_model.detection_certainty = certainty;
+	clm_model.tracking_initialised = true;
+
+	clm_model.pdm.CalcShape2D(clm_model.detected_landmarks, clm_model.params_local, clm_model.params_global);
+
+	return true;
+}
+
+void TrackFileReader::Close()
+{
+	if(track_file.is_open())
+	{
+		track_file.close();
+	}
+}
+
+}
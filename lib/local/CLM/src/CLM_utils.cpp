@@ -451,7 +451,45 @@ void get_image_input_output_params(vector<string> &input_image_files, vector<str
 // Fast patch expert response computation (linear model across a ROI) using normalised cross-correlation
 //===========================================================================
 
-void crossCorr_m( const Mat_<float>& img, Mat_<double>& img_dft, const Mat_<float>& _templ, map<int, cv::Mat_<double> >& _templ_dfts, Mat_<float>& corr)
+// The dft of a template, zero padded to dftsize
+static cv::Mat_<double> TemplateDFT(const Mat_<float>& _templ, Size dftsize)
+{
+	cv::Mat_<double> dftTempl(dftsize.height, dftsize.width);
+
+	cv::Mat_<float> src = _templ;
+
+	// TODO simplify no need for rect?
+	cv::Mat_<double> dst(dftTempl, cv::Rect(0, 0, dftsize.width, dftsize.height));
+		
+	cv::Mat_<double> dst1(dftTempl, cv::Rect(0, 0, _templ.cols, _templ.rows));
+			
+	if( dst1.data != src.data )
+		src.convertTo(dst1, dst1.depth());
+
+	if( dst.cols > _templ.cols )
+	{
+		cv::Mat_<double> part(dst, cv::Range(0, _templ.rows), cv::Range(_templ.cols, dst.cols));
+		part.setTo(0);
+	}
+
+	// Perform DFT of the template
+	dft(dst, dst, 0, _templ.rows);
+
+	return dftTempl;
+}
+
+void PrecomputeTemplateDFT(const Mat_<float>& templ, map<int, Mat_<double> >& templ_dfts, int input_width, int input_height)
+{
+	// The same dft size crossCorr_m uses, as the correlation is of size input - templ + 1
+	Size dftsize(getOptimalDFTSize(input_width), getOptimalDFTSize(input_height));
+
+	if(templ_dfts.find(dftsize.width) == templ_dfts.end())
+	{
+		templ_dfts[dftsize.width] = TemplateDFT(templ, dftsize);
+	}
+}
+
+void crossCorr_m( const Mat_<float>& img, Mat_<double>& img_dft, const Mat_<float>& _templ, const map<int, cv::Mat_<double> >& _templ_dfts, Mat_<float>& corr)
 {
 	// Our model will always be under min block size so can ignore this
     //const double blockScale = 4.5;
@@ -473,37 +511,15 @@ void crossCorr_m( const Mat_<float>& img, Mat_<double>& img_dft, const Mat_<floa
 	
 	cv::Mat_<double> dftTempl;
 
-	// if this has not been precomputed, precompute it, otherwise use it
-	if(_templ_dfts.find(dftsize.width) == _templ_dfts.end())
+	// use the precomputed version if available (see PrecomputeTemplateDFT), otherwise compute it for this response only
+	map<int, cv::Mat_<double> >::const_iterator precomputed = _templ_dfts.find(dftsize.width);
+	if(precomputed != _templ_dfts.end())
 	{
-		dftTempl.create(dftsize.height, dftsize.width);
-
-		cv::Mat_<float> src = _templ;
-
-		// TODO simplify no need for rect?
-		cv::Mat_<double> dst(dftTempl, cv::Rect(0, 0, dftsize.width, dftsize.height));
-		
-		cv::Mat_<double> dst1(dftTempl, cv::Rect(0, 0, _templ.cols, _templ.rows));
-			
-		if( dst1.data != src.data )
-			src.convertTo(dst1, dst1.depth());
-
-		if( dst.cols > _templ.cols )
-		{
-			cv::Mat_<double> part(dst, cv::Range(0, _templ.rows), cv::Range(_templ.cols, dst.cols));
-			part.setTo(0);
-		}
-
-		// Perform DFT of the template
-		dft(dst, dst, 0, _templ.rows);
-		
-		_templ_dfts[dftsize.width] = dftTempl;
-
+		dftTempl = precomputed->second;
 	}
 	else
 	{
-		// use the precomputed version
-		dftTempl = _templ_dfts.find(dftsize.width)->second;
+		dftTempl = TemplateDFT(_templ, dftsize);
 	}
 
 	Size bsz(std::min(blocksize.width, corr.cols), std::min(blocksize.height, corr.rows));
@@ -548,7 +564,7 @@ void crossCorr_m( const Mat_<float>& img, Mat_<double>& img_dft, const Mat_<floa
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void matchTemplate_m(  const Mat_<float>& input_img, Mat_<double>& img_dft, cv::Mat& _integral_img, cv::Mat& _integral_img_sq, const Mat_<float>&  templ, map<int, Mat_<double> >& templ_dfts, Mat_<float>& result, int method )
+void matchTemplate_m(  const Mat_<float>& input_img, Mat_<double>& img_dft, cv::Mat& _integral_img, cv::Mat& _integral_img_sq, const Mat_<float>&  templ, const map<int, Mat_<double> >& templ_dfts, Mat_<float>& result, int method )
 {
 
         int numType = method == CV_TM_CCORR || method == CV_TM_CCORR_NORMED ? 0 :
@@ -1269,10 +1285,15 @@ bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity
 }
 
 bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity, CascadeClassifier& classifier)
+{
+	return DetectFaces(o_regions, intensity, classifier, Size(50, 50), Size());
+}
+
+bool DetectFaces(vector<Rect_<double> >& o_regions, const Mat_<uchar>& intensity, CascadeClassifier& classifier, Size min_size, Size max_size)
 {
 		
 	vector<Rect> face_detections;
-	classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, Size(50, 50)); 		
+	classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, min_size, max_size); 		
 
 	// Convert from int bounding box do a double one with corrections
 	o_regions.resize(face_detections.size());
@@ -1470,6 +1491,112 @@ bool DetectSingleFaceHOG(Rect_<double>& o_region, const Mat_<uchar>& intensity_i
 	return detect_success;
 }
 
+// The region around the previous face that is searched (the face box is expanded by padding * size on each side)
+Rect GetRedetectionROI(const Rect_<double>& previous_face, double padding, const Size& image_size)
+{
+	Rect_<double> roi(previous_face.x - padding * previous_face.width, previous_face.y - padding * previous_face.height,
+		previous_face.width * (1 + 2 * padding), previous_face.height * (1 + 2 * padding));
+
+	return Rect(roi) & Rect(0, 0, image_size.width, image_size.height);
+}
+
+bool DetectSingleFaceHOGInROI(Rect_<double>& o_region, const Mat_<uchar>& intensity_img, dlib::frontal_face_detector& detector, double& confidence, const Rect_<double>& previous_face, double padding, double scale_band)
+{
+	o_region = Rect_<double>(0,0,0,0);
+	confidence = -2;
+
+	if(previous_face.width <= 0 || previous_face.height <= 0 || scale_band < 1)
+	{
+		return false;
+	}
+
+	Rect roi = GetRedetectionROI(previous_face, padding, intensity_img.size());
+
+	if(roi.width <= 0 || roi.height <= 0)
+	{
+		return false;
+	}
+
+	// The HOG detector window is 80px across (in the 1.3 times upsampled image, with the box corrected by 0.9611 in DetectFacesHOG), 
+	// rescale the region so that the smallest face in the scale band just fits the window, the larger ones will be found in the 
+	// first few pyramid levels, and the pyramid of such a small image is cheap to scan
+	double min_face_width = 80.0 * 0.9611 / 1.3;
+	double scaling = min_face_width / (previous_face.width / scale_band);
+
+	Mat_<uchar> roi_img;
+	cv::resize(intensity_img(roi), roi_img, Size(), scaling, scaling);
+
+	vector<Rect_<double> > face_detections;
+	vector<double> confidences;
+
+	CLMTracker::DetectFacesHOG(face_detections, roi_img, detector, confidences);
+
+	// Keep the most confident face that is within the scale band (mapped back to the full image)
+	bool detect_success = false;
+	for(size_t i = 0; i < face_detections.size(); ++i)
+	{
+		Rect_<double> face(face_detections[i].x / scaling + roi.x, face_detections[i].y / scaling + roi.y, face_detections[i].width / scaling, face_detections[i].height / scaling);
+
+		if(face.width < previous_face.width / scale_band || face.width > previous_face.width * scale_band)
+		{
+			continue;
+		}
+
+		if(!detect_success || confidences[i] > confidence)
+		{
+			o_region = face;
+			confidence = confidences[i];
+			detect_success = true;
+		}
+	}
+
+	return detect_success;
+}
+
+bool DetectSingleFaceInROI(Rect_<double>& o_region, const Mat_<uchar>& intensity_img, CascadeClassifier& classifier, const Rect_<double>& previous_face, double padding, double scale_band)
+{
+	o_region = Rect_<double>(0,0,0,0);
+
+	if(previous_face.width <= 0 || previous_face.height <= 0 || scale_band < 1)
+	{
+		return false;
+	}
+
+	Rect roi = GetRedetectionROI(previous_face, padding, intensity_img.size());
+
+	if(roi.width <= 0 || roi.height <= 0)
+	{
+		return false;
+	}
+
+	// The Haar cascade can limit the scales it searches directly, the 0.8924 is the box correction from DetectFaces
+	int min_size = (int)(previous_face.width / (scale_band * 0.8924));
+	int max_size = (int)(previous_face.width * scale_band / 0.8924 + 0.5);
+
+	vector<Rect_<double> > face_detections;
+	CLMTracker::DetectFaces(face_detections, intensity_img(roi), classifier, Size(min_size, min_size), Size(max_size, max_size));
+
+	// Keep the one closest to the previous face
+	double prev_x = previous_face.x + previous_face.width / 2;
+	double prev_y = previous_face.y + previous_face.height / 2;
+
+	double best_dist = 0;
+	for(size_t i = 0; i < face_detections.size(); ++i)
+	{
+		Rect_<double> face(face_detections[i].x + roi.x, face_detections[i].y + roi.y, face_detections[i].width, face_detections[i].height);
+
+		double dist = sqrt((face.x + face.width/2 - prev_x) * (face.x + face.width/2 - prev_x) + (face.y + face.height/2 - prev_y) * (face.y + face.height/2 - prev_y));
+
+		if(i == 0 || dist < best_dist)
+		{
+			o_region = face;
+			best_dist = dist;
+		}
+	}
+
+	return !face_detections.empty();
+}
+
 //============================================================================
 // Matrix reading functionality
 //============================================================================
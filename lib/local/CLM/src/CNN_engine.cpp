@@ -0,0 +1,244 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "CNN_engine.h"
+
+using namespace CLMTracker;
+
+//===========================================================================
+void CNN_engine::Init(const vector<int>& layer_types, const vector<vector<vector<Mat_<float> > > >& conv_kernels, const vector<vector<float> >& conv_biases,
+	const vector<int>& subsampling_scales, const vector<Mat_<float> >& fc_weights, const vector<float>& fc_biases, int input_rows, int input_cols)
+{
+	layers.clear();
+
+	int maps = 1;
+	int rows = input_rows;
+	int cols = input_cols;
+
+	int cnn_layer = 0;
+	int subsample_layer = 0;
+	int fully_connected_layer = 0;
+
+	for(size_t l = 0; l < layer_types.size(); ++l)
+	{
+		Layer layer;
+		layer.type = layer_types[l];
+		layer.in_maps = maps;
+		layer.in_rows = rows;
+		layer.in_cols = cols;
+		layer.kernel_rows = 0;
+		layer.kernel_cols = 0;
+		layer.scale = 1;
+
+		if(layer.type == 0)
+		{
+			const vector<vector<Mat_<float> > >& kernels = conv_kernels[cnn_layer];
+
+			int num_kernels = (int)kernels[0].size();
+			layer.kernel_rows = kernels[0][0].rows;
+			layer.kernel_cols = kernels[0][0].cols;
+
+			int kernel_size = layer.kernel_rows * layer.kernel_cols;
+
+			// Every row has the kernel for each of the input maps one after another
+			layer.weights = Mat_<float>(num_kernels, maps * kernel_size);
+			for(int k = 0; k < num_kernels; ++k)
+			{
+				for(int in = 0; in < maps; ++in)
+				{
+					Mat_<float> kernel = kernels[in][k].clone();
+					std::copy(kernel.begin(), kernel.end(), layer.weights.begin() + k * maps * kernel_size + in * kernel_size);
+				}
+			}
+			layer.biases = conv_biases[cnn_layer];
+
+			// Valid correlation
+			maps = num_kernels;
+			rows = rows - layer.kernel_rows + 1;
+			cols = cols - layer.kernel_cols + 1;
+
+			cnn_layer++;
+		}
+		else if(layer.type == 1)
+		{
+			layer.scale = subsampling_scales[subsample_layer];
+
+			// Averaging neighbouring 2x2 pixels and keeping every scale'th one
+			rows = (rows - 1 + layer.scale - 1) / layer.scale;
+			cols = (cols - 1 + layer.scale - 1) / layer.scale;
+
+			subsample_layer++;
+		}
+		else if(layer.type == 2)
+		{
+			const Mat_<float>& weights = fc_weights[fully_connected_layer];
+
+			// The weights expect the maps to be flattened column-wise, reorder them to match the row-major storage of the maps
+			layer.weights = Mat_<float>(weights.rows, weights.cols);
+			for(int in = 0; in < maps; ++in)
+			{
+				for(int y = 0; y < rows; ++y)
+				{
+					for(int x = 0; x < cols; ++x)
+					{
+						weights.col(in * rows * cols + x * rows + y).copyTo(layer.weights.col(in * rows * cols + y * cols + x));
+					}
+				}
+			}
+			layer.biases = vector<float>(1, fc_biases[fully_connected_layer]);
+
+			// The output is treated as a single map of one row
+			maps = 1;
+			rows = 1;
+			cols = weights.rows;
+
+			fully_connected_layer++;
+		}
+
+		layer.out_maps = maps;
+		layer.out_rows = rows;
+		layer.out_cols = cols;
+
+		layers.push_back(layer);
+	}
+}
+
+//===========================================================================
+float CNN_engine::Forward(const Mat_<float>& input) const
+{
+	// All of the maps, one per row
+	Mat_<float> maps = input.clone().reshape(1, 1);
+
+	for(size_t l = 0; l < layers.size(); ++l)
+	{
+		const Layer& layer = layers[l];
+
+		if(layer.type == 0)
+		{
+			int kernel_size = layer.kernel_rows * layer.kernel_cols;
+			int out_size = layer.out_rows * layer.out_cols;
+
+			// Every row contains the input values a kernel element sees at every output location (im2col)
+			Mat_<float> columns(layer.in_maps * kernel_size, out_size);
+			for(int in = 0; in < layer.in_maps; ++in)
+			{
+				const float* map = maps[in];
+				for(int i = 0; i < layer.kernel_rows; ++i)
+				{
+					for(int j = 0; j < layer.kernel_cols; ++j)
+					{
+						float* column = columns[in * kernel_size + i * layer.kernel_cols + j];
+						for(int y = 0; y < layer.out_rows; ++y)
+						{
+							std::copy(map + (y + i) * layer.in_cols + j, map + (y + i) * layer.in_cols + j + layer.out_cols, column + y * layer.out_cols);
+						}
+					}
+				}
+			}
+
+			// All of the kernels at once
+			Mat_<float> out_maps;
+			cv::gemm(layer.weights, columns, 1.0, Mat(), 0.0, out_maps);
+
+			// Bias and sigmoid
+			for(int k = 0; k < layer.out_maps; ++k)
+			{
+				float* out = out_maps[k];
+				float bias = layer.biases[k];
+				for(int p = 0; p < out_size; ++p)
+				{
+					out[p] = 1.0f / (1.0f + std::exp(-(out[p] + bias)));
+				}
+			}
+
+			maps = out_maps;
+		}
+		else if(layer.type == 1)
+		{
+			// Averaging of neighbouring 2x2 pixels sampled every scale pixels, done in place as the output never gets ahead of the input
+			float norm = 1.0f / (layer.scale * layer.scale);
+			float* data = maps.ptr<float>(0);
+
+			for(int m = 0; m < layer.in_maps; ++m)
+			{
+				const float* in = data + m * layer.in_rows * layer.in_cols;
+				float* out = data + m * layer.out_rows * layer.out_cols;
+
+				for(int y = 0; y < layer.out_rows; ++y)
+				{
+					const float* in_row = in + y * layer.scale * layer.in_cols;
+					for(int x = 0; x < layer.out_cols; ++x)
+					{
+						const float* p = in_row + x * layer.scale;
+						out[y * layer.out_cols + x] = (p[0] + p[1] + p[layer.in_cols] + p[layer.in_cols + 1]) * norm;
+					}
+				}
+			}
+
+			maps = maps.reshape(1, 1).colRange(0, layer.out_maps * layer.out_rows * layer.out_cols).reshape(1, layer.out_maps);
+		}
+		else if(layer.type == 2)
+		{
+			Mat_<float> out;
+			cv::gemm(layer.weights, maps.reshape(1, (int)maps.total()), 1.0, Mat(), 0.0, out);
+
+			float bias = layer.biases[0];
+			for(MatIterator_<float> it = out.begin(); it != out.end(); ++it)
+			{
+				*it = 1.0f / (1.0f + std::exp(-(*it + bias)));
+			}
+
+			maps = out.reshape(1, 1);
+		}
+	}
+
+	return maps.at<float>(0);
+}
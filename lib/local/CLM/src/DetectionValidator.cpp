@@ -103,7 +103,7 @@ void DetectionValidator::Read(string location)
 		else if(validator_type == 2)
 		{
 			cnn_convolutional_layers.resize(n);
-			cnn_convolutional_layers_dft.resize(n);
+			cnn_engines.resize(n);
 			cnn_subsampling_layers.resize(n);
 			cnn_fully_connected_layers.resize(n);
 			cnn_layer_types.resize(n);
@@ -183,10 +183,8 @@ void DetectionValidator::Read(string location)
 						detection_validator_stream.read ((char*)&num_kernels, 4);
 
 						vector<vector<Mat_<float> > > kernels;
-						vector<vector<pair<int, Mat_<double> > > > kernel_dfts;
 
 						kernels.resize(num_in_maps);
-						kernel_dfts.resize(num_in_maps);
 
 						vector<float> biases;
 						for (int k = 0; k < num_kernels; ++k)
@@ -202,7 +200,6 @@ void DetectionValidator::Read(string location)
 						for (int in = 0; in < num_in_maps; ++in)
 						{
 							kernels[in].resize(num_kernels);
-							kernel_dfts[in].resize(num_kernels);
 
 							// For every kernel on that input map
 							for (int k = 0; k < num_kernels; ++k)
@@ -215,7 +212,6 @@ void DetectionValidator::Read(string location)
 						}
 
 						cnn_convolutional_layers[i].push_back(kernels);
-						cnn_convolutional_layers_dft[i].push_back(kernel_dfts);
 					}
 					else if(layer_type == 1)
 					{
@@ -242,6 +238,13 @@ void DetectionValidator::Read(string location)
 			
 			// Read in the piece-wise affine warps
 			paws[i].Read(detection_validator_stream);
+
+			if(validator_type == 2)
+			{
+				// The network works on images of the warped size
+				cnn_engines[i].Init(cnn_layer_types[i], cnn_convolutional_layers[i], cnn_convolutional_layers_bias[i], cnn_subsampling_layers[i],
+					cnn_fully_connected_layers[i], cnn_fully_connected_layers_bias[i], paws[i].pixel_mask.rows, paws[i].pixel_mask.cols);
+			}
 		}
 		
 	}
@@ -251,6 +254,65 @@ void DetectionValidator::Read(string location)
 	}
 }
 
+void DetectionValidator::ReadCascadeStage(string location)
+{
+	cascade_stage.release();
+	cascade_stage_location = location;
+
+	ifstream cascade_stream(location.c_str(), ios_base::in);
+	if(!cascade_stream.is_open())
+	{
+		cout << "WARNING: Can't find the validator cascade stage location" << endl;
+		return;
+	}
+
+	// The validator location is relative to the cascade file
+	boost::filesystem::path root = boost::filesystem::path(location).parent_path();
+
+	string validator_location;
+	bool boundary_read = false;
+	bool margin_read = false;
+
+	string line;
+	while(getline(cascade_stream, line))
+	{
+		stringstream lineStream(line);
+
+		string key;
+		lineStream >> key;
+
+		if(key.compare("validator") == 0)
+		{
+			lineStream >> validator_location;
+			validator_location = (root / validator_location).string();
+		}
+		else if(key.compare("boundary") == 0)
+		{
+			boundary_read = (bool)(lineStream >> cascade_boundary);
+		}
+		else if(key.compare("margin") == 0)
+		{
+			margin_read = (bool)(lineStream >> cascade_margin);
+		}
+	}
+
+	// Without its own calibration the output of the stage can't be interpreted
+	if(validator_location.empty() || !boundary_read || !margin_read)
+	{
+		cout << "WARNING: The validator cascade stage " << location << " needs validator, boundary and margin lines, not using it" << endl;
+		return;
+	}
+
+	cascade_stage = cv::makePtr<DetectionValidator>();
+	cascade_stage->Read(validator_location);
+
+	// Could not read it
+	if(cascade_stage->orientations.empty())
+	{
+		cascade_stage.release();
+	}
+}
+
 //===========================================================================
 // Check if the fitting actually succeeded
 double DetectionValidator::Check(const Vec3d& orientation, const Mat_<uchar>& intensity_img, Mat_<double>& detected_landmarks)
@@ -258,36 +320,48 @@ double DetectionValidator::Check(const Vec3d& orientation, const Mat_<uchar>& in
 
 	int id = GetViewId(orientation);
 	
-	// The warped (cropped) image, corresponding to a face lying withing the detected lanmarks
-	Mat_<double> warped;
-	
-	// the piece-wise affine image
-	Mat_<double> intensity_img_double;
-	intensity_img.convertTo(intensity_img_double, CV_64F);
-
-	paws[id].Warp(intensity_img_double, warped, detected_landmarks);	
+	// The normalised face region lying within the detected landmarks
+	Mat_<double> feature_vec;
+	WarpToNormalisedVector(intensity_img, detected_landmarks, feature_vec, id);
 	
 	double dec;
 	if(validator_type == 0)
 	{
-		dec = CheckSVR(warped, id);
+		dec = CheckSVR(feature_vec, id);
 	}
 	else if(validator_type == 1)
 	{
-		dec = CheckNN(warped, id);
+		dec = CheckNN(feature_vec, id);
 	}
 	else if(validator_type == 2)
 	{
-		dec = CheckCNN(warped, id);
+		dec = CheckCNN(feature_vec, id);
 	}
 	return dec;
 }
 
-double DetectionValidator::CheckNN(const Mat_<double>& warped_img, int view_id)
+double DetectionValidator::Check(const Vec3d& orientation, const Mat_<uchar>& intensity_img, Mat_<double>& detected_landmarks, double boundary)
 {
-	Mat_<double> feature_vec;
-	NormaliseWarpedToVector(warped_img, feature_vec, view_id);
-	feature_vec = feature_vec.t();
+	if(!cascade_stage.empty() && cascade_margin > 0)
+	{
+		double dec = cascade_stage->Check(orientation, intensity_img, detected_landmarks);
+
+		// Clear-cut cases do not need the full validator
+		if(abs(dec - cascade_boundary) > cascade_margin)
+		{
+			cascade_decided++;
+			return dec - cascade_boundary + boundary;
+		}
+
+		cascade_escalated++;
+	}
+
+	return Check(orientation, intensity_img, detected_landmarks);
+}
+
+double DetectionValidator::CheckNN(const Mat_<double>& feature_vec_in, int view_id)
+{
+	Mat_<double> feature_vec = feature_vec_in.t();
 			
 	for(size_t layer = 0; layer < ws_nn[view_id].size(); ++layer)
 	{
@@ -336,13 +410,9 @@ double DetectionValidator::CheckNN(const Mat_<double>& warped_img, int view_id)
 
 }
 
-double DetectionValidator::CheckSVR(const Mat_<double>& warped_img, int view_id)
+double DetectionValidator::CheckSVR(const Mat_<double>& feature_vec, int view_id)
 {
 
-	Mat_<double> feature_vec;
-	NormaliseWarpedToVector(warped_img, feature_vec, view_id);
-		
-
 	double dec = (ws[view_id].dot(feature_vec.t()) + bs[view_id]);
 
 	return dec;
@@ -350,245 +420,72 @@ double DetectionValidator::CheckSVR(const Mat_<double>& warped_img, int view_id)
 }
 
 // Convolutional Neural Network
-double DetectionValidator::CheckCNN(const Mat_<double>& warped_img, int view_id)
+double DetectionValidator::CheckCNN(const Mat_<double>& feature_vec, int view_id)
 {
-
-	Mat_<double> feature_vec;
-	NormaliseWarpedToVector(warped_img, feature_vec, view_id);
 	
-	// Create a normalised image from the crop vector
-	Mat_<float> img(warped_img.size(), 0.0);
-	img = img.t();
+	// Create a normalised image from the crop vector (which is in column-major order)
+	const Mat_<uchar>& mask = paws[view_id].pixel_mask;
+	Mat_<float> img(mask.size(), 0.0);
 
-	cv::Mat mask = paws[view_id].pixel_mask.t();
-	cv::MatIterator_<uchar>  mask_it = mask.begin<uchar>();
-	
-	cv::MatIterator_<double> feature_it = feature_vec.begin();
-	cv::MatIterator_<float> img_it = img.begin();		
-
-	int wInt = img.cols;
-	int hInt = img.rows;
+	cv::MatConstIterator_<double> feature_it = feature_vec.begin();
 
-	for(int i=0; i < wInt; ++i)
+	for(int x = 0; x < mask.cols; ++x)
 	{
-		for(int j=0; j < hInt; ++j, ++mask_it, ++img_it)
+		for(int y = 0; y < mask.rows; ++y)
 		{
 			// if is within mask
-			if(*mask_it)
+			if(mask(y, x))
 			{
 				// assign the feature to image if it is within the mask
-				*img_it = (float)*feature_it++;
+				img(y, x) = (float)*feature_it++;
 			}
 		}
 	}
-	img = img.t();
-	
-	int cnn_layer = 0;
-	int subsample_layer = 0;
-	int fully_connected_layer = 0;
 
-	vector<Mat_<float> > input_maps;
-	input_maps.push_back(img);
-	
-	vector<Mat_<float> > outputs;
-
-	for(size_t layer = 0; layer < cnn_layer_types[view_id].size(); ++layer)
-	{
-		// Determine layer type
-		int layer_type = cnn_layer_types[view_id][layer];
-		
-		
-		// Convolutional layer
-		if(layer_type == 0)
-		{
-			vector<Mat_<float> > outputs_kern;
-			for(size_t in = 0; in < input_maps.size(); ++in)
-			{
-				Mat_<float> input_image = input_maps[in];
-
-				// Useful precomputed data placeholders for quick correlation (convolution)
-				Mat_<double> input_image_dft;
-				Mat integral_image;
-				Mat integral_image_sq;
-
-				for(size_t k = 0; k < cnn_convolutional_layers[view_id][cnn_layer][in].size(); ++k)
-				{
-					Mat_<float> kernel = cnn_convolutional_layers[view_id][cnn_layer][in][k];					
-										
-					// The convolution (with precomputation)
-					Mat_<float> output;
-					if(cnn_convolutional_layers_dft[view_id][cnn_layer][in][k].second.empty())
-					{
-						std::map<int, Mat_<double> > precomputed_dft;
-						
-						CLMTracker::matchTemplate_m(input_image, input_image_dft, integral_image, integral_image_sq, kernel, precomputed_dft, output, CV_TM_CCORR);
-						
-						cnn_convolutional_layers_dft[view_id][cnn_layer][in][k].first = precomputed_dft.begin()->first;
-						cnn_convolutional_layers_dft[view_id][cnn_layer][in][k].second = precomputed_dft.begin()->second;
-					}
-					else
-					{
-						std::map<int, Mat_<double> > precomputed_dft;
-						precomputed_dft[cnn_convolutional_layers_dft[view_id][cnn_layer][in][k].first] = cnn_convolutional_layers_dft[view_id][cnn_layer][in][k].second;
-						CLMTracker::matchTemplate_m(input_image, input_image_dft, integral_image, integral_image_sq, kernel,  precomputed_dft, output, CV_TM_CCORR);						
-					}
-
-					// Combining the maps
-					if(in == 0)
-					{
-						outputs_kern.push_back(output);
-					}
-					else
-					{
-						outputs_kern[k] = outputs_kern[k] + output;
-					}
-
-				}
-								
-			}
-			
-			outputs.clear();
-			for(size_t k = 0; k < cnn_convolutional_layers[view_id][cnn_layer][0].size(); ++k)
-			{
-				// Apply the sigmoid
-				cv::exp(-outputs_kern[k] - cnn_convolutional_layers_bias[view_id][cnn_layer][k], outputs_kern[k]);
-				outputs_kern[k] = 1.0 /(1.0 + outputs_kern[k]);	
-
-				outputs.push_back(outputs_kern[k]);
-
-			}			
-
-			cnn_layer++;
-		}				
-		if(layer_type == 1)
-		{
-			// Subsampling layer
-			int scale = cnn_subsampling_layers[view_id][subsample_layer];
-			
-			Mat kx = Mat::ones(2, 1, CV_32F)*1.0f/scale;
-			Mat ky = Mat::ones(1, 2, CV_32F)*1.0f/scale;
-
-			vector<Mat_<float>> outputs_sub;
-			for(size_t in = 0; in < input_maps.size(); ++in)
-			{
-
-				Mat_<float> conv_out;
-
-				sepFilter2D(input_maps[in], conv_out, CV_32F, kx, ky);
-				conv_out = conv_out(Rect(1, 1, conv_out.cols - 1, conv_out.rows - 1));
-
-				int res_rows = conv_out.rows / scale;
-				int res_cols = conv_out.cols / scale;
-
-				if(conv_out.rows % scale != 0)
-				{
-					res_rows++;
-				}
-				if(conv_out.cols % scale != 0)
-				{
-					res_cols++;
-				}
-
-				Mat_<float> sub_out(res_rows, res_cols);
-				for(int w = 0; w < conv_out.cols; w+=scale)
-				{
-					for(int h=0; h < conv_out.rows; h+=scale)
-					{
-						sub_out.at<float>(h/scale, w/scale) = conv_out(h, w);
-					}
-				}
-				outputs_sub.push_back(sub_out);
-			}
-			outputs = outputs_sub;
-			subsample_layer++;
-
-		}
-		if(layer_type == 2)
-		{
-			// Concatenate all the maps
-			Mat_<float> input_concat = input_maps[0].t();
-			input_concat = input_concat.reshape(0, 1);
-
-			for(size_t in = 1; in < input_maps.size(); ++in)
-			{
-				Mat_<float> add = input_maps[in].t();
-				add = add.reshape(0,1);
-				cv::hconcat(input_concat, add, input_concat);
-			}
-						
-			input_concat = input_concat * cnn_fully_connected_layers[view_id][fully_connected_layer].t();
-
-			cv::exp(-input_concat - cnn_fully_connected_layers_bias[view_id][fully_connected_layer], input_concat);
-			input_concat = 1.0 /(1.0 + input_concat);		
-
-			outputs.clear();
-			outputs.push_back(input_concat);
-
-			fully_connected_layer++;
-		}
-		// Set the outputs of this layer to inputs of the next
-		input_maps = outputs;
-
-	}
-	
-	// Turn it to -1, 1 range
-	double dec = (outputs[0].at<float>(0) - 0.5) * 2.0;
+	double dec = (cnn_engines[view_id].Forward(img) - 0.5) * 2.0;
 
 	return dec;
 }
 
-void DetectionValidator::NormaliseWarpedToVector(const Mat_<double>& warped_img, Mat_<double>& feature_vec, int view_id)
+void DetectionValidator::WarpToNormalisedVector(const Mat_<uchar>& intensity_img, const Mat_<double>& detected_landmarks, Mat_<double>& feature_vec, int view_id)
 {
-	Mat_<double> warped_t = warped_img.t();
-	
-	// the vector to be filled with paw values
-	cv::MatIterator_<double> vp;	
-	cv::MatIterator_<double>  cp;
+	// Sample the face region straight from the image (no intermediate warped image)
+	Mat_<double> vec;
+	paws[view_id].WarpToVector(intensity_img, vec, detected_landmarks);
 
-	cv::Mat_<double> vec(paws[view_id].number_of_pixels,1);
-	vp = vec.begin();
+	int num_pixels = vec.rows;
 
-	cp = warped_t.begin();		
+	// Local normalisation, the statistics are collected in a single pass
+	double sum = 0;
+	double sum_sq = 0;
 
-	int wInt = warped_img.cols;
-	int hInt = warped_img.rows;
-
-	// the mask indicating if point is within or outside the face region
-	
-	cv::Mat maskT = paws[view_id].pixel_mask.t();
+	const double* vp = vec.ptr<double>(0);
+	for(int i = 0; i < num_pixels; ++i)
+	{
+		sum += vp[i];
+		sum_sq += vp[i] * vp[i];
+	}
 
-	cv::MatIterator_<uchar>  mp = maskT.begin<uchar>();
+	double mean = sum / num_pixels;
+	double std = sqrt(std::max(sum_sq / num_pixels - mean * mean, 0.0));
 
-	for(int i=0; i < wInt; ++i)
+	// Normalise the image
+	if(std == 0)
 	{
-		for(int j=0; j < hInt; ++j, ++mp, ++cp)
-		{
-			// if is within mask
-			if(*mp)
-			{
-				*vp++ = *cp;
-			}
-		}
+		std = 1;
 	}
 
-	// Local normalisation
-	cv::Scalar mean;
-	cv::Scalar std;
-	cv::meanStdDev(vec, mean, std);
+	// Local and global normalisation combined
+	feature_vec.create(num_pixels, 1);
 
-	// subtract the mean image
-	vec -= mean[0];
+	cv::MatConstIterator_<double> mean_it = mean_images[view_id].begin();
+	cv::MatConstIterator_<double> std_it = standard_deviations[view_id].begin();
+	double* fp = feature_vec.ptr<double>(0);
 
-	// Normalise the image
-	if(std[0] == 0)
+	for(int i = 0; i < num_pixels; ++i, ++mean_it, ++std_it)
 	{
-		std[0] = 1;
+		fp[i] = ((vp[i] - mean) / std - *mean_it) / *std_it;
 	}
-	
-	vec /= std[0];
-
-	// Global normalisation
-	feature_vec = (vec - mean_images[view_id])  / standard_deviations[view_id];
 }
 
 // Getting the closest view center based on orientation
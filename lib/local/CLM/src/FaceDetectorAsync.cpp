@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2014, University of Southern California and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 3D
+//       Constrained Local Model for Rigid and Non-Rigid Facial Tracking.
+//       IEEE Conference on Computer Vision and Pattern Recognition (CVPR), 2012.    
+//
+//       Tadas Baltrusaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+
+#include "FaceDetectorAsync.h"
+#include "CLM_utils.h"
+
+using namespace CLMTracker;
+
+using namespace cv;
+
+FaceDetectorAsync::FaceDetectorAsync(CLMParameters::FaceDetector detector_type, const string& face_detector_location)
+{
+	this->detector_type = detector_type;
+
+	if(detector_type == CLMParameters::HAAR_DETECTOR)
+	{
+		face_detector_HAAR.load(face_detector_location);
+	}
+	face_detector_HOG = dlib::get_frontal_face_detector();
+
+	pending_frame_id = -1;
+	latest_frame_id = -1;
+	detections_frame_id = -1;
+	consumed_frame_id = -1;
+
+	busy = false;
+	stop = false;
+
+	worker = std::thread(&FaceDetectorAsync::DetectionLoop, this);
+}
+
+FaceDetectorAsync::~FaceDetectorAsync()
+{
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		stop = true;
+	}
+	frame_available.notify_one();
+
+	if(worker.joinable())
+	{
+		worker.join();
+	}
+}
+
+int FaceDetectorAsync::PushFrame(const Mat_<uchar>& grayscale_image)
+{
+	// Copy outside of the lock, the caller is likely to reuse the buffer for the next frame
+	Mat_<uchar> frame = grayscale_image.clone();
+
+	int frame_id;
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+
+		// Replace any frame still waiting, there is no point detecting faces in an outdated frame
+		latest_frame_id++;
+		frame_id = latest_frame_id;
+		pending_frame = frame;
+		pending_frame_id = frame_id;
+	}
+	frame_available.notify_one();
+
+	return frame_id;
+}
+
+bool FaceDetectorAsync::GetDetections(vector<Rect_<double> >& o_regions, vector<double>& o_confidences, int& detection_frame_id)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+
+	if(detections_frame_id <= consumed_frame_id)
+	{
+		return false;
+	}
+
+	o_regions = detections;
+	o_confidences = detection_confidences;
+	detection_frame_id = detections_frame_id;
+
+	consumed_frame_id = detections_frame_id;
+
+	return true;
+}
+
+bool FaceDetectorAsync::GetSingleDetection(Rect_<double>& o_region, double& confidence, int& detection_frame_id, const cv::Point preference)
+{
+	vector<Rect_<double> > face_detections;
+	vector<double> confidences;
+
+	if(!GetDetections(face_detections, confidences, detection_frame_id) || face_detections.empty())
+	{
+		o_region = Rect_<double>(0,0,0,0);
+		confidence = -2;
+		return false;
+	}
+
+	bool use_preferred = (preference.x != -1) && (preference.y != -1);
+
+	int best_index = 0;
+	double best_so_far = 0;
+
+	for(size_t i = 0; i < face_detections.size(); ++i)
+	{
+		double score;
+		if(use_preferred)
+		{
+			// Negative distance to the preference point, so that higher is always better
+			double c_x = face_detections[i].x + face_detections[i].width/2;
+			double c_y = face_detections[i].y + face_detections[i].height/2;
+			score = -sqrt((preference.x - c_x) * (preference.x - c_x) + (preference.y - c_y) * (preference.y - c_y));
+		}
+		else if(detector_type == CLMParameters::HOG_SVM_DETECTOR)
+		{
+			score = confidences[i];
+		}
+		else
+		{
+			score = face_detections[i].width;
+		}
+
+		if(i == 0 || score > best_so_far)
+		{
+			best_so_far = score;
+			best_index = i;
+		}
+	}
+
+	o_region = face_detections[best_index];
+	confidence = confidences[best_index];
+
+	return true;
+}
+
+int FaceDetectorAsync::LatestFrameId()
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return latest_frame_id;
+}
+
+bool FaceDetectorAsync::Busy()
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return busy;
+}
+
+void FaceDetectorAsync::DetectionLoop()
+{
+	while(true)
+	{
+		Mat_<uchar> frame;
+		int frame_id;
+
+		{
+			std::unique_lock<std::mutex> lock(state_mutex);
+
+			frame_available.wait(lock, [this]{ return stop || !pending_frame.empty(); });
+
+			if(stop)
+			{
+				break;
+			}
+
+			// Take ownership of the newest frame
+			frame = pending_frame;
+			frame_id = pending_frame_id;
+			pending_frame = Mat_<uchar>();
+
+			busy = true;
+		}
+
+		vector<Rect_<double> > face_detections;
+		vector<double> confidences;
+
+		if(detector_type == CLMParameters::HOG_SVM_DETECTOR)
+		{
+			CLMTracker::DetectFacesHOG(face_detections, frame, face_detector_HOG, confidences);
+		}
+		else if(!face_detector_HAAR.empty())
+		{
+			CLMTracker::DetectFaces(face_detections, frame, face_detector_HAAR);
+			// HAAR cascade does not provide a confidence
+			confidences.assign(face_detections.size(), 0.0);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+
+			// Publish the results (an empty result is also a result, it means no face in that frame)
+			detections = face_detections;
+			detection_confidences = confidences;
+			detections_frame_id = frame_id;
+
+			busy = false;
+		}
+	}
+}
@@ -58,211 +58,85 @@ using namespace cv;
 // A constructor from destination shape and triangulation
 PAW::PAW(const Mat_<double>& destination_shape, const Mat_<int>& triangulation)
 {
-	// Initialise some variables directly
-	this->destination_landmarks = destination_shape;
 	this->triangulation = triangulation;
 
 	int num_points = destination_shape.rows/2;
 
-	int num_tris = triangulation.rows;
-	
-	// Pre-compute the rest
-    alpha = Mat_<double>(num_tris, 3);
-    beta = Mat_<double>(num_tris, 3);
-    
-    Mat_<double> xs = destination_shape(Rect(0, 0, 1, num_points));
-    Mat_<double> ys = destination_shape(Rect(0, num_points, 1, num_points));
-    
-	// Create a vector representation of the control points
-	vector<vector<double>> destination_points;
-
-	for (int tri = 0; tri < num_tris; ++tri)
-	{	
-		int j = triangulation.at<int>(tri, 0);
-		int k = triangulation.at<int>(tri, 1);
-		int l = triangulation.at<int>(tri, 2);
-
-        double c1 = ys.at<double>(l) - ys.at<double>(j);
-        double c2 = xs.at<double>(l) - xs.at<double>(j);
-        double c4 = ys.at<double>(k) - ys.at<double>(j);
-        double c3 = xs.at<double>(k) - xs.at<double>(j);
-        		
-        double c5 = c3*c1 - c2*c4;
-
-        alpha.at<double>(tri, 0) = (ys.at<double>(j) * c2 - xs.at<double>(j) * c1) / c5;
-        alpha.at<double>(tri, 1) = c1/c5;
-        alpha.at<double>(tri, 2) = -c2/c5;
-
-        beta.at<double>(tri, 0) = (xs.at<double>(j) * c4 - ys.at<double>(j) * c3)/c5;
-        beta.at<double>(tri, 1) = -c4/c5;
-        beta.at<double>(tri, 2) = c3/c5;
-
-		// Add points corresponding to triangles as optimisation
-		vector<double> triangle_points(10);
-
-		triangle_points[0] = xs.at<double>(j);
-		triangle_points[1] = ys.at<double>(j);
-		triangle_points[2] = xs.at<double>(k);
-		triangle_points[3] = ys.at<double>(k);
-		triangle_points[4] = xs.at<double>(l);
-		triangle_points[5] = ys.at<double>(l);
-		
-		Vec3d xs_three(triangle_points[0], triangle_points[2], triangle_points[4]);
-		Vec3d ys_three(triangle_points[1], triangle_points[3], triangle_points[5]);
-
-		double min_x, max_x, min_y, max_y;
-		cv::minMaxIdx(xs_three, &min_x, &max_x);
-		cv::minMaxIdx(ys_three, &min_y, &max_y);
-
-		triangle_points[6] = max_x;
-		triangle_points[7] = max_y;
-
-		triangle_points[8] = min_x;
-		triangle_points[9] = min_y;
-
-		destination_points.push_back(triangle_points);
-
-	}
-
-	double max_x;
-	double max_y;
-
-	minMaxLoc(xs, &min_x, &max_x);
-	minMaxLoc(ys, &min_y, &max_y);
-
-	int w = (int)(max_x - min_x + 1.5);
-    int h = (int)(max_y - min_y + 1.5);
-    
-	// Round the min_x and min_y for simplicity?
-
-    pixel_mask = Mat_<uchar>(h, w, (uchar)0);
-    triangle_id = Mat_<int>(h, w, -1);
-        
-	int curr_tri = -1;
-
-	for(int y = 0; y < pixel_mask.rows; y++)
-	{
-		for(int x = 0; x < pixel_mask.cols; x++)
-		{
-			curr_tri = findTriangle(Point_<double>(x + min_x, y + min_y), destination_points, curr_tri);
-			// If there is a triangle at this location
-            if(curr_tri != -1)
-			{
-				triangle_id.at<int>(y, x) = curr_tri;
-                pixel_mask.at<uchar>(y, x) = 1;
-			}	
-		}
-	}
-    	
-	// Preallocate maps and coefficients
-	coefficients.create(num_tris, 6);
-	map_x.create(pixel_mask.rows,pixel_mask.cols);
-	map_y.create(pixel_mask.rows,pixel_mask.cols);
+	// The warp covers the bounding box of the destination shape
+	double in_min_x, in_max_x, in_min_y, in_max_y;
 
+	minMaxLoc(destination_shape(Rect(0, 0, 1, num_points)), &in_min_x, &in_max_x);
+	minMaxLoc(destination_shape(Rect(0, num_points, 1, num_points)), &in_min_y, &in_max_y);
 
+	SetDestination(destination_shape, in_min_x, in_min_y, in_max_x, in_max_y);
 }
 
 // Manually define min and max values
 PAW::PAW(const Mat_<double>& destination_shape, const Mat_<int>& triangulation, double in_min_x, double in_min_y, double in_max_x, double in_max_y)
 {
-	// Initialise some variables directly
-	this->destination_landmarks = destination_shape;
 	this->triangulation = triangulation;
 
+	SetDestination(destination_shape, in_min_x, in_min_y, in_max_x, in_max_y);
+}
+
+//===========================================================================
+// (Re)compute the destination dependent parts of the warp, the existing buffers are reused if the warp size does not change
+void PAW::SetDestination(const Mat_<double>& destination_shape, double in_min_x, double in_min_y, double in_max_x, double in_max_y)
+{
+	this->destination_landmarks = destination_shape;
+
 	int num_points = destination_shape.rows/2;
 
 	int num_tris = triangulation.rows;
 	
 	// Pre-compute the rest
-    alpha = Mat_<double>(num_tris, 3);
-    beta = Mat_<double>(num_tris, 3);
+	alpha.create(num_tris, 3);
+	beta.create(num_tris, 3);
     
-    Mat_<double> xs = destination_shape(Rect(0, 0, 1, num_points));
-    Mat_<double> ys = destination_shape(Rect(0, num_points, 1, num_points));
+	Mat_<double> xs = destination_shape(Rect(0, 0, 1, num_points));
+	Mat_<double> ys = destination_shape(Rect(0, num_points, 1, num_points));
+
+	min_x = in_min_x;
+	min_y = in_min_y;
+
+	int w = (int)(in_max_x - min_x + 1.5);
+	int h = (int)(in_max_y - min_y + 1.5);
+
+	pixel_mask.create(h, w);
+	pixel_mask.setTo(0);
+	triangle_id.create(h, w);
+	triangle_id.setTo(-1);
 
-	// Create a vector representation of the control points
-	vector<vector<double>> destination_points;
-    
 	for (int tri = 0; tri < num_tris; ++tri)
 	{	
 		int j = triangulation.at<int>(tri, 0);
 		int k = triangulation.at<int>(tri, 1);
 		int l = triangulation.at<int>(tri, 2);
 
-        double c1 = ys.at<double>(l) - ys.at<double>(j);
-        double c2 = xs.at<double>(l) - xs.at<double>(j);
-        double c4 = ys.at<double>(k) - ys.at<double>(j);
-        double c3 = xs.at<double>(k) - xs.at<double>(j);
+		double c1 = ys.at<double>(l) - ys.at<double>(j);
+		double c2 = xs.at<double>(l) - xs.at<double>(j);
+		double c4 = ys.at<double>(k) - ys.at<double>(j);
+		double c3 = xs.at<double>(k) - xs.at<double>(j);
         		
-        double c5 = c3*c1 - c2*c4;
-
-        alpha.at<double>(tri, 0) = (ys.at<double>(j) * c2 - xs.at<double>(j) * c1) / c5;
-        alpha.at<double>(tri, 1) = c1/c5;
-        alpha.at<double>(tri, 2) = -c2/c5;
-
-        beta.at<double>(tri, 0) = (xs.at<double>(j) * c4 - ys.at<double>(j) * c3)/c5;
-        beta.at<double>(tri, 1) = -c4/c5;
-        beta.at<double>(tri, 2) = c3/c5;
-
-		// Add points corresponding to triangles as optimisation
-		vector<double> triangle_points(10);
-
-		triangle_points[0] = xs.at<double>(j);
-		triangle_points[1] = ys.at<double>(j);
-		triangle_points[2] = xs.at<double>(k);
-		triangle_points[3] = ys.at<double>(k);
-		triangle_points[4] = xs.at<double>(l);
-		triangle_points[5] = ys.at<double>(l);
-		
-		Vec3d xs_three(triangle_points[0], triangle_points[2], triangle_points[4]);
-		Vec3d ys_three(triangle_points[1], triangle_points[3], triangle_points[5]);
+		double c5 = c3*c1 - c2*c4;
 
-		double min_x, max_x, min_y, max_y;
-		cv::minMaxIdx(xs_three, &min_x, &max_x);
-		cv::minMaxIdx(ys_three, &min_y, &max_y);
+		alpha.at<double>(tri, 0) = (ys.at<double>(j) * c2 - xs.at<double>(j) * c1) / c5;
+		alpha.at<double>(tri, 1) = c1/c5;
+		alpha.at<double>(tri, 2) = -c2/c5;
 
-		triangle_points[6] = max_x;
-		triangle_points[7] = max_y;
+		beta.at<double>(tri, 0) = (xs.at<double>(j) * c4 - ys.at<double>(j) * c3)/c5;
+		beta.at<double>(tri, 1) = -c4/c5;
+		beta.at<double>(tri, 2) = c3/c5;
 
-		triangle_points[8] = min_x;
-		triangle_points[9] = min_y;
+		double tri_xs[3] = {xs.at<double>(j), xs.at<double>(k), xs.at<double>(l)};
+		double tri_ys[3] = {ys.at<double>(j), ys.at<double>(k), ys.at<double>(l)};
 
-		destination_points.push_back(triangle_points);
-		
+		RasteriseTriangle(tri, tri_xs, tri_ys);
 	}
 
-	double max_x;
-	double max_y;
+	number_of_pixels = countNonZero(pixel_mask);
 
-	min_x = in_min_x;
-	min_y = in_min_y;
-
-	max_x = in_max_x;
-	max_y = in_max_y;
-
-	int w = (int)(max_x - min_x + 1.5);
-    int h = (int)(max_y - min_y + 1.5);
-    
-	// Round the min_x and min_y for simplicity?
-
-    pixel_mask = Mat_<uchar>(h, w, (uchar)0);
-    triangle_id = Mat_<int>(h, w, -1);
-        
-	int curr_tri = -1;
-
-	for(int y = 0; y < pixel_mask.rows; y++)
-	{
-		for(int x = 0; x < pixel_mask.cols; x++)
-		{
-			curr_tri = findTriangle(Point_<double>(x + min_x, y + min_y), destination_points, curr_tri);
-			// If there is a triangle at this location
-            if(curr_tri != -1)
-			{
-				triangle_id.at<int>(y, x) = curr_tri;
-                pixel_mask.at<uchar>(y, x) = 1;
-			}	
-		}
-	}    	
+	BuildColumnSpans();
 
 	// Preallocate maps and coefficients
 	coefficients.create(num_tris, 6);
@@ -299,6 +173,8 @@ void PAW::Read(std::ifstream& stream)
 	coefficients.create(this->NumberOfTriangles(),6);
 	
 	source_landmarks = destination_landmarks;
+
+	BuildColumnSpans();
 }
 
 //=============================================================================
@@ -321,6 +197,98 @@ void PAW::Warp(const Mat& image_to_warp, Mat& destination_image, const Mat_<doub
 }
 
 
+// Bilinear interpolation of a pixel value, locations outside the image are treated as 0 (as done by remap with a constant border)
+static inline double sampleBilinear(const Mat_<uchar>& image, double x, double y)
+{
+	int x0 = cvFloor(x);
+	int y0 = cvFloor(y);
+
+	double dx = x - x0;
+	double dy = y - y0;
+
+	double v00, v01, v10, v11;
+
+	if(x0 >= 0 && y0 >= 0 && x0 < image.cols - 1 && y0 < image.rows - 1)
+	{
+		const uchar* row_0 = image.ptr<uchar>(y0) + x0;
+		const uchar* row_1 = image.ptr<uchar>(y0 + 1) + x0;
+
+		v00 = row_0[0];
+		v01 = row_0[1];
+		v10 = row_1[0];
+		v11 = row_1[1];
+	}
+	else
+	{
+		bool in_x0 = x0 >= 0 && x0 < image.cols;
+		bool in_x1 = x0 + 1 >= 0 && x0 + 1 < image.cols;
+		bool in_y0 = y0 >= 0 && y0 < image.rows;
+		bool in_y1 = y0 + 1 >= 0 && y0 + 1 < image.rows;
+
+		v00 = in_y0 && in_x0 ? image(y0, x0) : 0;
+		v01 = in_y0 && in_x1 ? image(y0, x0 + 1) : 0;
+		v10 = in_y1 && in_x0 ? image(y0 + 1, x0) : 0;
+		v11 = in_y1 && in_x1 ? image(y0 + 1, x0 + 1) : 0;
+	}
+
+	double top = v00 + dx * (v01 - v00);
+	double bottom = v10 + dx * (v11 - v10);
+
+	return top + dy * (bottom - top);
+}
+
+//=============================================================================
+// Sample the valid destination pixels directly from the source image, one triangle span at a time
+void PAW::WarpToVector(const Mat_<uchar>& image_to_warp, Mat_<double>& sampled, const Mat_<double>& landmarks_to_warp)
+{
+	// set the current shape
+	source_landmarks = landmarks_to_warp.clone();
+
+	// prepare the mapping coefficients using the current shape
+	this->CalcCoeff();
+
+	sampled.create(number_of_pixels, 1);
+	double* out = sampled.ptr<double>(0);
+
+	// Source locations of a span, kept separate from sampling so that the affine part is a simple loop the compiler can vectorise
+	vector<double> src_x(pixel_mask.rows);
+	vector<double> src_y(pixel_mask.rows);
+
+	for(int s = 0; s < column_spans.rows; ++s)
+	{
+		const int* span = column_spans.ptr<int>(s);
+
+		int x = span[0];
+		int y_start = span[1];
+		int length = span[2] - span[1] + 1;
+
+		const double* a = coefficients.ptr<double>(span[3]);
+
+		double xi = double(x) + min_x;
+		double yi = double(y_start) + min_y;
+
+		// Along a column only the y term of the affine transform changes
+		double start_x = a[0] + a[1] * xi + a[2] * yi;
+		double start_y = a[3] + a[4] * xi + a[5] * yi;
+		double step_x = a[2];
+		double step_y = a[5];
+
+		double* sx = &src_x[0];
+		double* sy = &src_y[0];
+
+		for(int i = 0; i < length; ++i)
+		{
+			sx[i] = start_x + step_x * i;
+			sy[i] = start_y + step_y * i;
+		}
+
+		for(int i = 0; i < length; ++i)
+		{
+			*out++ = sampleBilinear(image_to_warp, sx[i], sy[i]);
+		}
+	}
+}
+
 //=============================================================================
 // Calculate the warping coefficients
 void PAW::CalcCoeff()
@@ -423,81 +391,115 @@ void PAW::WarpRegion(Mat_<float>& mapx, Mat_<float>& mapy)
 	}
 }
 
-// ============================================================
-// Helper functions to determine which point a triangle lies in
-// ============================================================
-
-// Is the point (x0,y0) on same side as a half-plane defined by (x1,y1), (x2, y2), and (x3, y3)
-bool sameSide(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3)
+//======================================================================
+// Group the valid pixels of each column into runs belonging to the same triangle
+void PAW::BuildColumnSpans()
 {
-    
-    double x = (x3-x2)*(y0-y2) - (x0-x2)*(y3-y2);
-    double y = (x3-x2)*(y1-y2) - (x1-x2)*(y3-y2);
+	vector<int> spans;
 
-    return x*y >= 0;
+	for(int x = 0; x < pixel_mask.cols; ++x)
+	{
+		int y = 0;
+		while(y < pixel_mask.rows)
+		{
+			if(pixel_mask.at<uchar>(y, x) == 0)
+			{
+				++y;
+				continue;
+			}
 
-}
+			int tri = triangle_id.at<int>(y, x);
+			int y_start = y;
 
-// if point (x0, y0) is on same side for all three half-planes it is in a triangle
-bool pointInTriangle(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3)
-{
-	bool same_1 = sameSide(x0, y0, x1, y1, x2, y2, x3, y3);
-	bool same_2 = sameSide(x0, y0, x2, y2, x1, y1, x3, y3);
-	bool same_3 = sameSide(x0, y0, x3, y3, x1, y1, x2, y2);
+			while(y < pixel_mask.rows && pixel_mask.at<uchar>(y, x) != 0 && triangle_id.at<int>(y, x) == tri)
+			{
+				++y;
+			}
 
-	return same_1 && same_2 && same_3;
+			spans.push_back(x);
+			spans.push_back(y_start);
+			spans.push_back(y - 1);
+			spans.push_back(tri);
+		}
+	}
 
+	column_spans = Mat_<int>((int)spans.size() / 4, 4);
+	if(!spans.empty())
+	{
+		std::copy(spans.begin(), spans.end(), column_spans.begin());
+	}
 }
 
-// Find if a given point lies in the triangles
-int PAW::findTriangle(const cv::Point_<double>& point, const std::vector<vector<double>>& control_points, int guess) const
+// ============================================================
+// Scanline rasterisation of the destination triangles
+// ============================================================
+
+// Mark the destination pixels covered by a triangle (boundaries included), one horizontal span per row.
+// Pixels already claimed by a lower index triangle are kept, so shared edges go to the first triangle
+void PAW::RasteriseTriangle(int tri, const double* tri_xs, const double* tri_ys)
 {
-    
-	int num_tris = control_points.size();
-	
-	int tri = -1;
-    
-	double x0 = point.x;
-	double y0 = point.y;
+	// A small tolerance so that pixels lying exactly on an edge are not lost to rounding
+	const double eps = 1e-9;
 
-	// Allow a guess for speed (so as not to go through all triangles)
-	if(guess != -1)
-	{
-		
-		bool in_triangle = pointInTriangle(x0, y0, control_points[guess][0], control_points[guess][1], control_points[guess][2], control_points[guess][3], control_points[guess][4], control_points[guess][5]);
-		if(in_triangle)
-		{
-			return guess;
-		}
-	}
+	double tri_min_y = std::min(tri_ys[0], std::min(tri_ys[1], tri_ys[2]));
+	double tri_max_y = std::max(tri_ys[0], std::max(tri_ys[1], tri_ys[2]));
 
+	int y_start = std::max(0, (int)std::ceil(tri_min_y - min_y - eps));
+	int y_end = std::min(pixel_mask.rows - 1, (int)std::floor(tri_max_y - min_y + eps));
 
-    for (int i = 0; i < num_tris; ++i)
+	for(int y = y_start; y <= y_end; ++y)
 	{
+		double yi = double(y) + min_y;
 
-		double max_x = control_points[i][6];
-		double max_y = control_points[i][7];
+		// Find the span of the scanline inside the triangle from its intersections with the edges
+		double span_min = DBL_MAX;
+		double span_max = -DBL_MAX;
 
-		double min_x = control_points[i][8];
-		double min_y = control_points[i][9];
+		for(int e = 0; e < 3; ++e)
+		{
+			double xa = tri_xs[e];
+			double ya = tri_ys[e];
+			double xb = tri_xs[(e + 1) % 3];
+			double yb = tri_ys[(e + 1) % 3];
 
-		// Skip the check if the point is outside the bounding box of the triangle
+			if((yi < ya - eps && yi < yb - eps) || (yi > ya + eps && yi > yb + eps))
+			{
+				continue;
+			}
 
-		if( max_x < x0 || min_x > x0 || max_y < y0 || min_y > y0)
+			if(std::abs(yb - ya) <= eps)
+			{
+				// Horizontal edge lying on the scanline
+				span_min = std::min(span_min, std::min(xa, xb));
+				span_max = std::max(span_max, std::max(xa, xb));
+			}
+			else
+			{
+				double t = std::min(1.0, std::max(0.0, (yi - ya) / (yb - ya)));
+				double xi = xa + t * (xb - xa);
+				span_min = std::min(span_min, xi);
+				span_max = std::max(span_max, xi);
+			}
+		}
+
+		if(span_min > span_max)
 		{
 			continue;
 		}
 
-		bool in_triangle = pointInTriangle(x0, y0, 
-			control_points[i][0], control_points[i][1],
-			control_points[i][2], control_points[i][3],
-			control_points[i][4], control_points[i][5]);
+		int x_start = std::max(0, (int)std::ceil(span_min - min_x - eps));
+		int x_end = std::min(pixel_mask.cols - 1, (int)std::floor(span_max - min_x + eps));
+
+		uchar* mask_row = pixel_mask.ptr<uchar>(y);
+		int* tri_row = triangle_id.ptr<int>(y);
 
-        if(in_triangle)
+		for(int x = x_start; x <= x_end; ++x)
 		{
-           tri = i;
-           break;
-		}        
+			if(mask_row[x] == 0)
+			{
+				mask_row[x] = 1;
+				tri_row[x] = tri;
+			}
+		}
 	}
-	return tri;
-}
\ No newline at end of file
+}
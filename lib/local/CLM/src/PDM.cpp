@@ -77,7 +77,7 @@ void Orthonormalise(cv::Matx33d &R)
 
 //===========================================================================
 // Clamping the parameter values to be within 3 standard deviations
-void PDM::Clamp(cv::Mat_<float>& local_params, Vec6d& params_global, const CLMParameters& parameters)
+void PDM::Clamp(cv::Mat_<float>& local_params, Vec6d& params_global, const CLMParameters& parameters) const
 {
 	double n_sigmas = 3;
 	cv::MatConstIterator_<double> e_it  = this->eigen_values.begin();
@@ -168,7 +168,7 @@ void PDM::CalcShape2D(Mat_<double>& out_shape, const Mat_<double>& params_local,
 //===========================================================================
 // provided the bounding box of a face and the local parameters (with optional rotation), generates the global parameters that can generate the face with the provided bounding box
 // This all assumes that the bounding box describes face from left outline to right outline of the face and chin to eyebrows
-void PDM::CalcParams(Vec6d& out_params_global, const Rect_<double>& bounding_box, const Mat_<double>& params_local, const Vec3d rotation)
+void PDM::CalcParams(Vec6d& out_params_global, const Rect_<double>& bounding_box, const Mat_<double>& params_local, const Vec3d rotation) const
 {
 
 	// get the shape instance based on local params
@@ -211,7 +211,7 @@ void PDM::CalcParams(Vec6d& out_params_global, const Rect_<double>& bounding_box
 //===========================================================================
 // provided the model parameters, compute the bounding box of a face
 // The bounding box describes face from left outline to right outline of the face and chin to eyebrows
-void PDM::CalcBoundingBox(Rect& out_bounding_box, const Vec6d& params_global, const Mat_<double>& params_local)
+void PDM::CalcBoundingBox(Rect& out_bounding_box, const Vec6d& params_global, const Mat_<double>& params_local) const
 {
 	
 	// get the shape instance based on local params
@@ -442,7 +442,7 @@ void PDM::ComputeJacobian(const Mat_<float>& params_local, const Vec6d& params_g
 
 //===========================================================================
 // Updating the parameters (more details in my thesis)
-void PDM::UpdateModelParameters(const Mat_<float>& delta_p, Mat_<float>& params_local, Vec6d& params_global)
+void PDM::UpdateModelParameters(const Mat_<float>& delta_p, Mat_<float>& params_local, Vec6d& params_global) const
 {
 
 	// The scaling and translation parameters can be just added
@@ -485,188 +485,246 @@ void PDM::UpdateModelParameters(const Mat_<float>& delta_p, Mat_<float>& params_
 
 }
 
-void PDM::CalcParams(Vec6d& out_params_global, const Mat_<double>& out_params_local, const Mat_<double>& landmark_locations, const Vec3d rotation)
+//===========================================================================
+// Helpers for fitting the model to a subset of (visible) landmarks, these index into the model instead of copying it
+
+// The 3D shape of the listed vertices, as a 3 x n_visible matrix of X, Y and Z coordinates
+static void calcVisibleShape3D(Mat_<double>& shape_3D, const Mat_<double>& mean_shape, const Mat_<double>& princ_comp, const Mat_<float>& params_local, const vector<int>& visible)
 {
-		
-	int m = this->NumberOfModes();
-	int n = this->NumberOfPoints();
+	int n = mean_shape.rows / 3;
+	int m = princ_comp.cols;
 
-	Mat_<int> visi_ind_2D(n * 2, 1, 1);
-	Mat_<int> visi_ind_3D(3 * n , 1, 1);
+	const float* p = params_local.ptr<float>(0);
 
-	for(int i = 0; i < n; ++i)
+	for(size_t k = 0; k < visible.size(); ++k)
 	{
-		// If the landmark is invisible indicate this
-		if(landmark_locations.at<double>(i) == 0)
+		for(int dim = 0; dim < 3; ++dim)
 		{
-			visi_ind_2D.at<int>(i) = 0;
-			visi_ind_2D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i) = 0;
-			visi_ind_3D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i+2*n) = 0;
+			int row = visible[k] + dim * n;
+			const double* v = princ_comp.ptr<double>(row);
+
+			double val = mean_shape.at<double>(row, 0);
+			for(int j = 0; j < m; ++j)
+			{
+				val += v[j] * p[j];
+			}
+			shape_3D.at<double>(dim, (int)k) = val;
 		}
 	}
+}
+
+// Weak-perspective projection of a 3 x n shape to a 2n x 1 vector [x1,...,xn,y1,...,yn]
+static void projectVisibleShape(Mat_<double>& shape_2D, const Mat_<double>& shape_3D, const Vec6d& params_global)
+{
+	int n = shape_3D.cols;
+
+	double s = params_global[0];
+	double tx = params_global[4];
+	double ty = params_global[5];
+
+	Matx33d R = Euler2RotationMatrix(Vec3d(params_global[1], params_global[2], params_global[3]));
+
+	const double* X = shape_3D.ptr<double>(0);
+	const double* Y = shape_3D.ptr<double>(1);
+	const double* Z = shape_3D.ptr<double>(2);
+
+	for(int i = 0; i < n; ++i)
+	{
+		shape_2D.at<double>(i, 0) = s * (R(0,0) * X[i] + R(0,1) * Y[i] + R(0,2) * Z[i]) + tx;
+		shape_2D.at<double>(i + n, 0) = s * (R(1,0) * X[i] + R(1,1) * Y[i] + R(1,2) * Z[i]) + ty;
+	}
+}
 
-	// As this might be subsampled have special versions
-	Mat_<double> M(0, mean_shape.cols, 0.0);
-	Mat_<double> V(0, princ_comp.cols, 0.0);
+// The Jacobian of the listed vertices (same layout as PDM::ComputeJacobian), written into a preallocated matrix
+static void calcVisibleJacobian(Mat_<float>& Jacobian, const Mat_<double>& shape_3D, const Mat_<double>& princ_comp, const Vec6d& params_global, const vector<int>& visible)
+{
+	int n = princ_comp.rows / 3;
+	int m = princ_comp.cols;
+	int n_vis = (int)visible.size();
+
+	float s = (float) params_global[0];
+
+	Matx33d currRot = Euler2RotationMatrix(Vec3d(params_global[1], params_global[2], params_global[3]));
+
+	float r11 = (float) currRot(0,0);
+	float r12 = (float) currRot(0,1);
+	float r13 = (float) currRot(0,2);
+	float r21 = (float) currRot(1,0);
+	float r22 = (float) currRot(1,1);
+	float r23 = (float) currRot(1,2);
 
-	for(int i = 0; i < n * 3; ++i)
+	for(int k = 0; k < n_vis; ++k)
 	{
-		if(visi_ind_3D.at<int>(i) == 1)
+		float X = (float) shape_3D.at<double>(0, k);
+		float Y = (float) shape_3D.at<double>(1, k);
+		float Z = (float) shape_3D.at<double>(2, k);
+
+		float* Jx = Jacobian.ptr<float>(k);
+		float* Jy = Jacobian.ptr<float>(k + n_vis);
+
+		// scaling term
+		Jx[0] = (X  * r11 + Y * r12 + Z * r13);
+		Jy[0] = (X  * r21 + Y * r22 + Z * r23);
+		
+		// rotation terms
+		Jx[1] = (s * (Y * r13 - Z * r12) );
+		Jy[1] = (s * (Y * r23 - Z * r22) );
+		Jx[2] = (-s * (X * r13 - Z * r11));
+		Jy[2] = (-s * (X * r23 - Z * r21));
+		Jx[3] = (s * (X * r12 - Y * r11) );
+		Jy[3] = (s * (X * r22 - Y * r21) );
+		
+		// translation terms
+		Jx[4] = 1.0f;
+		Jy[4] = 0.0f;
+		Jx[5] = 0.0f;
+		Jy[5] = 1.0f;
+
+		const double* Vx = princ_comp.ptr<double>(visible[k]);
+		const double* Vy = princ_comp.ptr<double>(visible[k] + n);
+		const double* Vz = princ_comp.ptr<double>(visible[k] + 2 * n);
+
+		for(int j = 0; j < m; ++j)
 		{
-			cv::vconcat(M, this->mean_shape.row(i), M);
-			cv::vconcat(V, this->princ_comp.row(i), V);
+			// How much the change of the non-rigid parameters (when object is rotated) affect 2D motion
+			Jx[6 + j] = (float) ( s*(r11*Vx[j] + r12*Vy[j] + r13*Vz[j]) );
+			Jy[6 + j] = (float) ( s*(r21*Vx[j] + r22*Vy[j] + r23*Vz[j]) );
 		}
 	}
+}
 
-	Mat_<double> m_old = this->mean_shape.clone();
-	Mat_<double> v_old = this->princ_comp.clone();
-
-	this->mean_shape = M;
-	this->princ_comp = V;
+// This does not modify the PDM, so it can be called concurrently (e.g. from the parallel part model fitting)
+void PDM::CalcParams(Vec6d& out_params_global, const Mat_<double>& out_params_local, const Mat_<double>& landmark_locations, const Vec3d rotation) const
+{
+		
+	int m = this->NumberOfModes();
+	int n = this->NumberOfPoints();
 
-	// The new number of points
-	n  = M.rows / 3;
+	// Only the visible landmarks are used (invisible ones are marked by 0)
+	vector<int> visible;
+	visible.reserve(n);
 
-	// Extract the relevant landmark locations
-	Mat_<double> landmark_locs_vis(n*2, 1, 0.0);
-	int k = 0;
-	for(int i = 0; i < visi_ind_2D.rows; ++i)
+	for(int i = 0; i < n; ++i)
 	{
-		if(visi_ind_2D.at<int>(i) == 1)
+		if(landmark_locations.at<double>(i) != 0)
 		{
-			landmark_locs_vis.at<double>(k) = landmark_locations.at<double>(i);
-			k++;
-		}		
+			visible.push_back(i);
+		}
 	}
 
-	// Compute the initial global parameters
-	double min_x;
-	double max_x;
-	cv::minMaxLoc(landmark_locations(Rect(0, 0, 1, this->NumberOfPoints())), &min_x, &max_x);
+	int n_vis = (int)visible.size();
 
-	double min_y;
-	double max_y;
-	cv::minMaxLoc(landmark_locations(Rect(0, this->NumberOfPoints(), 1, this->NumberOfPoints())), &min_y, &max_y);
+	if(n_vis == 0)
+	{
+		return;
+	}
+
+	// Extract the relevant landmark locations and their extent, and the extent of the corresponding mean shape points
+	Mat_<double> landmark_locs_vis(n_vis*2, 1);
+
+	double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+	double model_min_x = DBL_MAX, model_max_x = -DBL_MAX, model_min_y = DBL_MAX, model_max_y = -DBL_MAX;
+
+	for(int k = 0; k < n_vis; ++k)
+	{
+		double x = landmark_locations.at<double>(visible[k]);
+		double y = landmark_locations.at<double>(visible[k] + n);
+
+		landmark_locs_vis.at<double>(k) = x;
+		landmark_locs_vis.at<double>(k + n_vis) = y;
+
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+
+		double model_x = mean_shape.at<double>(visible[k]);
+		double model_y = mean_shape.at<double>(visible[k] + n);
+
+		model_min_x = std::min(model_min_x, model_x);
+		model_max_x = std::max(model_max_x, model_x);
+		model_min_y = std::min(model_min_y, model_y);
+		model_max_y = std::max(model_max_y, model_y);
+	}
 
+	// Compute the initial global parameters
 	double width = abs(min_x - max_x);
 	double height = abs(min_y - max_y);
 
-	Rect model_bbox;
-	CalcBoundingBox(model_bbox, Vec6d(1.0, 0.0, 0.0, 0.0, 0.0, 0.0), cv::Mat_<double>(this->NumberOfModes(), 1, 0.0));
-
-	Rect bbox((int)min_x, (int)min_y, (int)width, (int)height);
+	// The model bounding box at unit scale and no rotation (as CalcBoundingBox would give)
+	Rect model_bbox((int)model_min_x, (int)model_min_y, (int)abs(model_min_x - model_max_x), (int)abs(model_min_y - model_max_y));
 
 	double scaling = ((width / model_bbox.width) + (height / model_bbox.height)) / 2;
         
-    Vec3d rotation_init = rotation;
-	Matx33d R = Euler2RotationMatrix(rotation_init);
-    Vec2d translation((min_x + max_x) / 2.0, (min_y + max_y) / 2.0);
-    
-	Mat_<float> loc_params(this->NumberOfModes(),1, 0.0);
-	Vec6d glob_params(scaling, rotation_init[0], rotation_init[1], rotation_init[2], translation[0], translation[1]);
-
-	// get the 3D shape of the object
-	Mat_<double> loc_params_d;
-	loc_params.convertTo(loc_params_d, CV_64F);
-	Mat_<double> shape_3D = M + V * loc_params_d;
-
-	Mat_<double> curr_shape(2*n, 1);
-	
-	// for every vertex
-	for(int i = 0; i < n; i++)
+	Vec6d glob_params(scaling, rotation[0], rotation[1], rotation[2], (min_x + max_x) / 2.0, (min_y + max_y) / 2.0);
+	Mat_<float> loc_params(m, 1, 0.0f);
+
+	// The workspace, allocated once and reused by all of the iterations
+	Mat_<double> shape_3D(3, n_vis);
+	Mat_<double> curr_shape_2D(n_vis * 2, 1);
+	Mat_<float> error_resid(n_vis * 2, 1);
+	Mat_<float> J(n_vis * 2, 6 + m);
+	Mat_<float> J_t_m(6 + m, 1);
+	Mat_<float> Hessian(6 + m, 6 + m);
+	Mat_<float> param_update(6 + m, 1);
+
+	// Setting the regularisation to the inverse of eigenvalues (Tikhonov regularisation of the non-rigid parameters only)
+	Mat_<float> regularisations(6 + m, 6 + m, 0.0f);
+	for(int j = 0; j < m; ++j)
 	{
-		// Transform this using the weak-perspective mapping to 2D from 3D
-		curr_shape.at<double>(i  ,0) = scaling * ( R(0,0) * shape_3D.at<double>(i, 0) + R(0,1) * shape_3D.at<double>(i+n  ,0) + R(0,2) * shape_3D.at<double>(i+n*2,0) ) + translation[0];
-		curr_shape.at<double>(i+n,0) = scaling * ( R(1,0) * shape_3D.at<double>(i, 0) + R(1,1) * shape_3D.at<double>(i+n  ,0) + R(1,2) * shape_3D.at<double>(i+n*2,0) ) + translation[1];
+		regularisations.at<float>(6 + j, 6 + j) = (float)(1.0 / this->eigen_values.at<double>(j));
 	}
-		    
-    double currError = cv::norm(curr_shape - landmark_locs_vis);
-
-	Mat_<float> regularisations = Mat_<double>::zeros(1, 6 + m);
 
-	double reg_factor = 1;
+	calcVisibleShape3D(shape_3D, mean_shape, princ_comp, loc_params, visible);
+	projectVisibleShape(curr_shape_2D, shape_3D, glob_params);
 
-	// Setting the regularisation to the inverse of eigenvalues
-	Mat(reg_factor / this->eigen_values).copyTo(regularisations(Rect(6, 0, m, 1)));
-	Mat_<double> regTerm_d = Mat::diag(regularisations.t());
-	regTerm_d.convertTo(regularisations, CV_32F);    
-    
-	Mat_<float> WeightMatrix = Mat_<float>::eye(n*2, n*2);
+	double currError = cv::norm(curr_shape_2D, landmark_locs_vis, NORM_L2);
 
 	int not_improved_in = 0;
 
-    for (size_t i = 0; i < 1000; ++i)
+	for (size_t i = 0; i < 1000; ++i)
 	{
-		// get the 3D shape of the object
-		Mat_<double> loc_params_d;
-		loc_params.convertTo(loc_params_d, CV_64F);
-		shape_3D = M + V * loc_params_d;
+		// get the 3D and 2D shape of the object
+		calcVisibleShape3D(shape_3D, mean_shape, princ_comp, loc_params, visible);
+		projectVisibleShape(curr_shape_2D, shape_3D, glob_params);
 
-		shape_3D = shape_3D.reshape(1, 3);
-
-		Matx23d R_2D(R(0,0), R(0,1), R(0,2), R(1,0), R(1,1), R(1,2)); 
+		for(int k = 0; k < n_vis * 2; ++k)
+		{
+			error_resid.at<float>(k) = (float)(landmark_locs_vis.at<double>(k) - curr_shape_2D.at<double>(k));
+		}
 
-		Mat_<double> curr_shape_2D = scaling * shape_3D.t() * Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
+		calcVisibleJacobian(J, shape_3D, princ_comp, glob_params, visible);
 
-		curr_shape_2D = Mat(curr_shape_2D.t()).reshape(1, n * 2);
-		
-		Mat_<float> error_resid;
-		Mat(landmark_locs_vis - curr_shape_2D).convertTo(error_resid, CV_32F);
-        
-		Mat_<float> J, J_w_t;
-		this->ComputeJacobian(loc_params, glob_params, J, WeightMatrix, J_w_t);
-        
-		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		Mat_<float> J_w_t_m = J_w_t * error_resid;
+		// projection of the meanshifts onto the jacobians (all of the landmarks are weighted equally here)
+		cv::gemm(J, error_resid, 1, noArray(), 0, J_t_m, GEMM_1_T);
 
 		// Add the regularisation term
-		J_w_t_m(Rect(0,6,1, m)) = J_w_t_m(Rect(0,6,1, m)) - regularisations(Rect(6,6, m, m)) * loc_params;
-
-		Mat_<float> Hessian = J_w_t * J;
+		for(int j = 0; j < m; ++j)
+		{
+			J_t_m.at<float>(6 + j) -= regularisations.at<float>(6 + j, 6 + j) * loc_params.at<float>(j);
+		}
 
-		// Add the Tikhonov regularisation
-		Hessian = Hessian + regularisations;
+		// The Hessian with the Tikhonov regularisation
+		cv::gemm(J, J, 1, regularisations, 1, Hessian, GEMM_1_T);
 
 		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
-		Mat_<float> param_update;
-		solve(Hessian, J_w_t_m, param_update, CV_CHOLESKY);
+		solve(Hessian, J_t_m, param_update, DECOMP_CHOLESKY);
 
 		// To not overshoot, have the gradient decent rate a bit smaller
-		param_update = 0.5 * param_update;
+		param_update *= 0.5;
 
 		UpdateModelParameters(param_update, loc_params, glob_params);		
-        
-        scaling = glob_params[0];
-		rotation_init[0] = glob_params[1];
-		rotation_init[1] = glob_params[2];
-		rotation_init[2] = glob_params[3];
-
-		translation[0] = glob_params[4];
-		translation[1] = glob_params[5];
-        
-		R = Euler2RotationMatrix(rotation_init);
 
-		R_2D(0,0) = R(0,0);R_2D(0,1) = R(0,1); R_2D(0,2) = R(0,2);
-		R_2D(1,0) = R(1,0);R_2D(1,1) = R(1,1); R_2D(1,2) = R(1,2); 
-
-		curr_shape_2D = scaling * shape_3D.t() * Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
-
-		curr_shape_2D = Mat(curr_shape_2D.t()).reshape(1, n * 2);
+		projectVisibleShape(curr_shape_2D, shape_3D, glob_params);
         
-        double error = cv::norm(curr_shape_2D - landmark_locs_vis);
+		double error = cv::norm(curr_shape_2D, landmark_locs_vis, NORM_L2);
         
-        if(0.999 * currError < error)
+		if(0.999 * currError < error)
 		{
 			not_improved_in++;
 			if (not_improved_in == 5)
 			{
-	            break;
+				break;
 			}
 		}
 
@@ -676,10 +734,6 @@ void PDM::CalcParams(Vec6d& out_params_global, const Mat_<double>& out_params_lo
 
 	out_params_global = glob_params;
 	loc_params.convertTo(out_params_local, CV_64F);
-    	
-	this->mean_shape = m_old;
-	this->princ_comp = v_old;
-
 
 }
 
@@ -704,3 +758,161 @@ void PDM::Read(string location)
 	CLMTracker::ReadMat(pdmLoc,eigen_values);
 
 }
+
+//===========================================================================
+// Fused evaluation of the PDM
+//===========================================================================
+
+// Filling in the Jacobian rows of a single vertex (x row and y row), the non-rigid part is only filled if m > 0
+static inline void fillJacobianRows(float* Jx, float* Jy, float X, float Y, float Z, float s, const Matx33f& R, const double* Vx, const double* Vy, const double* Vz, int m)
+{
+	// The rigid jacobian from the axis angle rotation matrix approximation using small angle assumption (see PDM::ComputeJacobian)
+
+	// scaling term
+	Jx[0] = (X  * R(0,0) + Y * R(0,1) + Z * R(0,2));
+	Jy[0] = (X  * R(1,0) + Y * R(1,1) + Z * R(1,2));
+		
+	// rotation terms
+	Jx[1] = (s * (Y * R(0,2) - Z * R(0,1)) );
+	Jy[1] = (s * (Y * R(1,2) - Z * R(1,1)) );
+	Jx[2] = (-s * (X * R(0,2) - Z * R(0,0)));
+	Jy[2] = (-s * (X * R(1,2) - Z * R(1,0)));
+	Jx[3] = (s * (X * R(0,1) - Y * R(0,0)) );
+	Jy[3] = (s * (X * R(1,1) - Y * R(1,0)) );
+		
+	// translation terms
+	Jx[4] = 1.0f;
+	Jy[4] = 0.0f;
+	Jx[5] = 0.0f;
+	Jy[5] = 1.0f;
+
+	for(int j = 0; j < m; ++j)
+	{
+		// How much the change of the non-rigid parameters (when object is rotated) affect 2D motion
+		Jx[6 + j] = (float) ( s*(R(0,0)*Vx[j] + R(0,1)*Vy[j] + R(0,2)*Vz[j]) );
+		Jy[6 + j] = (float) ( s*(R(1,0)*Vx[j] + R(1,1)*Vy[j] + R(1,2)*Vz[j]) );
+	}
+}
+
+void PDM_evaluation::Evaluate(const PDM& pdm, const cv::Mat& params_local, const Vec6d& params_global, bool compute_jacobian, bool rigid)
+{
+	params_local.convertTo(local_buffer, CV_64F);
+
+	bool same_params = has_shape && pdm_shape_data == pdm.princ_comp.data && params_global == cached_global && 
+		cached_local.rows == local_buffer.rows && std::equal(local_buffer.begin(), local_buffer.end(), cached_local.begin());
+
+	if(same_params)
+	{
+		// Only the Jacobian might be missing
+		if(compute_jacobian && !(has_jacobian && jacobian_rigid == rigid))
+		{
+			ComputeJacobian(pdm, rigid);
+		}
+		return;
+	}
+
+	local_buffer.copyTo(cached_local);
+	cached_global = params_global;
+	pdm_shape_data = pdm.princ_comp.data;
+
+	int n = pdm.NumberOfPoints();
+	int m = pdm.NumberOfModes();
+
+	double s = params_global[0];
+	double tx = params_global[4];
+	double ty = params_global[5];
+
+	rotation = Euler2RotationMatrix(Vec3d(params_global[1], params_global[2], params_global[3]));
+	Matx33f rotation_f = rotation;
+
+	shape_3D.create(3 * n, 1);
+	shape_2D.create(2 * n, 1);
+
+	if(compute_jacobian)
+	{
+		jacobian.create(2 * n, rigid ? 6 : 6 + m);
+	}
+
+	const double* p = cached_local.ptr<double>(0);
+
+	for(int i = 0; i < n; ++i)
+	{
+		const double* Vx = pdm.princ_comp.ptr<double>(i);
+		const double* Vy = pdm.princ_comp.ptr<double>(i + n);
+		const double* Vz = pdm.princ_comp.ptr<double>(i + 2 * n);
+
+		// The 3D shape
+		double X = pdm.mean_shape.at<double>(i);
+		double Y = pdm.mean_shape.at<double>(i + n);
+		double Z = pdm.mean_shape.at<double>(i + 2 * n);
+
+		for(int j = 0; j < m; ++j)
+		{
+			X += Vx[j] * p[j];
+			Y += Vy[j] * p[j];
+			Z += Vz[j] * p[j];
+		}
+
+		shape_3D.at<double>(i) = X;
+		shape_3D.at<double>(i + n) = Y;
+		shape_3D.at<double>(i + 2 * n) = Z;
+
+		// Transform this using the weak-perspective mapping to 2D from 3D
+		shape_2D.at<double>(i) = s * (rotation(0,0) * X + rotation(0,1) * Y + rotation(0,2) * Z) + tx;
+		shape_2D.at<double>(i + n) = s * (rotation(1,0) * X + rotation(1,1) * Y + rotation(1,2) * Z) + ty;
+
+		if(compute_jacobian)
+		{
+			fillJacobianRows(jacobian.ptr<float>(i), jacobian.ptr<float>(i + n), (float)X, (float)Y, (float)Z, (float)s, rotation_f, Vx, Vy, Vz, rigid ? 0 : m);
+		}
+	}
+
+	has_shape = true;
+	has_jacobian = compute_jacobian;
+	jacobian_rigid = rigid;
+}
+
+// Computing the Jacobian from an already evaluated shape
+void PDM_evaluation::ComputeJacobian(const PDM& pdm, bool rigid)
+{
+	int n = pdm.NumberOfPoints();
+	int m = pdm.NumberOfModes();
+
+	jacobian.create(2 * n, rigid ? 6 : 6 + m);
+
+	Matx33f rotation_f = rotation;
+	float s = (float)cached_global[0];
+
+	for(int i = 0; i < n; ++i)
+	{
+		fillJacobianRows(jacobian.ptr<float>(i), jacobian.ptr<float>(i + n), 
+			(float)shape_3D.at<double>(i), (float)shape_3D.at<double>(i + n), (float)shape_3D.at<double>(i + 2 * n), s, rotation_f,
+			pdm.princ_comp.ptr<double>(i), pdm.princ_comp.ptr<double>(i + n), pdm.princ_comp.ptr<double>(i + 2 * n), rigid ? 0 : m);
+	}
+
+	has_jacobian = true;
+	jacobian_rigid = rigid;
+}
+
+void PDM_evaluation::Project(Mat_<double>& out_shape, const Vec6d& params_global) const
+{
+	int n = shape_3D.rows / 3;
+
+	double s = params_global[0];
+	double tx = params_global[4];
+	double ty = params_global[5];
+
+	Matx33d R = Euler2RotationMatrix(Vec3d(params_global[1], params_global[2], params_global[3]));
+
+	out_shape.create(2 * n, 1);
+
+	for(int i = 0; i < n; ++i)
+	{
+		double X = shape_3D.at<double>(i);
+		double Y = shape_3D.at<double>(i + n);
+		double Z = shape_3D.at<double>(i + 2 * n);
+
+		out_shape.at<double>(i) = s * (R(0,0) * X + R(0,1) * Y + R(0,2) * Z) + tx;
+		out_shape.at<double>(i + n) = s * (R(1,0) * X + R(1,1) * Y + R(1,2) * Z) + ty;
+	}
+}
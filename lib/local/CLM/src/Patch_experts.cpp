@@ -55,13 +55,72 @@ using namespace cv;
 
 using namespace CLMTracker;
 
+// Computes the CCNF sigmas and the dfts of the patch expert weights needed for responses at a scale, view and window size (if they are not computed yet)
+void Patch_experts::Prepare(int scale, int view_id, int window_size)
+{
+	int n = visibilities[scale][view_id].rows;
+
+	if(!ccnf_expert_intensity.empty())
+	{
+		vector<Mat_<float> > sigma_components;
+
+		// Retrieve the correct sigma component size
+		for( size_t w_size = 0; w_size < this->sigma_components.size(); ++w_size)
+		{
+			if(!this->sigma_components[w_size].empty())
+			{
+				if(window_size*window_size == this->sigma_components[w_size][0].rows)
+				{
+					sigma_components = this->sigma_components[w_size];
+				}
+			}
+		}			
+
+		// Go through all of the visible landmarks
+		for( int lmark = 0; lmark < n; lmark++)
+		{
+			if(visibilities[scale][view_id].at<int>(lmark,0))
+			{
+				ccnf_expert_intensity[scale][view_id][lmark].Prepare(sigma_components, window_size);
+			}
+		}
+	}
+	else
+	{
+		for( int lmark = 0; lmark < n; lmark++)
+		{
+			if(visibilities[scale][view_id].at<int>(lmark,0))
+			{
+				svr_expert_intensity[scale][view_id][lmark].Prepare(window_size);
+			}
+		}
+	}
+
+	if(!svr_expert_depth.empty())
+	{
+		for( int lmark = 0; lmark < n; lmark++)
+		{
+			if(visibilities[scale][view_id].at<int>(lmark,0))
+			{
+				svr_expert_depth[scale][view_id][lmark].Prepare(window_size);
+			}
+		}
+	}
+}
 
 // Returns the patch expert responses given a grayscale and an optional depth image.
 // Additionally returns the transform from the image coordinates to the response coordinates (and vice versa).
 // The computation also requires the current landmark locations to compute response around, the PDM corresponding to the desired model, and the parameters describing its instance
 // Also need to provide the size of the area of interest and the desired scale of analysis
 void Patch_experts::Response(vector<cv::Mat_<float> >& patch_expert_responses, Matx22f& sim_ref_to_img, Matx22d& sim_img_to_ref, const Mat_<uchar>& grayscale_image, const Mat_<float>& depth_image,
-							 const PDM& pdm, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale)
+							 const PDM& pdm, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale, const ConcurrencyParameters& concurrency) const
+{
+	PDM_evaluation pdm_evaluation;
+	Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, grayscale_image, depth_image, pdm, pdm_evaluation, params_global, params_local, window_size, scale, concurrency);
+}
+
+void Patch_experts::Response(vector<cv::Mat_<float> >& patch_expert_responses, Matx22f& sim_ref_to_img, Matx22d& sim_img_to_ref, const Mat_<uchar>& grayscale_image, const Mat_<float>& depth_image,
+							 const PDM& pdm, PDM_evaluation& pdm_evaluation, const Vec6d& params_global, const Mat_<double>& params_local, int window_size, int scale, const ConcurrencyParameters& concurrency) const
 {
 
 	int view_id = GetViewIdx(params_global, scale);		
@@ -69,17 +128,17 @@ void Patch_experts::Response(vector<cv::Mat_<float> >& patch_expert_responses, M
 	int n = pdm.NumberOfPoints();
 		
 	// Compute the current landmark locations (around which responses will be computed)
-	Mat_<double> landmark_locations;
+	pdm_evaluation.Evaluate(pdm, params_local, params_global);
 
-	pdm.CalcShape2D(landmark_locations, params_local, params_global);
+	Mat_<double> landmark_locations = pdm_evaluation.shape_2D;
 
 	Mat_<double> reference_shape;
 		
 	// Initialise the reference shape on which we'll be warping
 	Vec6d global_ref(patch_scaling[scale], 0, 0, 0, 0, 0);
 
-	// Compute the reference shape
-	pdm.CalcShape2D(reference_shape, params_local, global_ref);
+	// Compute the reference shape (the same 3D shape projected differently)
+	pdm_evaluation.Project(reference_shape, global_ref);
 		
 	// similarity and inverse similarity transform to and from image and reference shape
 	Mat_<double> reference_shape_2D = (reference_shape.reshape(1, 2).t());
@@ -107,42 +166,9 @@ void Patch_experts::Response(vector<cv::Mat_<float> >& patch_expert_responses, M
 
 	bool use_ccnf = !this->ccnf_expert_intensity.empty();
 
-	// If using CCNF patch experts might need to precalculate Sigmas
-	if(use_ccnf)
-	{
-		vector<Mat_<float> > sigma_components;
-
-		// Retrieve the correct sigma component size
-		for( size_t w_size = 0; w_size < this->sigma_components.size(); ++w_size)
-		{
-			if(!this->sigma_components[w_size].empty())
-			{
-				if(window_size*window_size == this->sigma_components[w_size][0].rows)
-				{
-					sigma_components = this->sigma_components[w_size];
-				}
-			}
-		}			
-
-		// Go through all of the landmarks and compute the Sigma for each
-		for( int lmark = 0; lmark < n; lmark++)
-		{
-			// Only for visible landmarks
-			if(visibilities[scale][view_id].at<int>(lmark,0))
-			{
-				// Precompute sigmas if they are not computed yet
-				ccnf_expert_intensity[scale][view_id][lmark].ComputeSigmas(sigma_components, window_size);
-			}
-		}
-
-	}
-
-	// calculate the patch responses for every landmark, Actual work happens here. If openMP is turned on it is possible to do this in parallel,
-	// this might work well on some machines, while potentially have an adverse effect on others
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-	tbb::parallel_for(0, (int)n, [&](int i){
+	// calculate the patch responses for every landmark, Actual work happens here. The landmarks are done in parallel (unless the concurrency
+	// parameters ask for a serial run), this might work well on some machines, while potentially have an adverse effect on others
+	ParallelFor(concurrency, 0, (int)n, concurrency.grain_landmarks, [&](int i){
 	//for(int i = 0; i < n; i++)
 	{
 			
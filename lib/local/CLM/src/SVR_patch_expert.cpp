@@ -125,7 +125,13 @@ void SVR_patch_expert::Read(ifstream &stream)
 }
 
 //===========================================================================
-void SVR_patch_expert::Response(const Mat_<float>& area_of_interest, Mat_<float>& response)
+void SVR_patch_expert::Prepare(int area_width, int area_height)
+{
+	PrecomputeTemplateDFT(weights, weights_dfts, area_width, area_height);
+}
+
+//===========================================================================
+void SVR_patch_expert::Response(const Mat_<float>& area_of_interest, Mat_<float>& response) const
 {
 
 	int response_height = area_of_interest.rows - weights.rows + 1;
@@ -189,7 +195,7 @@ void SVR_patch_expert::Response(const Mat_<float>& area_of_interest, Mat_<float>
 
 }
 
-void SVR_patch_expert::ResponseDepth(const Mat_<float>& area_of_interest, cv::Mat_<float> &response)
+void SVR_patch_expert::ResponseDepth(const Mat_<float>& area_of_interest, cv::Mat_<float> &response) const
 {
 
 	// How big the response map will be
@@ -274,7 +280,16 @@ void Multi_SVR_patch_expert::Read(ifstream &stream)
 
 }
 //===========================================================================
-void Multi_SVR_patch_expert::Response(const Mat_<float> &area_of_interest, Mat_<float> &response)
+void Multi_SVR_patch_expert::Prepare(int window_size)
+{
+	for(size_t i = 0; i < svr_patch_experts.size(); i++)
+	{
+		svr_patch_experts[i].Prepare(window_size + width - 1, window_size + height - 1);
+	}
+}
+
+//===========================================================================
+void Multi_SVR_patch_expert::Response(const Mat_<float> &area_of_interest, Mat_<float> &response) const
 {
 	
 	int response_height = area_of_interest.rows - height + 1;
@@ -308,7 +323,7 @@ void Multi_SVR_patch_expert::Response(const Mat_<float> &area_of_interest, Mat_<
 
 }
 
-void Multi_SVR_patch_expert::ResponseDepth(const Mat_<float>& area_of_interest, Mat_<float>& response)
+void Multi_SVR_patch_expert::ResponseDepth(const Mat_<float>& area_of_interest, Mat_<float>& response) const
 {
 	int response_height = area_of_interest.rows - height + 1;
 	int response_width = area_of_interest.cols - width + 1;
@@ -0,0 +1,158 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AUPREDICTIONHISTORY_h_
+#define __AUPREDICTIONHISTORY_h_
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include <opencv2/core/core.hpp>
+
+namespace FaceAnalysis
+{
+
+// Per-frame AU predictions of a whole video kept in a columnar form for offline post-processing. Frames are stored in fixed size chunks,
+// every chunk holds a row of single precision values per AU (columns sorted by AU name, regression ones followed by classification ones)
+// and a row each of timestamps, confidences and successes. Chunks are allocated once and never grow, so memory does not fragment over
+// long recordings, and if a spill file is set the full chunks beyond a given number are written out to it and released, keeping memory flat
+class AU_prediction_history{
+
+public:
+
+	AU_prediction_history(int chunk_size = 1024);
+	~AU_prediction_history();
+
+	// Full chunks are moved to the spill file once more than max_resident_chunks of them are held in memory, an empty location keeps
+	// everything in memory. The file is overwritten and removed again when the history is destroyed
+	void SetSpillFile(const std::string& location, int max_resident_chunks = 4);
+
+	// Add the predictions of a frame, the AU names in the first frame fix the columns and the later frames have to come in the same order
+	// (predictions of unsuccessful frames are not meaningful and are stored as -100)
+	void AddFrame(const std::vector<std::pair<std::string, double>>& predictions_reg, const std::vector<std::pair<std::string, double>>& predictions_class,
+		double timestamp, double confidence, bool success);
+
+	void Clear();
+
+	int NumFrames() const
+	{
+		return num_frames;
+	}
+
+	int NumChunks() const
+	{
+		return (int)chunks.size();
+	}
+
+	const std::vector<std::string>& GetAURegNames() const
+	{
+		return AU_names_reg;
+	}
+
+	const std::vector<std::string>& GetAUClassNames() const
+	{
+		return AU_names_class;
+	}
+
+	// The values of a chunk (a row per AU, regression followed by classification, and a column per frame) and the frame information
+	// (timestamp, confidence and success rows). For chunks in memory these are headers into the history and no data is copied (so they
+	// should not be written to), spilled chunks are read back from the file
+	void ReadChunk(int chunk, cv::Mat_<float>& values, cv::Mat_<double>& frame_info);
+
+	// The value below which the given ratio of the successfully tracked frames of an AU lie (0 if there are no such frames),
+	// only one column is read at a time so this does not need the whole history in memory
+	double SuccessfulQuantile(int column, double ratio);
+
+	// Rows of frame_info
+	enum FrameInfo{ TIMESTAMP = 0, CONFIDENCE = 1, SUCCESS = 2 };
+
+private:
+
+	struct Chunk
+	{
+		cv::Mat_<float> values;
+		cv::Mat_<double> frame_info;
+		int num_frames;
+		bool spilled;
+		std::streamoff spill_offset;
+	};
+
+	// Read a single row of the values or frame information of a chunk (from the spill file if needed)
+	void ReadChunkRow(const Chunk& chunk, int row, bool frame_info_row, void* data);
+
+	// Returns false if the spill file could not be written (in which case the chunk, and the ones after it, stay in memory)
+	bool SpillChunk(Chunk& chunk);
+
+	int chunk_size;
+	int num_frames;
+
+	std::vector<std::string> AU_names_reg;
+	std::vector<std::string> AU_names_class;
+
+	// Where the i-th prediction of a frame goes (the predictions do not come sorted by name)
+	std::vector<int> column_reg;
+	std::vector<int> column_class;
+
+	std::vector<Chunk> chunks;
+
+	// The oldest chunk that has not been spilled yet
+	size_t first_resident;
+
+	std::string spill_location;
+	int max_resident_chunks;
+	std::fstream spill_file;
+	std::streamoff spill_end;
+
+	// Set once a write to the spill file has failed (e.g. a full disk), no more chunks are spilled after that
+	bool spill_failed;
+
+	// Copying would share the chunks and the spill file
+	AU_prediction_history(const AU_prediction_history&);
+	AU_prediction_history& operator=(const AU_prediction_history&);
+};
+  //===========================================================================
+}
+#endif
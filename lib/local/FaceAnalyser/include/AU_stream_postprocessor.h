@@ -0,0 +1,122 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AUSTREAMPOSTPROCESSOR_h_
+#define __AUSTREAMPOSTPROCESSOR_h_
+
+#include <vector>
+#include <string>
+#include <deque>
+
+#include <opencv2/core/core.hpp>
+
+namespace FaceAnalysis
+{
+
+// Applies the person specific offset correction of the offline AU post-processing to a stream of frames, without needing the whole
+// session. Instead of the exact quantile over all frames the offsets are estimated from histograms of the successfully tracked
+// predictions (as in FaceAnalyser::UpdatePredictionTrack), and frames are held back for a fixed lookahead so that their correction
+// also takes into account the frames that follow them. Memory is bounded by the lookahead and the histograms
+class AU_stream_postprocessor{
+
+public:
+
+	AU_stream_postprocessor(int lookahead = 300) : lookahead(lookahead), releasable(0), histogram_count(0)
+	{}
+
+	void SetLookahead(int lookahead)
+	{
+		this->lookahead = lookahead;
+	}
+
+	int GetLookahead() const
+	{
+		return lookahead;
+	}
+
+	// Add the uncorrected predictions of a frame (the AUs have to come in the same order in every frame)
+	void AddFrame(const std::vector<std::pair<std::string, double>>& predictions_reg, const std::vector<std::pair<std::string, double>>& predictions_class,
+		double timestamp, double confidence, bool success);
+
+	// At the end of the stream, makes all of the frames added so far available without waiting for the lookahead
+	void Flush();
+
+	// Get the oldest frame that is ready, with the regression predictions corrected and the classification ones as they came in,
+	// returns false if no frame is ready yet. Frames come out in the order they were added
+	bool NextFrame(std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class,
+		double& timestamp, double& confidence, bool& success);
+
+	// Drops any frames that have not come out yet and forgets the estimated offsets (e.g. for a new person)
+	void Reset();
+
+private:
+
+	struct Frame
+	{
+		std::vector<double> values_reg;
+		std::vector<double> values_class;
+		double timestamp;
+		double confidence;
+		bool success;
+	};
+
+	int lookahead;
+
+	std::vector<std::string> AU_names_reg;
+	std::vector<std::string> AU_names_class;
+
+	std::deque<Frame> frames;
+
+	// How many of the oldest frames can come out regardless of the lookahead (after a flush)
+	size_t releasable;
+
+	// Histograms of the successful regression predictions and the offsets they give
+	cv::Mat_<unsigned int> histogram;
+	int histogram_count;
+	std::vector<double> offsets;
+};
+  //===========================================================================
+}
+#endif
@@ -50,6 +50,10 @@
 #include "SVR_static_lin_regressors.h"
 #include "SVM_static_lin.h"
 #include "SVM_dynamic_lin.h"
+#include "Fused_lin_predictors.h"
+#include "Face_aligner.h"
+#include "AU_prediction_history.h"
+#include "AU_stream_postprocessor.h"
 
 #include <string>
 #include <vector>
@@ -61,6 +65,42 @@
 namespace FaceAnalysis
 {
 
+// The frames of a part of a video added for offline prediction (see FaceAnalyser::AddOfflineFrames), the parts can be filled
+// independently (e.g. by different threads working on different parts of the video) and are then merged in order
+struct Offline_frames
+{
+	// Linear responses per batch of frames, and the view, success, certainty and timestamp of every frame
+	vector<Mat_<float> > responses;
+	vector<int> views;
+	vector<bool> successes;
+	vector<double> certainties;
+	vector<double> timestamps;
+
+	// The median histograms of the part (per view for HOG), together with the first and the last descriptor added to each,
+	// as the median of a histogram with at most one sample is a descriptor itself
+	vector<Mat_<unsigned int> > hog_hists;
+	vector<int> hog_hist_sums;
+	vector<Mat_<double> > hog_first;
+	vector<Mat_<double> > hog_last;
+
+	Mat_<unsigned int> geom_hist;
+	int geom_hist_sum;
+	Mat_<double> geom_first;
+	Mat_<double> geom_last;
+
+	// The latest frame of the part
+	Mat_<double> hog_desc_frame;
+	Mat_<double> geom_descriptor_frame;
+	int num_hog_rows;
+	int num_hog_cols;
+	Mat aligned_face;
+	double time_seconds;
+
+	Offline_frames() : geom_hist_sum(0), num_hog_rows(0), num_hog_cols(0), time_seconds(0)
+	{
+	}
+};
+
 class FaceAnalyser{
 
 public:
@@ -141,6 +181,52 @@ public:
 	void ExtractAllPredictionsOfflineReg(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps);
 	void ExtractAllPredictionsOfflineClass(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps);
 
+	// Keep all but the latest few chunks of the per-frame AU predictions in a file rather than in memory (for long videos)
+	void SetPredictionSpillFile(const std::string& location, int max_resident_chunks = 4);
+
+	// Allows to go through the per-frame predictions chunk by chunk (instead of extracting all of them at once as above),
+	// the regression ones can be corrected using the offsets from ExtractOfflineRegOffsets and CorrectOfflineReg
+	AU_prediction_history& GetAUPredictionHistory();
+	void ExtractOfflineRegOffsets(vector<double>& offsets);
+	static double CorrectOfflineReg(double prediction, double offset, bool success);
+
+	// Instead of keeping all of the predictions for offline post-processing, correct them as they come in (for unbounded streams),
+	// every frame becomes available through GetNextStreamedAUs lookahead_frames later (or after FlushStreamedAUs at the end).
+	// The streamed frames are dropped on Reset, so they should be flushed and collected first
+	void SetStreamingPostprocessing(int lookahead_frames);
+	bool GetNextStreamedAUs(std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class,
+		double& timestamp, double& confidence, bool& success);
+	void FlushStreamedAUs();
+
+	// Offline prediction for frames that have already been tracked (e.g. in a first pass over a video), in which case the alignment, HOG
+	// extraction and prediction of the frames in a batch can be done in parallel. The running medians are computed from all of the frames,
+	// so the AUs are only predicted once FinishOfflinePrediction is called after the last batch, and become available as if the frames
+	// were added one by one with AddNextFrame. The aligned faces and HOG descriptors of the batch are returned for output
+	void AddOfflineFrames(const vector<Mat>& frames, const vector<Vec6d>& params_global, const vector<Mat_<double>>& params_local, const vector<bool>& successes,
+		const vector<double>& certainties, const vector<double>& timestamps, const CLMTracker::PDM& pdm, const CLMTracker::ConcurrencyParameters& concurrency,
+		vector<Mat>& aligned_faces, vector<Mat_<double>>& hog_descriptors);
+	void FinishOfflinePrediction();
+
+	// The same for separate parts of a video that are processed concurrently: once PrepareOfflineFrames has been called the batches of
+	// every part can be added to their own Offline_frames (in frame order within the part), and the parts are merged into the analyser
+	// in frame order before FinishOfflinePrediction
+	void PrepareOfflineFrames(const CLMTracker::PDM& pdm);
+	void AddOfflineFrames(Offline_frames& part, const vector<Mat>& frames, const vector<Vec6d>& params_global, const vector<Mat_<double>>& params_local,
+		const vector<bool>& successes, const vector<double>& certainties, const vector<double>& timestamps, const CLMTracker::PDM& pdm,
+		const CLMTracker::ConcurrencyParameters& concurrency, vector<Mat>& aligned_faces, vector<Mat_<double>>& hog_descriptors) const;
+	void MergeOfflineFrames(const Offline_frames& part);
+
+	// The person specific normalisation (running median histograms, prediction correction histograms and dynamic scaling) can be saved at the
+	// end of a session and restored at the start of the next one with the same subject, so that the predictions are calibrated from the first frame.
+	// The median shape of the subject is stored as well and restored as the shape prior of the CLM (CLM::params_local_prior).
+	// Loading fails if the file is missing or belongs to another subject id, in which case the current state is kept
+	bool SaveSubjectState(const std::string& location, const std::string& subject_id, const CLMTracker::CLM& clm_model);
+	bool LoadSubjectState(const std::string& location, const std::string& subject_id, CLMTracker::CLM& clm_model);
+
+	// The AUs predicted by the model are not always 0 calibrated to a person. That is they don't always predict 0 for a neutral expression
+	// Keeping track of the predictions we can correct for this, by assuming that at least "ratio" of frames are neutral and subtract that value of prediction, only perform the correction after min_frames
+	static void UpdatePredictionTrack(Mat_<unsigned int>& prediction_corr_histogram, int& prediction_correction_count, vector<double>& correction, const vector<pair<string, double>>& predictions, double ratio=0.25, int num_bins = 200, double min_val = -3, double max_val = 5, int min_frames = 10);	
+
 private:
 
 	// Where the predictions are kept
@@ -150,11 +236,25 @@ private:
 	std::vector<std::pair<std::string, double>> AU_predictions_combined;
 
 	// Keeping track of AU predictions over time (useful for post-processing)
-	vector<double> timestamps;
-	std::map<std::string, vector<double>> AU_predictions_reg_all_hist;
-	std::map<std::string, vector<double>> AU_predictions_class_all_hist;
-	std::vector<double> confidences;
-	std::vector<bool> valid_preds;
+	AU_prediction_history AU_predictions_hist;
+
+	// Or the streaming correction of them if that is used instead
+	bool stream_postprocessing;
+	AU_stream_postprocessor AU_predictions_stream;
+
+	// The frames added for offline prediction, waiting for the medians to be complete (linear responses per batch of frames, and the view,
+	// success, certainty and timestamp of every frame), and the median HOG descriptor of every view
+	vector<Mat_<float> > offline_responses;
+	vector<int> offline_views;
+	vector<bool> offline_successes;
+	vector<double> offline_certainties;
+	vector<double> offline_timestamps;
+	vector<Mat_<double> > offline_hog_medians;
+
+	void ClearOfflineFrames();
+
+	// All of the uncorrected regression or classification predictions from the history
+	void ExtractAllPredictions(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps, bool reg);
 
 	int frames_tracking;
 
@@ -163,6 +263,9 @@ private:
 	Mat aligned_face;
 	Mat hog_descriptor_visualisation;
 
+	// Similarity alignment and masking of the face, set up on first use (once the landmark model is known)
+	Face_aligner face_aligner;
+
 	// Private members to be used for predictions
 	// The HOG descriptor of the last frame
 	Mat_<double> hog_desc_frame;
@@ -190,12 +293,17 @@ private:
 	vector<int> hog_hist_sum;
 	int view_used;
 
+	// For every histogram the current median bin of each dimension (first row) and the number of samples in the bins below it (second row),
+	// so that the median can be moved along as samples are added rather than recomputed from the whole histogram
+	vector<Mat_<int> > hog_median_state;
+
 	// The geometry descriptor (rigid followed by non-rigid shape parameters from CLM)
 	Mat_<double> geom_descriptor_frame;
 	Mat_<double> geom_descriptor_median;
 	
 	int geom_hist_sum;
 	Mat_<unsigned int> geom_desc_hist;
+	Mat_<int> geom_median_state;
 	int num_bins_geom;
 	double min_val_geom;
 	double max_val_geom;
@@ -203,9 +311,8 @@ private:
 	// Using the bounding box of previous analysed frame to determine if a reset is needed
 	Rect_<double> face_bounding_box;
 	
-	// The AU predictions internally
-	std::vector<std::pair<std::string, double>> PredictCurrentAUs(int view);
-	std::vector<std::pair<std::string, double>> PredictCurrentAUsClass(int view);
+	// The AU predictions internally (regression and classification)
+	void PredictCurrentAUs(int view, std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class);
 
 	// special step for online (rather than offline AU prediction)
 	std::vector<pair<string, double>> CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift = false, bool dyn_scale = false, bool update_track = true, bool clip_values = false);
@@ -217,7 +324,12 @@ private:
 	// A utility function for keeping track of approximate running medians used for AU and emotion inference using a set of histograms (the histograms are evenly spaced from min_val to max_val)
 	// Descriptor has to be a row vector
 	// TODO this duplicates some other code
-	void UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_sum, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val);
+	void UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_sum, cv::Mat_<int>& median_state, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val);
+	void InitialiseMedianState(const cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<int>& median_state);
+
+	// Adds the histogram of a part of the offline frames to a running median histogram, the median becoming the one of all of the samples so far
+	void MergeMedianHistogram(cv::Mat_<unsigned int>& histogram, int& hist_count, cv::Mat_<int>& median_state, cv::Mat_<double>& median, const cv::Mat_<unsigned int>& part_histogram,
+		int part_count, const cv::Mat_<double>& first_descriptor, const cv::Mat_<double>& last_descriptor, int num_bins, double min_val, double max_val);
 	void ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<double>& median, int num_bins, double min_val, double max_val);
 	
 	// The linear SVR regressors
@@ -228,9 +340,9 @@ private:
 	SVM_static_lin AU_SVM_static_appearance_lin;
 	SVM_dynamic_lin AU_SVM_dynamic_appearance_lin;
 
-	// The AUs predicted by the model are not always 0 calibrated to a person. That is they don't always predict 0 for a neutral expression
-	// Keeping track of the predictions we can correct for this, by assuming that at least "ratio" of frames are neutral and subtract that value of prediction, only perform the correction after min_frames
-	void UpdatePredictionTrack(Mat_<unsigned int>& prediction_corr_histogram, int& prediction_correction_count, vector<double>& correction, const vector<pair<string, double>>& predictions, double ratio=0.25, int num_bins = 200, double min_val = -3, double max_val = 5, int min_frames = 10);	
+	// All of the above combined into one linear model, built on first use (once the descriptor sizes are known)
+	Fused_lin_predictors AU_fused_predictors;
+
 	void GetSampleHist(Mat_<unsigned int>& prediction_corr_histogram, int prediction_correction_count, vector<double>& sample, double ratio, int num_bins = 200, double min_val = 0, double max_val = 5);	
 
 	vector<std::pair<std::string, vector<double>>> PostprocessPredictions();
@@ -0,0 +1,110 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __FACE_ALIGNER_h_
+#define __FACE_ALIGNER_h_
+
+#include <CLM_core.h>
+
+#include <opencv2/core/core.hpp>
+
+namespace FaceAnalysis
+{
+
+// Similarity alignment of faces to the scaled mean shape (as AlignFace and AlignFaceMask in Face_utils), for use on every frame. The destination
+// shape and the points used for the fit are set up once, the scaled rotation is found in closed form rather than through an SVD, and the masked
+// face is written into the output image in place (so its buffer is reused when the same image is passed in every frame)
+class Face_aligner{
+
+public:
+
+	Face_aligner() : rigid(true), sim_scale(0), out_width(0), out_height(0), dest_mean_x(0), dest_mean_y(0), dest_norm(0)
+	{}
+
+	Face_aligner(const CLMTracker::PDM& pdm, const cv::Mat_<int>& triangulation, bool rigid = true, double sim_scale = 0.6, int out_width = 96, int out_height = 96);
+
+	// A deep copy, so that the copies (e.g. one per thread) do not share the mask buffers
+	Face_aligner(const Face_aligner& other);
+	Face_aligner & operator= (const Face_aligner& other);
+
+	// Prepare for a point distribution model (the triangulation is only needed for masking)
+	void Initialise(const CLMTracker::PDM& pdm, const cv::Mat_<int>& triangulation, bool rigid = true, double sim_scale = 0.6, int out_width = 96, int out_height = 96);
+
+	bool Initialised() const
+	{
+		return dest_norm > 0;
+	}
+
+	// The similarity transform from the image to the aligned face, detected_landmarks as in CLM::detected_landmarks [x1,...,xn,y1,...,yn]
+	cv::Matx23d ComputeWarp(const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global) const;
+
+	// The aligned face only, and the aligned face with everything outside of the face masked out
+	void Align(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global) const;
+	void AlignMask(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global);
+
+private:
+
+	bool rigid;
+	double sim_scale;
+	int out_width;
+	int out_height;
+
+	// The landmarks used for the fit and their mean normalised destination locations (and the size of the destination shape)
+	std::vector<int> fit_indices;
+	std::vector<double> dest_x;
+	std::vector<double> dest_y;
+	double dest_mean_x;
+	double dest_mean_y;
+	double dest_norm;
+
+	cv::Mat_<int> triangulation;
+
+	// The mask follows the face shape, so is recomputed on every frame (in the buffers of the warp)
+	CLMTracker::PAW mask_paw;
+	cv::Mat_<double> mask_landmarks;
+};
+  //===========================================================================
+}
+#endif
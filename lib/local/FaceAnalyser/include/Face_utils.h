@@ -61,7 +61,14 @@ namespace FaceAnalysis
 	void AlignFace(cv::Mat& aligned_face, const cv::Mat& frame, const CLMTracker::CLM& clm_model, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
 	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const CLMTracker::CLM& clm_model, const cv::Mat_<int>& triangulation, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
 
+	// As above, but the masking warp is kept in mask_paw and rebuilt in place on subsequent calls (for per-frame use)
+	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const CLMTracker::CLM& clm_model, CLMTracker::PAW& mask_paw, const cv::Mat_<int>& triangulation, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
+
+	// As above, but from landmarks and pose that are not in a CLM model (e.g. recorded in an earlier pass over a video)
+	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global, const CLMTracker::PDM& pdm, CLMTracker::PAW& mask_paw, const cv::Mat_<int>& triangulation, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
+
 	void Extract_FHOG_descriptor(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size = 8);
+	void Extract_FHOG_descriptor(cv::Mat_<float>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size = 8);
 
 	void Visualise_FHOG(const cv::Mat_<double>& descriptor, int num_rows, int num_cols, cv::Mat& visualisation);
 
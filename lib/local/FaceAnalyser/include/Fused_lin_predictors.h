@@ -0,0 +1,137 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __FUSEDLINPREDICTORS_h_
+#define __FUSEDLINPREDICTORS_h_
+
+#include <vector>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#include "SVR_static_lin_regressors.h"
+#include "SVR_dynamic_lin_regressors.h"
+#include "SVM_static_lin.h"
+#include "SVM_dynamic_lin.h"
+
+namespace FaceAnalysis
+{
+
+// All of the linear AU predictors (static and dynamic SVRs and SVMs) combined into a single weight matrix, so that all AUs are predicted with
+// one matrix product per frame (or per batch of frames). The means are folded into the biases and the running median of the dynamic
+// predictors becomes a correction vector that is only recomputed when the median changes
+class Fused_lin_predictors{
+
+public:
+
+	Fused_lin_predictors() : num_hog(0), num_geom(0)
+	{}
+
+	// Combine the separately read predictors, for HOG and geometry descriptors of the given lengths
+	void Build(const SVR_static_lin_regressors& svr_static, const SVR_dynamic_lin_regressors& svr_dynamic, const SVM_static_lin& svm_static, 
+		const SVM_dynamic_lin& svm_dynamic, int num_hog, int num_geom);
+
+	// Has the model been built for descriptors of these lengths
+	bool Built(int num_hog, int num_geom) const
+	{
+		return !weights.empty() && this->num_hog == num_hog && this->num_geom == num_geom;
+	}
+
+	// Every row of the descriptors is a frame, the corresponding rows of the predictions are in the order of the AU names below
+	// (the classification ones are already converted to the class labels)
+	void Predict(cv::Mat_<double>& predictions_reg, cv::Mat_<double>& predictions_class, const cv::Mat_<double>& hog_descriptors, const cv::Mat_<double>& geom_descriptors,
+		const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median);
+
+	// The same in two steps, first the raw linear responses of every frame (does not depend on the median, and as it does not change
+	// the model it can be called from several threads), then the predictions from those once the median is known
+	void Respond(cv::Mat_<float>& responses, const cv::Mat_<double>& hog_descriptors, const cv::Mat_<double>& geom_descriptors) const;
+	void Predict(cv::Mat_<double>& predictions_reg, cv::Mat_<double>& predictions_class, const cv::Mat_<float>& responses, 
+		const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median);
+
+	const std::vector<std::string>& GetAURegNames() const
+	{
+		return AU_names_reg;
+	}
+
+	const std::vector<std::string>& GetAUClassNames() const
+	{
+		return AU_names_class;
+	}
+
+private:
+
+	// Add the columns of one of the predictors, returns the column after the last added one
+	int AddPredictor(const cv::Mat_<double>& means, const cv::Mat_<double>& support_vectors, const cv::Mat_<double>& biases, int start_col, bool ignore_geom);
+
+	// Recompute the correction of the dynamic predictors if the running median has changed
+	void UpdateMedianCorrection(const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median);
+
+	int num_hog;
+	int num_geom;
+
+	std::vector<std::string> AU_names_reg;
+	std::vector<std::string> AU_names_class;
+
+	// Columns are the static regressors, static classifiers, dynamic regressors and dynamic classifiers (so that the dynamic ones are together)
+	cv::Mat_<float> weights;
+	cv::Mat_<float> biases;
+
+	int num_reg_static;
+	int num_class_static;
+	int num_reg_dynamic;
+	int num_class_dynamic;
+
+	std::vector<double> pos_classes;
+	std::vector<double> neg_classes;
+
+	// The running median the correction of the dynamic predictors was computed for
+	cv::Mat_<double> hog_median_used;
+	cv::Mat_<double> geom_median_used;
+	cv::Mat_<float> median_correction;
+
+};
+  //===========================================================================
+}
+#endif
@@ -71,11 +71,27 @@ public:
 	// Reading in the model (or adding to it)
 	void Read(std::ifstream& stream, const std::vector<std::string>& au_names);
 
-	std::vector<std::string> GetAUNames()
+	const std::vector<std::string>& GetAUNames() const
 	{
 		return AU_names;
 	}
 
+	// The model itself (each column of the support vectors is a predictor), used when combining it with the other predictors
+	const cv::Mat_<double>& GetMeans() const
+	{
+		return means;
+	}
+
+	const cv::Mat_<double>& GetSupportVectors() const
+	{
+		return support_vectors;
+	}
+
+	const cv::Mat_<double>& GetBiases() const
+	{
+		return biases;
+	}
+
 private:
 
 	// The names of Action Units this model is responsible for
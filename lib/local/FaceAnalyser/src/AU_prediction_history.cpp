@@ -0,0 +1,309 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AU_prediction_history.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cassert>
+#include <iostream>
+
+using namespace FaceAnalysis;
+
+AU_prediction_history::AU_prediction_history(int chunk_size) : chunk_size(chunk_size), num_frames(0), first_resident(0), max_resident_chunks(0), spill_end(0), spill_failed(false)
+{
+}
+
+AU_prediction_history::~AU_prediction_history()
+{
+	if(spill_file.is_open())
+	{
+		spill_file.close();
+		std::remove(spill_location.c_str());
+	}
+}
+
+void AU_prediction_history::SetSpillFile(const std::string& location, int max_resident_chunks)
+{
+	if(spill_file.is_open())
+	{
+		spill_file.close();
+		std::remove(spill_location.c_str());
+	}
+
+	this->spill_location = location;
+	this->max_resident_chunks = std::max(max_resident_chunks, 1);
+	this->spill_end = 0;
+	this->spill_failed = false;
+}
+
+// Sort the AU names and work out where each of the incoming predictions goes
+static void SetColumns(const std::vector<std::pair<std::string, double>>& predictions, std::vector<std::string>& names, std::vector<int>& columns, int first_column)
+{
+	names.clear();
+	for(size_t i = 0; i < predictions.size(); ++i)
+	{
+		names.push_back(predictions[i].first);
+	}
+	std::sort(names.begin(), names.end());
+
+	columns.resize(predictions.size());
+	for(size_t i = 0; i < predictions.size(); ++i)
+	{
+		columns[i] = first_column + (int)(std::lower_bound(names.begin(), names.end(), predictions[i].first) - names.begin());
+	}
+}
+
+void AU_prediction_history::AddFrame(const std::vector<std::pair<std::string, double>>& predictions_reg, const std::vector<std::pair<std::string, double>>& predictions_class,
+		double timestamp, double confidence, bool success)
+{
+	if(num_frames == 0)
+	{
+		SetColumns(predictions_reg, AU_names_reg, column_reg, 0);
+		SetColumns(predictions_class, AU_names_class, column_class, (int)predictions_reg.size());
+	}
+
+	assert(predictions_reg.size() == column_reg.size() && predictions_class.size() == column_class.size());
+
+	int frame = num_frames % chunk_size;
+	if(frame == 0)
+	{
+		Chunk chunk;
+		chunk.values = cv::Mat_<float>((int)(column_reg.size() + column_class.size()), chunk_size, 0.0f);
+		chunk.frame_info = cv::Mat_<double>(3, chunk_size, 0.0);
+		chunk.num_frames = 0;
+		chunk.spilled = false;
+		chunk.spill_offset = 0;
+		chunks.push_back(chunk);
+	}
+
+	Chunk& chunk = chunks.back();
+
+	for(size_t i = 0; i < predictions_reg.size(); ++i)
+	{
+		chunk.values(column_reg[i], frame) = success ? (float)predictions_reg[i].second : -100.0f;
+	}
+	for(size_t i = 0; i < predictions_class.size(); ++i)
+	{
+		chunk.values(column_class[i], frame) = success ? (float)predictions_class[i].second : -100.0f;
+	}
+
+	chunk.frame_info(TIMESTAMP, frame) = timestamp;
+	chunk.frame_info(CONFIDENCE, frame) = confidence;
+	chunk.frame_info(SUCCESS, frame) = success ? 1.0 : 0.0;
+
+	chunk.num_frames++;
+	num_frames++;
+
+	// Once a chunk is complete move the oldest ones out of memory if there are too many of them
+	if(chunk.num_frames == chunk_size && !spill_location.empty() && !spill_failed)
+	{
+		while(chunks.size() - first_resident > (size_t)max_resident_chunks && SpillChunk(chunks[first_resident]))
+		{
+			first_resident++;
+		}
+	}
+}
+
+bool AU_prediction_history::SpillChunk(Chunk& chunk)
+{
+	if(!spill_file.is_open())
+	{
+		spill_file.open(spill_location, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		spill_end = 0;
+
+		if(!spill_file.is_open())
+		{
+			// Can't spill, so just keep everything in memory
+			std::cout << "Could not open the AU prediction spill file " << spill_location << ", keeping the predictions in memory" << std::endl;
+			spill_location.clear();
+			return false;
+		}
+	}
+
+	spill_file.clear();
+	spill_file.seekp(spill_end);
+	if(spill_file)
+	{
+		spill_file.write((const char*)chunk.values.ptr(), chunk.values.total() * sizeof(float));
+	}
+	if(spill_file)
+	{
+		spill_file.write((const char*)chunk.frame_info.ptr(), chunk.frame_info.total() * sizeof(double));
+	}
+	if(spill_file)
+	{
+		spill_file.flush();
+	}
+
+	std::streamoff chunk_end = spill_file ? (std::streamoff)spill_file.tellp() : -1;
+
+	// A partial write (e.g. a full disk) would leave a corrupt chunk in the file, so keep it in memory instead (the chunks spilled before are still fine)
+	if(!spill_file || chunk_end < 0)
+	{
+		std::cout << "Could not write to the AU prediction spill file " << spill_location << ", keeping the remaining predictions in memory" << std::endl;
+		spill_file.clear();
+		spill_failed = true;
+		return false;
+	}
+
+	chunk.spill_offset = spill_end;
+	chunk.spilled = true;
+	spill_end = chunk_end;
+
+	// Release the memory, but keep the sizes around
+	chunk.values.release();
+	chunk.frame_info.release();
+
+	return true;
+}
+
+void AU_prediction_history::Clear()
+{
+	chunks.clear();
+	num_frames = 0;
+	first_resident = 0;
+
+	AU_names_reg.clear();
+	AU_names_class.clear();
+	column_reg.clear();
+	column_class.clear();
+
+	// The spill file gets overwritten from the start
+	spill_end = 0;
+	spill_failed = false;
+}
+
+void AU_prediction_history::ReadChunk(int chunk_ind, cv::Mat_<float>& values, cv::Mat_<double>& frame_info)
+{
+	const Chunk& chunk = chunks[chunk_ind];
+
+	int num_cols = (int)(column_reg.size() + column_class.size());
+
+	if(!chunk.spilled)
+	{
+		values = num_cols > 0 ? chunk.values.colRange(0, chunk.num_frames) : cv::Mat_<float>();
+		frame_info = chunk.frame_info.colRange(0, chunk.num_frames);
+	}
+	else
+	{
+		cv::Mat_<float> values_all(num_cols, chunk_size);
+		cv::Mat_<double> frame_info_all(3, chunk_size);
+
+		spill_file.clear();
+		spill_file.seekg(chunk.spill_offset);
+		spill_file.read((char*)values_all.ptr(), values_all.total() * sizeof(float));
+		spill_file.read((char*)frame_info_all.ptr(), frame_info_all.total() * sizeof(double));
+
+		if(!spill_file)
+		{
+			std::cout << "Could not read chunk " << chunk_ind << " back from the AU prediction spill file " << spill_location << std::endl;
+		}
+
+		values = num_cols > 0 ? values_all.colRange(0, chunk.num_frames) : cv::Mat_<float>();
+		frame_info = frame_info_all.colRange(0, chunk.num_frames);
+	}
+}
+
+void AU_prediction_history::ReadChunkRow(const Chunk& chunk, int row, bool frame_info_row, void* data)
+{
+	size_t element_size = frame_info_row ? sizeof(double) : sizeof(float);
+
+	if(!chunk.spilled)
+	{
+		const uchar* source = frame_info_row ? chunk.frame_info.ptr(row) : chunk.values.ptr(row);
+		std::copy(source, source + chunk.num_frames * element_size, (uchar*)data);
+	}
+	else
+	{
+		std::streamoff offset = chunk.spill_offset;
+		if(frame_info_row)
+		{
+			offset += (std::streamoff)(column_reg.size() + column_class.size()) * chunk_size * sizeof(float);
+		}
+		offset += (std::streamoff)row * chunk_size * element_size;
+
+		spill_file.clear();
+		spill_file.seekg(offset);
+		spill_file.read((char*)data, chunk.num_frames * element_size);
+
+		if(!spill_file)
+		{
+			std::cout << "Could not read back from the AU prediction spill file " << spill_location << std::endl;
+		}
+	}
+}
+
+double AU_prediction_history::SuccessfulQuantile(int column, double ratio)
+{
+	std::vector<float> successful_values;
+	std::vector<float> column_values(chunk_size);
+	std::vector<double> successes(chunk_size);
+
+	for(size_t c = 0; c < chunks.size(); ++c)
+	{
+		ReadChunkRow(chunks[c], column, false, &column_values[0]);
+		ReadChunkRow(chunks[c], SUCCESS, true, &successes[0]);
+
+		for(int frame = 0; frame < chunks[c].num_frames; ++frame)
+		{
+			if(successes[frame] != 0)
+			{
+				successful_values.push_back(column_values[frame]);
+			}
+		}
+	}
+
+	if(successful_values.empty())
+	{
+		return 0.0;
+	}
+
+	// Only the one value is needed, so no need to sort all of them
+	auto quantile = successful_values.begin() + (int)(successful_values.size() * ratio);
+	std::nth_element(successful_values.begin(), quantile, successful_values.end());
+
+	return *quantile;
+}
@@ -0,0 +1,145 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AU_stream_postprocessor.h"
+
+#include "FaceAnalyser.h"
+
+using namespace FaceAnalysis;
+
+void AU_stream_postprocessor::AddFrame(const std::vector<std::pair<std::string, double>>& predictions_reg, const std::vector<std::pair<std::string, double>>& predictions_class,
+		double timestamp, double confidence, bool success)
+{
+	if(AU_names_reg.empty() && AU_names_class.empty())
+	{
+		for(size_t i = 0; i < predictions_reg.size(); ++i)
+		{
+			AU_names_reg.push_back(predictions_reg[i].first);
+		}
+		for(size_t i = 0; i < predictions_class.size(); ++i)
+		{
+			AU_names_class.push_back(predictions_class[i].first);
+		}
+	}
+
+	Frame frame;
+	frame.timestamp = timestamp;
+	frame.confidence = confidence;
+	frame.success = success;
+
+	// As in the offline case, the predictions of unsuccessful frames are not meaningful
+	frame.values_reg.resize(predictions_reg.size());
+	for(size_t i = 0; i < predictions_reg.size(); ++i)
+	{
+		frame.values_reg[i] = success ? predictions_reg[i].second : -100.0;
+	}
+	frame.values_class.resize(predictions_class.size());
+	for(size_t i = 0; i < predictions_class.size(); ++i)
+	{
+		frame.values_class[i] = success ? predictions_class[i].second : -100.0;
+	}
+
+	frames.push_back(frame);
+
+	// Only the successfully tracked frames inform the offsets, using the same ratio of neutral frames as the offline correction
+	if(success && !predictions_reg.empty())
+	{
+		FaceAnalyser::UpdatePredictionTrack(histogram, histogram_count, offsets, predictions_reg, 0.25, 200, -3, 5, 10);
+	}
+}
+
+void AU_stream_postprocessor::Flush()
+{
+	releasable = frames.size();
+}
+
+bool AU_stream_postprocessor::NextFrame(std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class,
+		double& timestamp, double& confidence, bool& success)
+{
+	if(frames.empty() || (releasable == 0 && (int)frames.size() <= lookahead))
+	{
+		return false;
+	}
+
+	const Frame& frame = frames.front();
+
+	predictions_reg.resize(AU_names_reg.size());
+	for(size_t i = 0; i < AU_names_reg.size(); ++i)
+	{
+		double offset = i < offsets.size() ? offsets[i] : 0.0;
+		predictions_reg[i] = std::pair<std::string, double>(AU_names_reg[i], FaceAnalyser::CorrectOfflineReg(frame.values_reg[i], offset, frame.success));
+	}
+
+	predictions_class.resize(AU_names_class.size());
+	for(size_t i = 0; i < AU_names_class.size(); ++i)
+	{
+		predictions_class[i] = std::pair<std::string, double>(AU_names_class[i], frame.values_class[i]);
+	}
+
+	timestamp = frame.timestamp;
+	confidence = frame.confidence;
+	success = frame.success;
+
+	frames.pop_front();
+	if(releasable > 0)
+	{
+		releasable--;
+	}
+
+	return true;
+}
+
+void AU_stream_postprocessor::Reset()
+{
+	frames.clear();
+	releasable = 0;
+
+	AU_names_reg.clear();
+	AU_names_class.clear();
+
+	histogram = cv::Mat_<unsigned int>();
+	histogram_count = 0;
+	offsets.clear();
+}
@@ -52,7 +52,10 @@
 #include <stdio.h>
 #include <iostream>
 
+#include <tbb/enumerable_thread_specific.h>
+
 #include <string>
+#include <cstring>
 
 #include <filesystem.hpp>
 #include <filesystem/fstream.hpp>
@@ -85,6 +88,9 @@ FaceAnalyser::FaceAnalyser(vector<Vec3d> orientation_bins, double scale, int wid
 		
 	// Keep track for how many frames have been tracked so far
 	frames_tracking = 0;
+
+	// By default all of the predictions are kept for offline post-processing
+	stream_postprocessing = false;
 	
 	if(orientation_bins.empty())
 	{
@@ -98,6 +104,7 @@ FaceAnalyser::FaceAnalyser(vector<Vec3d> orientation_bins, double scale, int wid
 	hog_hist_sum.resize(head_orientations.size());
 	face_image_hist_sum.resize(head_orientations.size());
 	hog_desc_hist.resize(head_orientations.size());
+	hog_median_state.resize(head_orientations.size());
 	geom_hist_sum = 0;
 	face_image_hist.resize(head_orientations.size());
 
@@ -241,14 +248,18 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 
 	frames_tracking++;
 
-	// First align the face if tracking was successfull
+	// First align the face if tracking was successfull (into the same buffer every frame)
 	if(clm_model.detection_success)
 	{
-		AlignFaceMask(aligned_face, frame, clm_model, triangulation, true, align_scale, align_width, align_height);
+		if(!face_aligner.Initialised())
+		{
+			face_aligner.Initialise(clm_model.pdm, triangulation, true, align_scale, align_width, align_height);
+		}
+		face_aligner.AlignMask(aligned_face, frame, clm_model.detected_landmarks, clm_model.params_global);
 	}
 	else
 	{
-		aligned_face = Mat(align_height, align_width, CV_8UC3);
+		aligned_face.create(align_height, align_width, CV_8UC3);
 		aligned_face.setTo(0);
 	}
 
@@ -293,7 +304,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 	// A small speedup
 	if(frames_tracking % 2 == 1)
 	{
-		UpdateRunningMedian(this->hog_desc_hist[orientation_to_use], this->hog_hist_sum[orientation_to_use], this->hog_desc_median, hog_descriptor, update_median, this->num_bins_hog, this->min_val_hog, this->max_val_hog);
+		UpdateRunningMedian(this->hog_desc_hist[orientation_to_use], this->hog_hist_sum[orientation_to_use], this->hog_median_state[orientation_to_use], this->hog_desc_median, hog_descriptor, update_median, this->num_bins_hog, this->min_val_hog, this->max_val_hog);
 	}	
 	// Geom descriptor and its median
 	geom_descriptor_frame = clm_model.params_local.t();
@@ -311,7 +322,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 	// A small speedup
 	if(frames_tracking % 2 == 1)
 	{
-		UpdateRunningMedian(this->geom_desc_hist, this->geom_hist_sum, this->geom_descriptor_median, geom_descriptor_frame, update_median, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
+		UpdateRunningMedian(this->geom_desc_hist, this->geom_hist_sum, this->geom_median_state, this->geom_descriptor_median, geom_descriptor_frame, update_median, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
 	}
 
 	// First convert the face image to double representation as a row vector
@@ -329,7 +340,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 	}
 
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUs(orientation_to_use, AU_predictions_reg, AU_predictions_class);
 
 	std::vector<std::pair<std::string, double>> AU_predictions_reg_corrected;
 	if(online)
@@ -340,39 +351,16 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 	// Keep only closer to in-plane faces
 	double angle_norm = cv::sqrt(clm_model.params_global[2] * clm_model.params_global[2] + clm_model.params_global[3] * clm_model.params_global[3]);
 
-	// Add the reg predictions to the historic data
-	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
+	// Add the predictions to the historic data, only keeping them if the detection was successful and not too out of plane
+	bool success = clm_model.detection_success && angle_norm < 0.5;
+	if(stream_postprocessing)
 	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful and not too out of plane
-		if(clm_model.detection_success && angle_norm < 0.5)
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(AU_predictions_reg[au].second);
-		}
-		else
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(-100.0);
-		}
+		AU_predictions_stream.AddFrame(AU_predictions_reg, AU_predictions_class, timestamp_seconds, clm_model.detection_certainty, success);
 	}
-	
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
-
-	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
+	else
 	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful and not too out of plane
-		if(clm_model.detection_success && angle_norm < 0.5)
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(AU_predictions_class[au].second);
-		}
-		else
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(-100.0);
-		}
+		AU_predictions_hist.AddFrame(AU_predictions_reg, AU_predictions_class, timestamp_seconds, clm_model.detection_certainty, success);
 	}
-	
 
 	if(online)
 	{
@@ -382,12 +370,6 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const CLMTracker::CLM& clm
 	this->current_time_seconds = timestamp_seconds;
 
 	view_used = orientation_to_use;
-			
-	bool success = clm_model.detection_success && angle_norm < 0.5;
-
-	confidences.push_back(clm_model.detection_certainty);
-	valid_preds.push_back(success);
-	timestamps.push_back(timestamp_seconds);
 }
 
 void FaceAnalyser::GetGeomDescriptor(Mat_<double>& geom_desc)
@@ -405,7 +387,7 @@ void FaceAnalyser::PredictAUs(const cv::Mat_<double>& hog_features, const cv::Ma
 	int orientation_to_use = GetViewId(this->head_orientations, curr_orient);
 
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUs(orientation_to_use, AU_predictions_reg, AU_predictions_class);
 
 	std::vector<std::pair<std::string, double>> AU_predictions_reg_corrected;
 	if(online)
@@ -416,146 +398,460 @@ void FaceAnalyser::PredictAUs(const cv::Mat_<double>& hog_features, const cv::Ma
 	// Keep only closer to in-plane faces
 	double angle_norm = cv::sqrt(clm_model.params_global[2] * clm_model.params_global[2] + clm_model.params_global[3] * clm_model.params_global[3]);
 
-	// Add the reg predictions to the historic data
-	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
+	// Add the predictions to the historic data, only keeping them if the detection was successful and not too out of plane
+	// (there is no timestamp for manually provided features)
+	bool success = clm_model.detection_success && angle_norm < 0.5;
+	if(stream_postprocessing)
+	{
+		AU_predictions_stream.AddFrame(AU_predictions_reg, AU_predictions_class, 0, clm_model.detection_certainty, success);
+	}
+	else
+	{
+		AU_predictions_hist.AddFrame(AU_predictions_reg, AU_predictions_class, 0, clm_model.detection_certainty, success);
+	}
+
+	if(online)
+	{
+		AU_predictions_reg = AU_predictions_reg_corrected;
+	}
+
+	for(size_t i = 0; i < AU_predictions_reg.size(); ++i)
+	{
+		AU_predictions_combined.push_back(AU_predictions_reg[i]);
+	}
+	for(size_t i = 0; i < AU_predictions_class.size(); ++i)
+	{
+		AU_predictions_combined.push_back(AU_predictions_class[i]);
+	}
+
+	view_used = orientation_to_use;
+}
+
+void FaceAnalyser::SetPredictionSpillFile(const std::string& location, int max_resident_chunks)
+{
+	AU_predictions_hist.SetSpillFile(location, max_resident_chunks);
+}
+
+AU_prediction_history& FaceAnalyser::GetAUPredictionHistory()
+{
+	return AU_predictions_hist;
+}
+
+void FaceAnalyser::SetStreamingPostprocessing(int lookahead_frames)
+{
+	stream_postprocessing = true;
+	AU_predictions_stream.SetLookahead(lookahead_frames);
+}
+
+bool FaceAnalyser::GetNextStreamedAUs(std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class,
+	double& timestamp, double& confidence, bool& success)
+{
+	return AU_predictions_stream.NextFrame(predictions_reg, predictions_class, timestamp, confidence, success);
+}
+
+void FaceAnalyser::FlushStreamedAUs()
+{
+	AU_predictions_stream.Flush();
+}
+
+void FaceAnalyser::AddOfflineFrames(const vector<Mat>& frames, const vector<Vec6d>& params_global, const vector<Mat_<double>>& params_local, const vector<bool>& successes,
+	const vector<double>& certainties, const vector<double>& timestamps, const CLMTracker::PDM& pdm, const CLMTracker::ConcurrencyParameters& concurrency,
+	vector<Mat>& aligned_faces, vector<Mat_<double>>& hog_descriptors)
+{
+	PrepareOfflineFrames(pdm);
+
+	// The batch is a part of its own, merged straight away
+	Offline_frames part;
+	AddOfflineFrames(part, frames, params_global, params_local, successes, certainties, timestamps, pdm, concurrency, aligned_faces, hog_descriptors);
+	MergeOfflineFrames(part);
+}
+
+void FaceAnalyser::PrepareOfflineFrames(const CLMTracker::PDM& pdm)
+{
+	if(!face_aligner.Initialised())
 	{
+		face_aligner.Initialise(pdm, triangulation, true, align_scale, align_width, align_height);
+	}
+
+	// The descriptor sizes do not depend on the frame (the HOG of an aligned face, and the shape followed by its parameters)
+	Mat_<double> hog_descriptor;
+	int hog_rows, hog_cols;
+	Mat aligned_blank(align_height, align_width, CV_8UC3);
+	aligned_blank.setTo(0);
+	Extract_FHOG_descriptor(hog_descriptor, aligned_blank, hog_rows, hog_cols);
 
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful and not too out of plane
-		if(clm_model.detection_success && angle_norm < 0.5)
+	int num_geom = pdm.princ_comp.rows + pdm.princ_comp.cols;
+
+	if(!AU_fused_predictors.Built(hog_descriptor.cols, num_geom))
+	{
+		AU_fused_predictors.Build(AU_SVR_static_appearance_lin_regressors, AU_SVR_dynamic_appearance_lin_regressors, AU_SVM_static_appearance_lin, 
+			AU_SVM_dynamic_appearance_lin, hog_descriptor.cols, num_geom);
+	}
+}
+
+// Adds a descriptor to a median histogram, binned as in UpdateRunningMedian (but without keeping track of the median)
+void AddToHistogram(Mat_<unsigned int>& histogram, int& hist_count, const Mat_<double>& descriptor, int num_bins, double min_val, double max_val)
+{
+	double length = max_val - min_val;
+	if(length < 0)
+		length = -length;
+
+	if(histogram.empty())
+	{
+		histogram = Mat_<unsigned int>(descriptor.cols, num_bins, (unsigned int)0);
+	}
+
+	Mat_<double> converted_descriptor = (descriptor - min_val)*((double)num_bins)/(length);
+
+	converted_descriptor.setTo(Scalar(num_bins-1), converted_descriptor > num_bins - 1);
+	converted_descriptor.setTo(Scalar(0), converted_descriptor < 0);
+
+	const double* converted = converted_descriptor.ptr<double>();
+	for(int i = 0; i < histogram.rows; ++i)
+	{
+		histogram(i, (int)converted[i])++;
+	}
+
+	hist_count++;
+}
+
+void FaceAnalyser::AddOfflineFrames(Offline_frames& part, const vector<Mat>& frames, const vector<Vec6d>& params_global, const vector<Mat_<double>>& params_local,
+	const vector<bool>& successes, const vector<double>& certainties, const vector<double>& timestamps, const CLMTracker::PDM& pdm,
+	const CLMTracker::ConcurrencyParameters& concurrency, vector<Mat>& aligned_faces, vector<Mat_<double>>& hog_descriptors) const
+{
+	int num_frames = (int)frames.size();
+
+	aligned_faces.resize(num_frames);
+	hog_descriptors.resize(num_frames);
+
+	if(num_frames == 0)
+	{
+		return;
+	}
+
+	vector<Mat_<double>> geom_descriptors(num_frames);
+	vector<int> hog_rows(num_frames), hog_cols(num_frames);
+
+	// Every thread keeps its own copy of the aligner (for the masking warp)
+	tbb::enumerable_thread_specific<Face_aligner> aligners(face_aligner);
+
+	// Alignment and descriptors of every frame only depend on that frame
+	CLMTracker::ParallelFor(concurrency, 0, num_frames, 1, [&](int i)
+	{
+		if(successes[i])
 		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(AU_predictions_reg[au].second);
+			Mat_<double> landmarks;
+			pdm.CalcShape2D(landmarks, params_local[i], params_global[i]);
+			aligners.local().AlignMask(aligned_faces[i], frames[i], landmarks, params_global[i]);
 		}
 		else
 		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(-100.0);
+			aligned_faces[i] = Mat(align_height, align_width, CV_8UC3);
+			aligned_faces[i].setTo(0);
 		}
+
+		Extract_FHOG_descriptor(hog_descriptors[i], aligned_faces[i], hog_rows[i], hog_cols[i]);
+
+		// Geom descriptor as in AddNextFrame
+		Mat_<double> geom_descriptor = params_local[i].t();
+		if(!successes[i])
+		{
+			geom_descriptor.setTo(0);
+		}
+		Mat_<double> locs = pdm.princ_comp * geom_descriptor.t();
+		cv::hconcat(locs.t(), geom_descriptor, geom_descriptors[i]);
+	});
+
+	// The responses of the whole batch at once, the medians are only applied once all of the frames are in
+	Mat_<double> hog_batch, geom_batch;
+	for(int i = 0; i < num_frames; ++i)
+	{
+		hog_batch.push_back(hog_descriptors[i]);
+		geom_batch.push_back(geom_descriptors[i]);
 	}
+	Mat_<float> responses;
+	AU_fused_predictors.Respond(responses, hog_batch, geom_batch);
+	part.responses.push_back(responses);
 
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
+	if(part.hog_hists.size() != head_orientations.size())
+	{
+		part.hog_hists.resize(head_orientations.size());
+		part.hog_hist_sums.resize(head_orientations.size(), 0);
+		part.hog_first.resize(head_orientations.size());
+		part.hog_last.resize(head_orientations.size());
+	}
+
+	// The last frame of every view in the batch
+	vector<int> last_of_view(head_orientations.size(), -1);
 
-	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
+	for(int i = 0; i < num_frames; ++i)
 	{
+		Vec3d curr_orient(params_global[i][1], params_global[i][2], params_global[i][3]);
+		int view = GetViewId(this->head_orientations, curr_orient);
 
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful and not too out of plane
-		if(clm_model.detection_success && angle_norm < 0.5)
+		if(part.hog_first[view].empty())
 		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(AU_predictions_class[au].second);
+			part.hog_first[view] = hog_descriptors[i].clone();
 		}
-		else
+		last_of_view[view] = i;
+
+		// Only the successfully tracked frames count towards the medians
+		if(successes[i])
 		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(-100.0);
+			AddToHistogram(part.hog_hists[view], part.hog_hist_sums[view], hog_descriptors[i], this->num_bins_hog, this->min_val_hog, this->max_val_hog);
+			AddToHistogram(part.geom_hist, part.geom_hist_sum, geom_descriptors[i], this->num_bins_geom, this->min_val_geom, this->max_val_geom);
 		}
+
+		// Keep only closer to in-plane faces
+		double angle_norm = cv::sqrt(params_global[i][2] * params_global[i][2] + params_global[i][3] * params_global[i][3]);
+
+		part.views.push_back(view);
+		part.successes.push_back(successes[i] && angle_norm < 0.5);
+		part.certainties.push_back(certainties[i]);
+		part.timestamps.push_back(timestamps[i]);
 	}
 
-	if(online)
+	for(size_t view = 0; view < last_of_view.size(); ++view)
 	{
-		AU_predictions_reg = AU_predictions_reg_corrected;
+		if(last_of_view[view] != -1)
+		{
+			part.hog_last[view] = hog_descriptors[last_of_view[view]].clone();
+		}
 	}
 
-	for(size_t i = 0; i < AU_predictions_reg.size(); ++i)
+	if(part.geom_first.empty())
 	{
-		AU_predictions_combined.push_back(AU_predictions_reg[i]);
+		part.geom_first = geom_descriptors.front().clone();
 	}
-	for(size_t i = 0; i < AU_predictions_class.size(); ++i)
+	part.geom_last = geom_descriptors.back().clone();
+
+	// The latest frame
+	part.hog_desc_frame = hog_descriptors.back();
+	part.geom_descriptor_frame = geom_descriptors.back();
+	part.num_hog_rows = hog_rows.back();
+	part.num_hog_cols = hog_cols.back();
+	part.aligned_face = aligned_faces.back().clone();
+	part.time_seconds = timestamps.back();
+}
+
+void FaceAnalyser::MergeOfflineFrames(const Offline_frames& part)
+{
+	int num_frames = (int)part.views.size();
+	if(num_frames == 0)
 	{
-		AU_predictions_combined.push_back(AU_predictions_class[i]);
+		return;
 	}
 
-	view_used = orientation_to_use;
+	offline_responses.insert(offline_responses.end(), part.responses.begin(), part.responses.end());
+	offline_views.insert(offline_views.end(), part.views.begin(), part.views.end());
+	offline_successes.insert(offline_successes.end(), part.successes.begin(), part.successes.end());
+	offline_certainties.insert(offline_certainties.end(), part.certainties.begin(), part.certainties.end());
+	offline_timestamps.insert(offline_timestamps.end(), part.timestamps.begin(), part.timestamps.end());
 
-	bool success = clm_model.detection_success && angle_norm < 0.5;
+	if(offline_hog_medians.size() != hog_desc_hist.size())
+	{
+		offline_hog_medians.resize(hog_desc_hist.size());
+	}
 
-	confidences.push_back(clm_model.detection_certainty);
-	valid_preds.push_back(success);
+	// The medians end up as if the frames of all the parts were added one by one
+	for(size_t view = 0; view < part.hog_hists.size(); ++view)
+	{
+		MergeMedianHistogram(this->hog_desc_hist[view], this->hog_hist_sum[view], this->hog_median_state[view], this->offline_hog_medians[view], part.hog_hists[view],
+			part.hog_hist_sums[view], part.hog_first[view], part.hog_last[view], this->num_bins_hog, this->min_val_hog, this->max_val_hog);
+	}
+	MergeMedianHistogram(this->geom_desc_hist, this->geom_hist_sum, this->geom_median_state, this->geom_descriptor_median, part.geom_hist,
+		part.geom_hist_sum, part.geom_first, part.geom_last, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
+
+	frames_tracking += num_frames;
+
+	// The latest frame
+	hog_desc_frame = part.hog_desc_frame;
+	geom_descriptor_frame = part.geom_descriptor_frame;
+	num_hog_rows = part.num_hog_rows;
+	num_hog_cols = part.num_hog_cols;
+	aligned_face = part.aligned_face.clone();
+	current_time_seconds = part.time_seconds;
 }
 
-void FaceAnalyser::ExtractAllPredictionsOfflineReg(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps)
+void FaceAnalyser::FinishOfflinePrediction()
 {
-	timestamps = this->timestamps;
-	au_predictions.clear();
-	// First extract the valid AU values and put them in a different format
-	vector<vector<double>> aus_valid;
-	vector<double> offsets;
-	confidences = this->confidences;
-	successes = this->valid_preds;
+	int num_frames = (int)offline_views.size();
 
-	for(auto au_iter = AU_predictions_reg_all_hist.begin(); au_iter != AU_predictions_reg_all_hist.end(); ++au_iter)
+	const vector<string>& au_names_reg = AU_fused_predictors.GetAURegNames();
+	const vector<string>& au_names_class = AU_fused_predictors.GetAUClassNames();
+
+	Mat_<double> preds_reg_all(num_frames, (int)au_names_reg.size(), 0.0);
+	Mat_<double> preds_class_all(num_frames, (int)au_names_class.size(), 0.0);
+
+	// A view at a time, the responses of all of the frames of the view are stacked and predicted in one go (so that the median correction
+	// of the predictors is only worked out once for each)
+	for(size_t view = 0; view < offline_hog_medians.size(); ++view)
 	{
-		vector<double> au_good;
-		string au_name = au_iter->first;
-		vector<double> au_vals = au_iter->second;
-		
-		au_predictions.push_back(std::pair<string,vector<double>>(au_name, au_vals));
+		vector<int> view_frames;
+		Mat_<float> view_responses;
 
-		for(size_t frame = 0; frame < au_vals.size(); ++frame)
+		int frame = 0;
+		for(size_t batch = 0; batch < offline_responses.size(); ++batch)
 		{
-
-			if(successes[frame])
+			for(int row = 0; row < offline_responses[batch].rows; ++row, ++frame)
 			{
-				au_good.push_back(au_vals[frame]);
+				if(offline_views[frame] == (int)view)
+				{
+					view_frames.push_back(frame);
+					view_responses.push_back(offline_responses[batch].row(row));
+				}
 			}
+		}
+
+		if(view_frames.empty())
+		{
+			continue;
+		}
+
+		Mat_<double> preds_reg, preds_class;
+		AU_fused_predictors.Predict(preds_reg, preds_class, view_responses, offline_hog_medians[view], geom_descriptor_median);
 
+		for(size_t i = 0; i < view_frames.size(); ++i)
+		{
+			preds_reg.row((int)i).copyTo(preds_reg_all.row(view_frames[i]));
+			preds_class.row((int)i).copyTo(preds_class_all.row(view_frames[i]));
 		}
+	}
 
-		if(!au_good.empty())
+	// Into the history (or the streaming post-processing), as if the frames came one by one
+	for(int frame = 0; frame < num_frames; ++frame)
+	{
+		AU_predictions_reg.clear();
+		AU_predictions_class.clear();
+		for(size_t i = 0; i < au_names_reg.size(); ++i)
+		{
+			AU_predictions_reg.push_back(pair<string, double>(au_names_reg[i], preds_reg_all(frame, (int)i)));
+		}
+		for(size_t i = 0; i < au_names_class.size(); ++i)
 		{
-			std::sort(au_good.begin(), au_good.end());
-			offsets.push_back(au_good.at((int)au_good.size()/4));
+			AU_predictions_class.push_back(pair<string, double>(au_names_class[i], preds_class_all(frame, (int)i)));
+		}
+
+		if(stream_postprocessing)
+		{
+			AU_predictions_stream.AddFrame(AU_predictions_reg, AU_predictions_class, offline_timestamps[frame], offline_certainties[frame], offline_successes[frame]);
 		}
 		else
 		{
-			offsets.push_back(0.0);
+			AU_predictions_hist.AddFrame(AU_predictions_reg, AU_predictions_class, offline_timestamps[frame], offline_certainties[frame], offline_successes[frame]);
 		}
-		aus_valid.push_back(au_good);
 	}
 
-	// sort each of the aus
-	for(size_t au = 0; au < au_predictions.size(); ++au)
+	if(num_frames > 0)
 	{
-		for(size_t frame = 0; frame < au_predictions[au].second.size(); ++frame)
-		{
+		view_used = offline_views.back();
+		hog_desc_median = offline_hog_medians[view_used];
+	}
 
-			if(successes[frame])
-			{
-				double scaling = 1;
+	ClearOfflineFrames();
+}
+
+void FaceAnalyser::ClearOfflineFrames()
+{
+	offline_responses.clear();
+	offline_views.clear();
+	offline_successes.clear();
+	offline_certainties.clear();
+	offline_timestamps.clear();
+	offline_hog_medians.clear();
+}
+
+// The person specific offsets of the regression AUs (assuming at least a quarter of the successfully tracked frames are neutral)
+void FaceAnalyser::ExtractOfflineRegOffsets(vector<double>& offsets)
+{
+	offsets.resize(AU_predictions_hist.GetAURegNames().size());
+	for(size_t au = 0; au < offsets.size(); ++au)
+	{
+		offsets[au] = AU_predictions_hist.SuccessfulQuantile((int)au, 0.25);
+	}
+}
+
+double FaceAnalyser::CorrectOfflineReg(double prediction, double offset, bool success)
+{
+	if(!success)
+	{
+		return 0;
+	}
+
+	double scaling = 1;
 				
-				au_predictions[au].second[frame] = (au_predictions[au].second[frame] - offsets[au]) * scaling;
+	double corrected = (prediction - offset) * scaling;
 				
-				if(au_predictions[au].second[frame] < 0.5)
-					au_predictions[au].second[frame] = 0;
+	if(corrected < 0.5)
+		corrected = 0;
 
-				if(au_predictions[au].second[frame] > 5)
-					au_predictions[au].second[frame] = 5;
+	if(corrected > 5)
+		corrected = 5;
 
-			}
-			else
-			{
-				au_predictions[au].second[frame] = 0;
-			}
-		}
-	}
+	return corrected;
+}
+
+void FaceAnalyser::ExtractAllPredictionsOfflineReg(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps)
+{
+	vector<double> offsets;
+	ExtractOfflineRegOffsets(offsets);
 
+	ExtractAllPredictions(au_predictions, confidences, successes, timestamps, true);
 
+	for(size_t au = 0; au < au_predictions.size(); ++au)
+	{
+		for(size_t frame = 0; frame < au_predictions[au].second.size(); ++frame)
+		{
+			au_predictions[au].second[frame] = CorrectOfflineReg(au_predictions[au].second[frame], offsets[au], successes[frame]);
+		}
+	}
 }
 
 void FaceAnalyser::ExtractAllPredictionsOfflineClass(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps)
 {
-	timestamps = this->timestamps;
+	ExtractAllPredictions(au_predictions, confidences, successes, timestamps, false);
+}
+
+void FaceAnalyser::ExtractAllPredictions(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps, bool reg)
+{
+	const vector<string>& au_names = reg ? AU_predictions_hist.GetAURegNames() : AU_predictions_hist.GetAUClassNames();
+	int first_row = reg ? 0 : (int)AU_predictions_hist.GetAURegNames().size();
+
+	int num_frames = AU_predictions_hist.NumFrames();
+
 	au_predictions.clear();
+	for(size_t au = 0; au < au_names.size(); ++au)
+	{
+		au_predictions.push_back(std::pair<string,vector<double>>(au_names[au], vector<double>()));
+		au_predictions.back().second.reserve(num_frames);
+	}
 
-	for(auto au_iter = AU_predictions_class_all_hist.begin(); au_iter != AU_predictions_class_all_hist.end(); ++au_iter)
+	confidences.clear();
+	successes.clear();
+	timestamps.clear();
+	confidences.reserve(num_frames);
+	successes.reserve(num_frames);
+	timestamps.reserve(num_frames);
+
+	Mat_<float> values;
+	Mat_<double> frame_info;
+	for(int chunk = 0; chunk < AU_predictions_hist.NumChunks(); ++chunk)
 	{
-		string au_name = au_iter->first;
-		vector<double> au_vals = au_iter->second;
-		
-		au_predictions.push_back(std::pair<string,vector<double>>(au_name, au_vals));
+		AU_predictions_hist.ReadChunk(chunk, values, frame_info);
 
-	}
+		for(int frame = 0; frame < frame_info.cols; ++frame)
+		{
+			timestamps.push_back(frame_info(AU_prediction_history::TIMESTAMP, frame));
+			confidences.push_back(frame_info(AU_prediction_history::CONFIDENCE, frame));
+			successes.push_back(frame_info(AU_prediction_history::SUCCESS, frame) != 0);
+		}
 
-	confidences = this->confidences;
-	successes = this->valid_preds;
+		for(size_t au = 0; au < au_names.size(); ++au)
+		{
+			const float* au_values = values[first_row + (int)au];
+			au_predictions[au].second.insert(au_predictions[au].second.end(), au_values, au_values + frame_info.cols);
+		}
+	}
 }
 
 // Reset the models
@@ -570,6 +866,7 @@ void FaceAnalyser::Reset()
 	{
 		this->hog_desc_hist[i] = Mat_<unsigned int>(hog_desc_hist[i].rows, hog_desc_hist[i].cols, (unsigned int)0);
 		this->hog_hist_sum[i] = 0;
+		this->hog_median_state[i] = Mat_<int>();
 
 
 		this->face_image_hist[i] = Mat_<unsigned int>(face_image_hist[i].rows, face_image_hist[i].cols, (unsigned int)0);
@@ -583,6 +880,7 @@ void FaceAnalyser::Reset()
 	this->geom_descriptor_median.setTo(Scalar(0));
 	this->geom_desc_hist = Mat_<unsigned int>(geom_desc_hist.rows, geom_desc_hist.cols, (unsigned int)0);
 	geom_hist_sum = 0;
+	this->geom_median_state = Mat_<int>();
 
 	// Reset the predictions
 	AU_prediction_track = Mat_<double>(AU_prediction_track.rows, AU_prediction_track.cols, 0.0);
@@ -594,27 +892,294 @@ void FaceAnalyser::Reset()
 	AU_predictions_reg.clear();
 	AU_predictions_class.clear();
 	AU_predictions_combined.clear();
-	timestamps.clear();
-	AU_predictions_reg_all_hist.clear();
-	AU_predictions_class_all_hist.clear();
-	confidences.clear();
-	valid_preds.clear();
+	AU_predictions_hist.Clear();
+	AU_predictions_stream.Reset();
+	ClearOfflineFrames();
+
+}
+
+namespace
+{
+	const char subject_state_magic[4] = {'F', 'A', 'S', 'S'};
+	const int subject_state_version = 1;
+
+	// The histograms are mostly empty, so only the non-zero bins of every row are stored (as bin index and count pairs)
+	void WriteSparseHistogram(std::ofstream& stream, const Mat_<unsigned int>& histogram)
+	{
+		int rows = histogram.rows;
+		int cols = histogram.cols;
+		stream.write((char*)&rows, 4);
+		stream.write((char*)&cols, 4);
+
+		vector<int> row_entries;
+		for(int i = 0; i < rows; ++i)
+		{
+			row_entries.clear();
+			const unsigned int* hist_row = histogram[i];
+			for(int j = 0; j < cols; ++j)
+			{
+				if(hist_row[j] > 0)
+				{
+					row_entries.push_back(j);
+					row_entries.push_back((int)hist_row[j]);
+				}
+			}
+			int num_entries = (int)row_entries.size() / 2;
+			stream.write((char*)&num_entries, 4);
+			if(num_entries > 0)
+			{
+				stream.write((char*)&row_entries[0], row_entries.size() * 4);
+			}
+		}
+	}
+
+	bool ReadSparseHistogram(std::ifstream& stream, Mat_<unsigned int>& histogram)
+	{
+		int rows, cols;
+		stream.read((char*)&rows, 4);
+		stream.read((char*)&cols, 4);
+		if(!stream || rows < 0 || cols < 0)
+		{
+			return false;
+		}
+
+		if(rows == 0 || cols == 0)
+		{
+			histogram = Mat_<unsigned int>();
+			return true;
+		}
+
+		histogram = Mat_<unsigned int>(rows, cols, (unsigned int)0);
+
+		vector<int> row_entries;
+		for(int i = 0; i < rows; ++i)
+		{
+			int num_entries;
+			stream.read((char*)&num_entries, 4);
+			if(!stream || num_entries < 0 || num_entries > cols)
+			{
+				return false;
+			}
+			row_entries.resize(num_entries * 2);
+			if(num_entries > 0)
+			{
+				stream.read((char*)&row_entries[0], row_entries.size() * 4);
+			}
+			for(int e = 0; e < num_entries; ++e)
+			{
+				int bin = row_entries[2 * e];
+				if(bin < 0 || bin >= cols)
+				{
+					return false;
+				}
+				histogram(i, bin) = (unsigned int)row_entries[2 * e + 1];
+			}
+		}
+		return (bool)stream;
+	}
+
+	// In the format read by CLMTracker::ReadMatBin
+	void WriteMatBin(std::ofstream& stream, const Mat& mat)
+	{
+		int rows = mat.rows;
+		int cols = mat.cols;
+		int type = mat.type();
+		stream.write((char*)&rows, 4);
+		stream.write((char*)&cols, 4);
+		stream.write((char*)&type, 4);
+
+		Mat continuous = mat.isContinuous() ? mat : mat.clone();
+		stream.write((char*)continuous.data, continuous.rows * continuous.cols * continuous.elemSize());
+	}
+}
+
+bool FaceAnalyser::SaveSubjectState(const std::string& location, const std::string& subject_id, const CLMTracker::CLM& clm_model)
+{
+	std::ofstream state_file(location, ios_base::out | ios_base::binary);
+	if(!state_file.is_open())
+	{
+		cout << "Could not create the subject state file " << location << endl;
+		return false;
+	}
+
+	state_file.write(subject_state_magic, 4);
+	state_file.write((char*)&subject_state_version, 4);
+
+	int id_length = (int)subject_id.size();
+	state_file.write((char*)&id_length, 4);
+	state_file.write(subject_id.c_str(), id_length);
+
+	int num_views = (int)head_orientations.size();
+	state_file.write((char*)&num_views, 4);
+
+	for(int view = 0; view < num_views; ++view)
+	{
+		state_file.write((char*)&hog_hist_sum[view], 4);
+		WriteSparseHistogram(state_file, hog_desc_hist[view]);
+
+		state_file.write((char*)&au_prediction_correction_count[view], 4);
+		WriteSparseHistogram(state_file, au_prediction_correction_histogram[view]);
+
+		int num_scalings = (int)dyn_scaling[view].size();
+		state_file.write((char*)&num_scalings, 4);
+		if(num_scalings > 0)
+		{
+			state_file.write((char*)&dyn_scaling[view][0], num_scalings * sizeof(double));
+		}
+	}
 
+	state_file.write((char*)&geom_hist_sum, 4);
+	WriteSparseHistogram(state_file, geom_desc_hist);
+
+	// The median non-rigid shape seen in this session (the end of the geometry descriptor), or the prior the session started with
+	Mat_<double> shape_prior = clm_model.params_local_prior;
+	int num_modes = clm_model.pdm.NumberOfModes();
+	if(geom_hist_sum > 0 && geom_desc_hist.rows >= num_modes)
+	{
+		Mat_<double> geom_median;
+		ExtractMedian(geom_desc_hist, geom_hist_sum, geom_median, num_bins_geom, min_val_geom, max_val_geom);
+		shape_prior = geom_median.colRange(geom_median.cols - num_modes, geom_median.cols).t();
+	}
+	WriteMatBin(state_file, shape_prior);
+
+	return (bool)state_file;
 }
 
-void FaceAnalyser::UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_count, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val)
+bool FaceAnalyser::LoadSubjectState(const std::string& location, const std::string& subject_id, CLMTracker::CLM& clm_model)
+{
+	std::ifstream state_file(location, ios_base::in | ios_base::binary);
+	if(!state_file.is_open())
+	{
+		return false;
+	}
+
+	char magic[4];
+	int version, id_length;
+	state_file.read(magic, 4);
+	state_file.read((char*)&version, 4);
+	state_file.read((char*)&id_length, 4);
+	if(!state_file || std::memcmp(magic, subject_state_magic, 4) != 0 || version != subject_state_version || id_length < 0 || id_length > 4096)
+	{
+		cout << location << " is not a subject state file" << endl;
+		return false;
+	}
+
+	string stored_id(id_length, ' ');
+	if(id_length > 0)
+	{
+		state_file.read(&stored_id[0], id_length);
+	}
+	if(stored_id != subject_id)
+	{
+		cout << "The subject state in " << location << " belongs to " << stored_id << " rather than " << subject_id << endl;
+		return false;
+	}
+
+	int num_views;
+	state_file.read((char*)&num_views, 4);
+	if(!state_file || num_views != (int)head_orientations.size())
+	{
+		cout << "The subject state in " << location << " was saved with different head orientation bins" << endl;
+		return false;
+	}
+
+	// Read everything first, so that a broken file leaves the current state untouched
+	vector<int> hog_hist_sum_in(num_views), au_correction_count_in(num_views);
+	vector<Mat_<unsigned int> > hog_desc_hist_in(num_views), au_correction_hist_in(num_views);
+	vector<vector<double> > dyn_scaling_in(num_views);
+
+	bool valid = true;
+	for(int view = 0; view < num_views && valid; ++view)
+	{
+		state_file.read((char*)&hog_hist_sum_in[view], 4);
+		valid = ReadSparseHistogram(state_file, hog_desc_hist_in[view]);
+
+		state_file.read((char*)&au_correction_count_in[view], 4);
+		valid = valid && ReadSparseHistogram(state_file, au_correction_hist_in[view]);
+
+		int num_scalings = 0;
+		state_file.read((char*)&num_scalings, 4);
+		valid = valid && state_file && num_scalings >= 0 && num_scalings < 1024;
+		if(valid && num_scalings > 0)
+		{
+			dyn_scaling_in[view].resize(num_scalings);
+			state_file.read((char*)&dyn_scaling_in[view][0], num_scalings * sizeof(double));
+		}
+	}
+
+	int geom_hist_sum_in = 0;
+	Mat_<unsigned int> geom_desc_hist_in;
+	if(valid)
+	{
+		state_file.read((char*)&geom_hist_sum_in, 4);
+		valid = ReadSparseHistogram(state_file, geom_desc_hist_in);
+	}
+
+	Mat shape_prior;
+	if(valid)
+	{
+		CLMTracker::ReadMatBin(state_file, shape_prior);
+		valid = (bool)state_file;
+	}
+
+	if(!valid)
+	{
+		cout << "Could not read the subject state from " << location << endl;
+		return false;
+	}
+
+	hog_hist_sum = hog_hist_sum_in;
+	hog_desc_hist = hog_desc_hist_in;
+	au_prediction_correction_count = au_correction_count_in;
+	au_prediction_correction_histogram = au_correction_hist_in;
+	dyn_scaling = dyn_scaling_in;
+	geom_hist_sum = geom_hist_sum_in;
+	geom_desc_hist = geom_desc_hist_in;
+
+	// The median bins are found again from the restored histograms on the next update
+	for(int view = 0; view < num_views; ++view)
+	{
+		hog_median_state[view] = Mat_<int>();
+	}
+	geom_median_state = Mat_<int>();
+
+	if(shape_prior.rows == clm_model.pdm.NumberOfModes() && shape_prior.type() == CV_64F)
+	{
+		clm_model.params_local_prior = shape_prior;
+	}
+
+	return true;
+}
+
+void FaceAnalyser::UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_count, cv::Mat_<int>& median_state, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val)
 {
 
 	double length = max_val - min_val;
 	if(length < 0)
 		length = -length;
 
-	// The median update
-	if(histogram.empty())
+	// The median update (a restored histogram of a different descriptor size can't be used)
+	if(histogram.empty() || histogram.rows != descriptor.cols)
 	{
 		histogram = Mat_<unsigned int>(descriptor.cols, num_bins, (unsigned int)0);
+		hist_count = 0;
+		median_state = Mat_<int>();
 		median = descriptor.clone();
 	}
+	else if(median.cols != histogram.rows)
+	{
+		// A histogram restored from an earlier session (the values are set from the histogram below)
+		median = descriptor.clone();
+	}
+
+	// Start tracking the median bins if this has not been done for the histogram yet
+	if(median_state.cols != histogram.rows)
+	{
+		InitialiseMedianState(histogram, hist_count, median_state);
+	}
+
+	int* median_bins = median_state[0];
+	int* counts_below = median_state[1];
 
 	if(update)
 	{
@@ -625,43 +1190,148 @@ void FaceAnalyser::UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& h
 		converted_descriptor.setTo(Scalar(num_bins-1), converted_descriptor > num_bins - 1);
 		converted_descriptor.setTo(Scalar(0), converted_descriptor < 0);
 
+		// Update the histogram count
+		hist_count++;
+
+		// The median bin is the first one at which the cumulative count exceeds the cutoff point
+		int cutoff_point = (hist_count + 1)/2;
+
+		const double* converted = converted_descriptor.ptr<double>();
+
 		// Only count the median till a certain number of frame seen?
 		for(int i = 0; i < histogram.rows; ++i)
 		{
-			int index = (int)converted_descriptor.at<double>(i);
-			histogram.at<unsigned int>(i, index)++;
-		}
+			unsigned int* hist_row = histogram[i];
 
-		// Update the histogram count
-		hist_count++;
+			int index = (int)converted[i];
+			hist_row[index]++;
+
+			int bin = median_bins[i];
+			int count_below = counts_below[i];
+
+			if(index < bin)
+			{
+				count_below++;
+			}
+
+			// A single new sample moves the median by at most a few (non-empty) bins, so step it along instead of rescanning the histogram
+			while(bin > 0 && count_below > cutoff_point)
+			{
+				bin--;
+				count_below -= hist_row[bin];
+			}
+			while(bin < num_bins - 1 && count_below + (int)hist_row[bin] <= cutoff_point)
+			{
+				count_below += hist_row[bin];
+				bin++;
+			}
+
+			median_bins[i] = bin;
+			counts_below[i] = count_below;
+		}
 	}
 
 	if(hist_count == 1)
 	{
 		median = descriptor.clone();
 	}
-	else
+	else if(hist_count > 1)
 	{
-		// Recompute the median
-		int cutoff_point = (hist_count + 1)/2;
+		double* median_vals = median.ptr<double>();
 
 		// For each dimension
 		for(int i = 0; i < histogram.rows; ++i)
 		{
-			int cummulative_sum = 0;
-			for(int j = 0; j < histogram.cols; ++j)
+			median_vals[i] = min_val + median_bins[i] * (length/num_bins) + (0.5*(length)/num_bins);
+		}
+	}
+}
+
+void FaceAnalyser::MergeMedianHistogram(cv::Mat_<unsigned int>& histogram, int& hist_count, cv::Mat_<int>& median_state, cv::Mat_<double>& median, const cv::Mat_<unsigned int>& part_histogram,
+	int part_count, const cv::Mat_<double>& first_descriptor, const cv::Mat_<double>& last_descriptor, int num_bins, double min_val, double max_val)
+{
+	// No frames of the histogram in the part
+	if(first_descriptor.empty())
+	{
+		return;
+	}
+
+	double length = max_val - min_val;
+	if(length < 0)
+		length = -length;
+
+	// As in UpdateRunningMedian, a missing (or restored) histogram starts off with the first descriptor as the median
+	if(histogram.empty() || histogram.rows != first_descriptor.cols)
+	{
+		histogram = Mat_<unsigned int>(first_descriptor.cols, num_bins, (unsigned int)0);
+		hist_count = 0;
+		median = first_descriptor.clone();
+	}
+	else if(median.cols != histogram.rows)
+	{
+		median = first_descriptor.clone();
+	}
+
+	if(part_count > 0)
+	{
+		for(int i = 0; i < histogram.rows; ++i)
+		{
+			unsigned int* hist_row = histogram[i];
+			const unsigned int* part_row = part_histogram[i];
+			for(int bin = 0; bin < num_bins; ++bin)
 			{
-				cummulative_sum += histogram.at<unsigned int>(i, j);
-				if(cummulative_sum > cutoff_point)
-				{
-					median.at<double>(i) = min_val + j * (length/num_bins) + (0.5*(length)/num_bins);
-					break;
-				}
+				hist_row[bin] += part_row[bin];
 			}
 		}
+		hist_count += part_count;
+	}
+
+	// The median bins of the merged histogram
+	InitialiseMedianState(histogram, hist_count, median_state);
+
+	if(hist_count == 1)
+	{
+		median = last_descriptor.clone();
+	}
+	else if(hist_count > 1)
+	{
+		double* median_vals = median.ptr<double>();
+		const int* median_bins = median_state[0];
+
+		for(int i = 0; i < histogram.rows; ++i)
+		{
+			median_vals[i] = min_val + median_bins[i] * (length/num_bins) + (0.5*(length)/num_bins);
+		}
 	}
 }
 
+// Finds the median bin of every dimension of the histogram (and the number of samples below it) by scanning the cumulative histogram, 
+// if no bin exceeds the cutoff point (too few samples) the last bin is used, which is where the incremental update would have got to
+void FaceAnalyser::InitialiseMedianState(const cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<int>& median_state)
+{
+	median_state.create(2, histogram.rows);
+
+	int cutoff_point = (hist_count + 1)/2;
+
+	for(int i = 0; i < histogram.rows; ++i)
+	{
+		const unsigned int* hist_row = histogram[i];
+
+		int cummulative_sum = 0;
+		int bin = 0;
+		for(; bin < histogram.cols - 1; ++bin)
+		{
+			if(cummulative_sum + (int)hist_row[bin] > cutoff_point)
+			{
+				break;
+			}
+			cummulative_sum += hist_row[bin];
+		}
+
+		median_state(0, i) = bin;
+		median_state(1, i) = cummulative_sum;
+	}
+}
 
 void FaceAnalyser::ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<double>& median, int num_bins, double min_val, double max_val)
 {
@@ -701,37 +1371,35 @@ void FaceAnalyser::ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_cou
 		}
 	}
 }
-// Apply the current predictors to the currently stored descriptors
-vector<pair<string, double>> FaceAnalyser::PredictCurrentAUs(int view)
+// Apply the current predictors to the currently stored descriptors (all of the regressors and classifiers at once)
+void FaceAnalyser::PredictCurrentAUs(int view, vector<pair<string, double>>& predictions_reg, vector<pair<string, double>>& predictions_class)
 {
-
-	vector<pair<string, double>> predictions;
+	predictions_reg.clear();
+	predictions_class.clear();
 
 	if(!hog_desc_frame.empty())
 	{
-		vector<string> svr_lin_stat_aus;
-		vector<double> svr_lin_stat_preds;
-
-		AU_SVR_static_appearance_lin_regressors.Predict(svr_lin_stat_preds, svr_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svr_lin_stat_preds.size(); ++i)
+		if(!AU_fused_predictors.Built(hog_desc_frame.cols, geom_descriptor_frame.cols))
 		{
-			predictions.push_back(pair<string, double>(svr_lin_stat_aus[i], svr_lin_stat_preds[i]));
+			AU_fused_predictors.Build(AU_SVR_static_appearance_lin_regressors, AU_SVR_dynamic_appearance_lin_regressors, AU_SVM_static_appearance_lin, 
+				AU_SVM_dynamic_appearance_lin, hog_desc_frame.cols, geom_descriptor_frame.cols);
 		}
 
-		vector<string> svr_lin_dyn_aus;
-		vector<double> svr_lin_dyn_preds;
+		Mat_<double> preds_reg, preds_class;
+		AU_fused_predictors.Predict(preds_reg, preds_class, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
 
-		AU_SVR_dynamic_appearance_lin_regressors.Predict(svr_lin_dyn_preds, svr_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame,  this->hog_desc_median, this->geom_descriptor_frame);
-
-		for(size_t i = 0; i < svr_lin_dyn_preds.size(); ++i)
+		const vector<string>& au_names_reg = AU_fused_predictors.GetAURegNames();
+		for(size_t i = 0; i < au_names_reg.size(); ++i)
 		{
-			predictions.push_back(pair<string, double>(svr_lin_dyn_aus[i], svr_lin_dyn_preds[i]));
+			predictions_reg.push_back(pair<string, double>(au_names_reg[i], preds_reg.at<double>(0, (int)i)));
 		}
 
+		const vector<string>& au_names_class = AU_fused_predictors.GetAUClassNames();
+		for(size_t i = 0; i < au_names_class.size(); ++i)
+		{
+			predictions_class.push_back(pair<string, double>(au_names_class[i], preds_class.at<double>(0, (int)i)));
+		}
 	}
-
-	return predictions;
 }
 
 vector<pair<string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift, bool dyn_scale, bool update_track, bool clip_values)
@@ -797,40 +1465,6 @@ vector<pair<string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pai
 	return predictions;
 }
 
-// Apply the current predictors to the currently stored descriptors (classification)
-vector<pair<string, double>> FaceAnalyser::PredictCurrentAUsClass(int view)
-{
-
-	vector<pair<string, double>> predictions;
-
-	if(!hog_desc_frame.empty())
-	{
-		vector<string> svm_lin_stat_aus;
-		vector<double> svm_lin_stat_preds;
-		
-		AU_SVM_static_appearance_lin.Predict(svm_lin_stat_preds, svm_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svm_lin_stat_aus.size(); ++i)
-		{
-			predictions.push_back(pair<string, double>(svm_lin_stat_aus[i], svm_lin_stat_preds[i]));
-		}
-
-		vector<string> svm_lin_dyn_aus;
-		vector<double> svm_lin_dyn_preds;
-
-		AU_SVM_dynamic_appearance_lin.Predict(svm_lin_dyn_preds, svm_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svm_lin_dyn_aus.size(); ++i)
-		{
-			predictions.push_back(pair<string, double>(svm_lin_dyn_aus[i], svm_lin_dyn_preds[i]));
-		}
-		
-	}
-
-	return predictions;
-}
-
-
 Mat_<uchar> FaceAnalyser::GetLatestAlignedFaceGrayscale()
 {
 	return aligned_face_grayscale.clone();
@@ -0,0 +1,266 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Face_aligner.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace FaceAnalysis;
+
+namespace
+{
+	// The more rigid points of the 68 point model (some of the face outline, eyes and nose), as in AlignFace
+	const int rigid_indices_68[24] = {1, 2, 3, 4, 12, 13, 14, 15, 27, 28, 29, 31, 32, 33, 34, 35, 36, 39, 40, 41, 42, 45, 46, 47};
+}
+
+Face_aligner::Face_aligner(const CLMTracker::PDM& pdm, const cv::Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
+{
+	Initialise(pdm, triangulation, rigid, sim_scale, out_width, out_height);
+}
+
+Face_aligner::Face_aligner(const Face_aligner& other) : rigid(other.rigid), sim_scale(other.sim_scale), out_width(other.out_width), out_height(other.out_height),
+	fit_indices(other.fit_indices), dest_x(other.dest_x), dest_y(other.dest_y), dest_mean_x(other.dest_mean_x), dest_mean_y(other.dest_mean_y), dest_norm(other.dest_norm),
+	triangulation(other.triangulation.clone()), mask_paw(other.mask_paw), mask_landmarks(other.mask_landmarks.clone())
+{
+}
+
+Face_aligner & Face_aligner::operator= (const Face_aligner& other)
+{
+	if (this != &other) // protect against invalid self-assignment
+	{
+		rigid = other.rigid;
+		sim_scale = other.sim_scale;
+		out_width = other.out_width;
+		out_height = other.out_height;
+
+		fit_indices = other.fit_indices;
+		dest_x = other.dest_x;
+		dest_y = other.dest_y;
+		dest_mean_x = other.dest_mean_x;
+		dest_mean_y = other.dest_mean_y;
+		dest_norm = other.dest_norm;
+
+		triangulation = other.triangulation.clone();
+		mask_paw = CLMTracker::PAW(other.mask_paw);
+		mask_landmarks = other.mask_landmarks.clone();
+	}
+	return *this;
+}
+
+void Face_aligner::Initialise(const CLMTracker::PDM& pdm, const cv::Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
+{
+	this->rigid = rigid;
+	this->sim_scale = sim_scale;
+	this->out_width = out_width;
+	this->out_height = out_height;
+	this->triangulation = triangulation.clone();
+	this->mask_paw = CLMTracker::PAW();
+
+	int n = pdm.NumberOfPoints();
+
+	fit_indices.clear();
+	if(rigid && n == 68)
+	{
+		fit_indices.assign(rigid_indices_68, rigid_indices_68 + 24);
+	}
+	else
+	{
+		for(int i = 0; i < n; ++i)
+		{
+			fit_indices.push_back(i);
+		}
+	}
+
+	// Will warp to the scaled mean shape (discarding the z component)
+	int num_fit = (int)fit_indices.size();
+	dest_x.resize(num_fit);
+	dest_y.resize(num_fit);
+
+	dest_mean_x = 0;
+	dest_mean_y = 0;
+	for(int i = 0; i < num_fit; ++i)
+	{
+		dest_x[i] = pdm.mean_shape.at<double>(fit_indices[i]) * sim_scale;
+		dest_y[i] = pdm.mean_shape.at<double>(fit_indices[i] + n) * sim_scale;
+		dest_mean_x += dest_x[i];
+		dest_mean_y += dest_y[i];
+	}
+	dest_mean_x /= num_fit;
+	dest_mean_y /= num_fit;
+
+	double dest_sum_sq = 0;
+	for(int i = 0; i < num_fit; ++i)
+	{
+		dest_x[i] -= dest_mean_x;
+		dest_y[i] -= dest_mean_y;
+		dest_sum_sq += dest_x[i] * dest_x[i] + dest_y[i] * dest_y[i];
+	}
+	dest_norm = sqrt(dest_sum_sq);
+}
+
+// The same transform as CLMTracker::AlignShapesWithScale (scaling by the ratio of the shape sizes and the least squares rotation), 
+// but for two dimensions the rotation has a closed form: its angle is given by the sums of dot and cross products of the mean normalised points
+cv::Matx23d Face_aligner::ComputeWarp(const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global) const
+{
+	int n = detected_landmarks.rows / 2;
+	int num_fit = (int)fit_indices.size();
+
+	const double* landmarks_x = detected_landmarks.ptr<double>(0);
+	const double* landmarks_y = detected_landmarks.ptr<double>(n);
+
+	double src_mean_x = 0;
+	double src_mean_y = 0;
+	for(int i = 0; i < num_fit; ++i)
+	{
+		src_mean_x += landmarks_x[fit_indices[i]];
+		src_mean_y += landmarks_y[fit_indices[i]];
+	}
+	src_mean_x /= num_fit;
+	src_mean_y /= num_fit;
+
+	double src_sum_sq = 0;
+	double dot = 0;
+	double cross = 0;
+	for(int i = 0; i < num_fit; ++i)
+	{
+		double x = landmarks_x[fit_indices[i]] - src_mean_x;
+		double y = landmarks_y[fit_indices[i]] - src_mean_y;
+
+		src_sum_sq += x * x + y * y;
+		dot += x * dest_x[i] + y * dest_y[i];
+		cross += x * dest_y[i] - y * dest_x[i];
+	}
+
+	double scale = src_sum_sq > 0 ? dest_norm / sqrt(src_sum_sq) : 1.0;
+	double rot_norm = sqrt(dot * dot + cross * cross);
+	double cos_a = rot_norm > 0 ? dot / rot_norm : 1.0;
+	double sin_a = rot_norm > 0 ? cross / rot_norm : 0.0;
+
+	cv::Matx23d warp_matrix;
+	warp_matrix(0,0) = scale * cos_a;
+	warp_matrix(0,1) = -scale * sin_a;
+	warp_matrix(1,0) = scale * sin_a;
+	warp_matrix(1,1) = scale * cos_a;
+
+	// Make sure centering is correct
+	double tx = params_global[4];
+	double ty = params_global[5];
+
+	warp_matrix(0,2) = -(warp_matrix(0,0) * tx + warp_matrix(0,1) * ty) + out_width/2;
+	warp_matrix(1,2) = -(warp_matrix(1,0) * tx + warp_matrix(1,1) * ty) + out_height/2;
+
+	return warp_matrix;
+}
+
+void Face_aligner::Align(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global) const
+{
+	cv::Matx23d warp_matrix = ComputeWarp(detected_landmarks, params_global);
+	cv::warpAffine(frame, aligned_face, warp_matrix, cv::Size(out_width, out_height), cv::INTER_LINEAR);
+}
+
+void Face_aligner::AlignMask(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global)
+{
+	cv::Matx23d warp_matrix = ComputeWarp(detected_landmarks, params_global);
+	cv::warpAffine(frame, aligned_face, warp_matrix, cv::Size(out_width, out_height), cv::INTER_LINEAR);
+
+	// Move the landmarks to the aligned face as well [x1,...,xn,y1,...,yn]
+	int n = detected_landmarks.rows / 2;
+	mask_landmarks.create(2 * n, 1);
+
+	const double* landmarks_x = detected_landmarks.ptr<double>(0);
+	const double* landmarks_y = detected_landmarks.ptr<double>(n);
+	double* mask_x = mask_landmarks.ptr<double>(0);
+	double* mask_y = mask_landmarks.ptr<double>(n);
+	for(int i = 0; i < n; ++i)
+	{
+		mask_x[i] = warp_matrix(0,0) * landmarks_x[i] + warp_matrix(0,1) * landmarks_y[i] + warp_matrix(0,2);
+		mask_y[i] = warp_matrix(1,0) * landmarks_x[i] + warp_matrix(1,1) * landmarks_y[i] + warp_matrix(1,2);
+	}
+
+	// Move the eyebrows up to include more of upper face
+	if(n == 68)
+	{
+		mask_y[0] -= 15;
+		mask_y[16] -= 15;
+		for(int i = 17; i <= 26; ++i)
+		{
+			mask_y[i] -= 7;
+		}
+	}
+
+	if(mask_paw.triangulation.empty())
+	{
+		mask_paw = CLMTracker::PAW(mask_landmarks, triangulation, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+	}
+	else
+	{
+		mask_paw.SetDestination(mask_landmarks, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+	}
+
+	// Clear the pixels outside of the face in place
+	if(aligned_face.depth() == CV_8U)
+	{
+		int channels = aligned_face.channels();
+		for(int y = 0; y < aligned_face.rows; ++y)
+		{
+			uchar* face_row = aligned_face.ptr<uchar>(y);
+			const uchar* mask_row = mask_paw.pixel_mask.ptr<uchar>(y);
+			for(int x = 0; x < aligned_face.cols; ++x)
+			{
+				if(mask_row[x] == 0)
+				{
+					for(int c = 0; c < channels; ++c)
+					{
+						face_row[x * channels + c] = 0;
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		aligned_face.setTo(0, mask_paw.pixel_mask == 0);
+	}
+}
@@ -160,14 +160,27 @@ namespace FaceAnalysis
 
 	// Aligning a face to a common reference frame
 	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const CLMTracker::CLM& clm_model, const Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
+	{
+		CLMTracker::PAW mask_paw;
+		AlignFaceMask(aligned_face, frame, clm_model, mask_paw, triangulation, rigid, sim_scale, out_width, out_height);
+	}
+
+	// Aligning a face to a common reference frame, reusing the masking warp between calls
+	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const CLMTracker::CLM& clm_model, CLMTracker::PAW& mask_paw, const Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
+	{
+		AlignFaceMask(aligned_face, frame, clm_model.detected_landmarks, clm_model.params_global, clm_model.pdm, mask_paw, triangulation, rigid, sim_scale, out_width, out_height);
+	}
+
+	// As above, but from landmarks and pose that are not in a CLM model (e.g. recorded in an earlier pass over a video)
+	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const cv::Mat_<double>& detected_landmarks, const cv::Vec6d& params_global, const CLMTracker::PDM& pdm, CLMTracker::PAW& mask_paw, const Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
 	{
 		// Will warp to scaled mean shape
-		Mat_<double> similarity_normalised_shape = clm_model.pdm.mean_shape * sim_scale;
+		Mat_<double> similarity_normalised_shape = pdm.mean_shape * sim_scale;
 	
 		// Discard the z component
 		similarity_normalised_shape = similarity_normalised_shape(Rect(0, 0, 1, 2*similarity_normalised_shape.rows/3)).clone();
 
-		Mat_<double> source_landmarks = clm_model.detected_landmarks.reshape(1, 2).t();
+		Mat_<double> source_landmarks = detected_landmarks.reshape(1, 2).t();
 		Mat_<double> destination_landmarks = similarity_normalised_shape.reshape(1, 2).t();
 
 		// Aligning only the more rigid points
@@ -184,8 +197,8 @@ namespace FaceAnalysis
 		warp_matrix(1,0) = scale_rot_matrix(1,0);
 		warp_matrix(1,1) = scale_rot_matrix(1,1);
 
-		double tx = clm_model.params_global[4];
-		double ty = clm_model.params_global[5];
+		double tx = params_global[4];
+		double ty = params_global[5];
 
 		Vec2d T(tx, ty);
 		T = scale_rot_matrix * T;
@@ -199,7 +212,7 @@ namespace FaceAnalysis
 		// Move the destination landmarks there as well
 		Matx22d warp_matrix_2d(warp_matrix(0,0), warp_matrix(0,1), warp_matrix(1,0), warp_matrix(1,1));
 		
-		destination_landmarks = Mat(clm_model.detected_landmarks.reshape(1, 2).t()) * Mat(warp_matrix_2d).t();
+		destination_landmarks = Mat(detected_landmarks.reshape(1, 2).t()) * Mat(warp_matrix_2d).t();
 
 		destination_landmarks.col(0) = destination_landmarks.col(0) + warp_matrix(0,2);
 		destination_landmarks.col(1) = destination_landmarks.col(1) + warp_matrix(1,2);
@@ -221,7 +234,15 @@ namespace FaceAnalysis
 
 		destination_landmarks = Mat(destination_landmarks.t()).reshape(1, 1).t();		
 
-		CLMTracker::PAW paw(destination_landmarks, triangulation, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+		// Only the destination changes from frame to frame, so the warp buffers can be kept unless a different triangulation is used
+		if(mask_paw.triangulation.data != triangulation.data)
+		{
+			mask_paw = CLMTracker::PAW(destination_landmarks, triangulation, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+		}
+		else
+		{
+			mask_paw.SetDestination(destination_landmarks, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+		}
 		
 		vector<Mat> aligned_face_channels(aligned_face.channels());
 		
@@ -229,7 +250,7 @@ namespace FaceAnalysis
 
 		for(size_t i = 0; i < aligned_face_channels.size(); ++i)
 		{
-			aligned_face_channels[i] = aligned_face_channels[i].mul(paw.pixel_mask);
+			aligned_face_channels[i] = aligned_face_channels[i].mul(mask_paw.pixel_mask);
 		}
 
 		cv::merge(aligned_face_channels, aligned_face);
@@ -260,40 +281,229 @@ namespace FaceAnalysis
 		visualisation = dlib::toMat(fhog_vis).clone();
 	}
 
-	// Create a row vector Felzenszwalb HOG descriptor from a given image
-	void Extract_FHOG_descriptor(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
+	// Create a row vector Felzenszwalb HOG descriptor from a given image, computed natively in single precision.
+	// This follows dlib::extract_fhog_features (same orientation bins, bilinear voting and block normalisation) but keeps
+	// the per-row work in flat arrays so the gradient and orientation loops vectorise, and writes straight into the row-major
+	// (row, column, 31 channel) layout the AU predictors expect instead of going through a dlib array of matrices
+	void Extract_FHOG_descriptor(cv::Mat_<float>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
 	{
-		
-		dlib::array2d<dlib::matrix<float,31,1> > hog;
-		if(image.channels() == 1)
+		// Unit vectors used to compute gradient orientation
+		static const float dir_x[9] = {1.0000f, 0.9397f, 0.7660f, 0.5000f, 0.1736f, -0.1736f, -0.5000f, -0.7660f, -0.9397f};
+		static const float dir_y[9] = {0.0000f, 0.3420f, 0.6428f, 0.8660f, 0.9848f, 0.9848f, 0.8660f, 0.6428f, 0.3420f};
+
+		const int cells_nr = (int)((double)image.rows/(double)cell_size + 0.5);
+		const int cells_nc = (int)((double)image.cols/(double)cell_size + 0.5);
+
+		num_rows = std::max(cells_nr - 2, 0);
+		num_cols = std::max(cells_nc - 2, 0);
+
+		if(num_rows == 0 || num_cols == 0)
 		{
-			dlib::cv_image<uchar> dlib_warped_img(image);
-			dlib::extract_fhog_features(dlib_warped_img, hog, cell_size);
+			num_rows = 0;
+			num_cols = 0;
+			descriptor = Mat_<float>();
+			return;
 		}
-		else
+
+		// Orientation histograms with a cell of padding all the way round, laid out as (row, column, 18 orientations)
+		const int hist_nc = cells_nc + 2;
+		vector<float> hist((cells_nr + 2) * hist_nc * 18, 0.0f);
+
+		const int visible_nr = std::min(cells_nr * cell_size, image.rows) - 1;
+		const int visible_nc = std::min(cells_nc * cell_size, image.cols) - 1;
+
+		// The horizontal interpolation only depends on the column, so work it out once
+		vector<int> ixp(visible_nc);
+		vector<float> vx0(visible_nc);
+		for(int x = 1; x < visible_nc; ++x)
 		{
-			dlib::cv_image<dlib::bgr_pixel> dlib_warped_img(image);
-			dlib::extract_fhog_features(dlib_warped_img, hog, cell_size);
+			float xp = ((float)x + 0.5f) / (float)cell_size + 0.5f;
+			ixp[x] = (int)xp;
+			vx0[x] = xp - (float)ixp[x];
 		}
 
-		// Convert to a usable format
-		num_cols = hog.nc();
-		num_rows = hog.nr();
+		vector<float> grad_x(visible_nc), grad_y(visible_nc), grad_len(visible_nc);
+		vector<float> best_dot(visible_nc);
+		vector<int> best_o(visible_nc);
 
-		descriptor = Mat_<double>(1, num_cols * num_rows * 31);
-		cv::MatIterator_<double> descriptor_it = descriptor.begin();
-		for(int y = 0; y < num_cols; ++y)
+		const int channels = image.channels();
+
+		for(int y = 1; y < visible_nr; ++y)
 		{
-			for(int x = 0; x < num_rows; ++x)
+			const uchar* top = image.ptr<uchar>(y - 1);
+			const uchar* mid = image.ptr<uchar>(y);
+			const uchar* bottom = image.ptr<uchar>(y + 1);
+
+			// Gradients, for colour images taking the channel with the strongest gradient (BGR order, ties go to the later channel)
+			if(channels == 1)
 			{
-				for(unsigned int o = 0; o < 31; ++o)
+				for(int x = 1; x < visible_nc; ++x)
+				{
+					int gx = (int)mid[x + 1] - (int)mid[x - 1];
+					int gy = (int)bottom[x] - (int)top[x];
+					grad_x[x] = (float)gx;
+					grad_y[x] = (float)gy;
+					grad_len[x] = (float)(gx * gx + gy * gy);
+				}
+			}
+			else
+			{
+				for(int x = 1; x < visible_nc; ++x)
+				{
+					int gx_r = (int)mid[(x + 1) * channels + 2] - (int)mid[(x - 1) * channels + 2];
+					int gy_r = (int)bottom[x * channels + 2] - (int)top[x * channels + 2];
+					int gx_g = (int)mid[(x + 1) * channels + 1] - (int)mid[(x - 1) * channels + 1];
+					int gy_g = (int)bottom[x * channels + 1] - (int)top[x * channels + 1];
+					int gx_b = (int)mid[(x + 1) * channels] - (int)mid[(x - 1) * channels];
+					int gy_b = (int)bottom[x * channels] - (int)top[x * channels];
+
+					int len_r = gx_r * gx_r + gy_r * gy_r;
+					int len_g = gx_g * gx_g + gy_g * gy_g;
+					int len_b = gx_b * gx_b + gy_b * gy_b;
+
+					bool red = len_r > len_g;
+					int gx = red ? gx_r : gx_g;
+					int gy = red ? gy_r : gy_g;
+					int len = red ? len_r : len_g;
+
+					bool blue = !(len > len_b);
+					grad_x[x] = (float)(blue ? gx_b : gx);
+					grad_y[x] = (float)(blue ? gy_b : gy);
+					grad_len[x] = (float)(blue ? len_b : len);
+				}
+			}
+
+			// Snap each gradient to one of 18 orientations
+			for(int x = 1; x < visible_nc; ++x)
+			{
+				best_dot[x] = 0.0f;
+				best_o[x] = 0;
+			}
+			for(int o = 0; o < 9; ++o)
+			{
+				for(int x = 1; x < visible_nc; ++x)
+				{
+					float dot = grad_x[x] * dir_x[o] + grad_y[x] * dir_y[o];
+					float best = best_dot[x];
+					int bin = best_o[x];
+					if(dot > best) { best = dot; bin = o; }
+					if(-dot > best) { best = -dot; bin = o + 9; }
+					best_dot[x] = best;
+					best_o[x] = bin;
+				}
+			}
+
+			// Vote with the gradient magnitude into the four surrounding cells
+			const double yp = ((double)y + 0.5) / (double)cell_size - 0.5;
+			const int iyp = (int)std::floor(yp);
+			const float vy0 = (float)(yp - iyp);
+			const float vy1 = 1.0f - vy0;
+
+			float* hist_top = &hist[(iyp + 1) * hist_nc * 18];
+			float* hist_bottom = hist_top + hist_nc * 18;
+
+			for(int x = 1; x < visible_nc; ++x)
+			{
+				const float v = std::sqrt(grad_len[x]);
+				const float v_x0 = vx0[x] * v;
+				const float v_x1 = (1.0f - vx0[x]) * v;
+				const int left = ixp[x] * 18 + best_o[x];
+				const int right = left + 18;
+
+				hist_top[left] += vy1 * v_x1;
+				hist_bottom[left] += vy0 * v_x1;
+				hist_top[right] += vy1 * v_x0;
+				hist_bottom[right] += vy0 * v_x0;
+			}
+		}
+
+		// Energy in each cell, summed over the contrast insensitive orientations
+		vector<float> norm(cells_nr * cells_nc);
+		for(int r = 0; r < cells_nr; ++r)
+		{
+			for(int c = 0; c < cells_nc; ++c)
+			{
+				const float* h = &hist[((r + 1) * hist_nc + c + 1) * 18];
+				float energy = 0.0f;
+				for(int o = 0; o < 9; ++o)
+				{
+					float s = h[o] + h[o + 9];
+					energy += s * s;
+				}
+				norm[r * cells_nc + c] = energy;
+			}
+		}
+
+		descriptor = Mat_<float>(1, num_rows * num_cols * 31);
+		float* descriptor_it = descriptor.ptr<float>(0);
+
+		for(int y = 0; y < num_rows; ++y)
+		{
+			const float* n0 = &norm[y * cells_nc];
+			const float* n1 = n0 + cells_nc;
+			const float* n2 = n1 + cells_nc;
+
+			for(int x = 0; x < num_cols; ++x)
+			{
+				// Normalisation factors from the four 2x2 blocks the cell belongs to
+				float nn[4], n[4];
+				nn[0] = n1[x+1] + n0[x+1] + n1[x] + n0[x];
+				nn[1] = n1[x+2] + n0[x+2] + n1[x+1] + n0[x+1];
+				nn[2] = n2[x+1] + n1[x+1] + n2[x] + n1[x];
+				nn[3] = n2[x+2] + n1[x+2] + n2[x+1] + n1[x+1];
+				for(int j = 0; j < 4; ++j)
+				{
+					nn[j] = 0.2f * std::sqrt(nn[j] + 0.0001f);
+					n[j] = 0.1f / nn[j];
+				}
+
+				const float* h = &hist[((y + 2) * hist_nc + x + 2) * 18];
+				float t[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+				// Contrast sensitive features
+				for(int o = 0; o < 18; ++o)
 				{
-					*descriptor_it++ = (double)hog[y][x](o);
+					float sum = 0.0f;
+					for(int j = 0; j < 4; ++j)
+					{
+						float h_j = std::min(h[o], nn[j]) * n[j];
+						t[j] += h_j;
+						sum += h_j;
+					}
+					descriptor_it[o] = sum;
 				}
+
+				// Contrast insensitive features
+				for(int o = 0; o < 9; ++o)
+				{
+					float h_o = h[o] + h[o + 9];
+					float sum = 0.0f;
+					for(int j = 0; j < 4; ++j)
+					{
+						sum += std::min(h_o, nn[j]) * n[j];
+					}
+					descriptor_it[18 + o] = sum;
+				}
+
+				// Texture features, in the order dlib leaves its four normalisation lanes in
+				static const int texture_lane[4] = {3, 1, 2, 0};
+				for(int j = 0; j < 4; ++j)
+				{
+					descriptor_it[27 + j] = t[texture_lane[j]] * (float)(2 * 0.2357);
+				}
+
+				descriptor_it += 31;
 			}
 		}
 	}
 
+	void Extract_FHOG_descriptor(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
+	{
+		Mat_<float> descriptor_float;
+		Extract_FHOG_descriptor(descriptor_float, image, num_rows, num_cols, cell_size);
+		descriptor_float.convertTo(descriptor, CV_64F);
+	}
+
 	// Extract summary statistics (mean, stdev, min, max) from each dimension of a descriptor, each row is a descriptor
 	void ExtractSummaryStatistics(const cv::Mat_<double>& descriptors, cv::Mat_<double>& sum_stats, bool use_mean, bool use_stdev, bool use_max_min)
 	{
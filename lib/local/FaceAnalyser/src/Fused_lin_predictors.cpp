@@ -0,0 +1,218 @@
+// Copyright (C) 2015, University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite one of the following works:
+//
+//       Tadas Baltrusaitis, Marwa Mahmoud, and Peter Robinson.
+//		 Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Facial Expression Recognition and Analysis Challenge 2015,
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Fused_lin_predictors.h"
+
+#include "CLM_core.h"
+
+#include <algorithm>
+
+using namespace FaceAnalysis;
+
+void Fused_lin_predictors::Build(const SVR_static_lin_regressors& svr_static, const SVR_dynamic_lin_regressors& svr_dynamic, const SVM_static_lin& svm_static, 
+		const SVM_dynamic_lin& svm_dynamic, int num_hog, int num_geom)
+{
+	this->num_hog = num_hog;
+	this->num_geom = num_geom;
+
+	num_reg_static = (int)svr_static.GetAUNames().size();
+	num_class_static = (int)svm_static.GetAUNames().size();
+	num_reg_dynamic = (int)svr_dynamic.GetAUNames().size();
+	num_class_dynamic = (int)svm_dynamic.GetAUNames().size();
+
+	int num_cols = num_reg_static + num_class_static + num_reg_dynamic + num_class_dynamic;
+
+	weights = cv::Mat_<float>(num_hog + num_geom, num_cols, 0.0f);
+	biases = cv::Mat_<float>(1, num_cols, 0.0f);
+
+	int col = 0;
+	if(num_reg_static > 0)
+		col = AddPredictor(svr_static.GetMeans(), svr_static.GetSupportVectors(), svr_static.GetBiases(), col, false);
+	if(num_class_static > 0)
+		col = AddPredictor(svm_static.GetMeans(), svm_static.GetSupportVectors(), svm_static.GetBiases(), col, false);
+
+	// The dynamic regressors are given the geometry descriptor of the frame itself as the running median of geometry, so the geometry part
+	// of their input is always zero (apart from the means, which are in the bias)
+	if(num_reg_dynamic > 0)
+		col = AddPredictor(svr_dynamic.GetMeans(), svr_dynamic.GetSupportVectors(), svr_dynamic.GetBiases(), col, true);
+	if(num_class_dynamic > 0)
+		col = AddPredictor(svm_dynamic.GetMeans(), svm_dynamic.GetSupportVectors(), svm_dynamic.GetBiases(), col, false);
+
+	AU_names_reg = svr_static.GetAUNames();
+	AU_names_reg.insert(AU_names_reg.end(), svr_dynamic.GetAUNames().begin(), svr_dynamic.GetAUNames().end());
+
+	AU_names_class = svm_static.GetAUNames();
+	AU_names_class.insert(AU_names_class.end(), svm_dynamic.GetAUNames().begin(), svm_dynamic.GetAUNames().end());
+
+	pos_classes = svm_static.GetPosClasses();
+	pos_classes.insert(pos_classes.end(), svm_dynamic.GetPosClasses().begin(), svm_dynamic.GetPosClasses().end());
+
+	neg_classes = svm_static.GetNegClasses();
+	neg_classes.insert(neg_classes.end(), svm_dynamic.GetNegClasses().begin(), svm_dynamic.GetNegClasses().end());
+
+	// Force the correction to be recomputed
+	hog_median_used = cv::Mat_<double>();
+	geom_median_used = cv::Mat_<double>();
+	median_correction = cv::Mat_<float>(1, num_reg_dynamic + num_class_dynamic, 0.0f);
+}
+
+int Fused_lin_predictors::AddPredictor(const cv::Mat_<double>& means, const cv::Mat_<double>& support_vectors, const cv::Mat_<double>& biases, int start_col, bool ignore_geom)
+{
+	int num_cols = support_vectors.cols;
+
+	// (x - means) * sv + b = x * sv + (b - means * sv)
+	cv::Mat_<double> folded_biases = biases - means * support_vectors;
+	cv::Mat_<float>(folded_biases).copyTo(this->biases.colRange(start_col, start_col + num_cols));
+
+	// The predictors either work on the HOG descriptor alone or on the HOG followed by the geometry descriptor
+	int num_rows = support_vectors.rows;
+	if(ignore_geom && num_rows > num_hog)
+	{
+		num_rows = num_hog;
+	}
+
+	cv::Mat_<float>(support_vectors.rowRange(0, num_rows)).copyTo(weights(cv::Rect(start_col, 0, num_cols, num_rows)));
+
+	return start_col + num_cols;
+}
+
+void Fused_lin_predictors::UpdateMedianCorrection(const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median)
+{
+	int num_dynamic = num_reg_dynamic + num_class_dynamic;
+
+	if(num_dynamic == 0 || hog_median.empty())
+	{
+		return;
+	}
+
+	// The median is only updated every other frame (and not at all when the face is not tracked)
+	bool hog_same = hog_median.size() == hog_median_used.size() && std::equal(hog_median.begin(), hog_median.end(), hog_median_used.begin());
+	bool geom_same = geom_median.size() == geom_median_used.size() && (geom_median.empty() || std::equal(geom_median.begin(), geom_median.end(), geom_median_used.begin()));
+
+	if(hog_same && geom_same)
+	{
+		return;
+	}
+
+	hog_median.copyTo(hog_median_used);
+	geom_median.copyTo(geom_median_used);
+
+	cv::Mat_<float> median(1, num_hog + num_geom, 0.0f);
+	cv::Mat_<float>(hog_median).copyTo(median.colRange(0, num_hog));
+	if(geom_median.cols == num_geom)
+	{
+		cv::Mat_<float>(geom_median).copyTo(median.colRange(num_hog, num_hog + num_geom));
+	}
+
+	int dynamic_start = num_reg_static + num_class_static;
+	cv::gemm(median, weights.colRange(dynamic_start, dynamic_start + num_dynamic), 1.0, cv::Mat(), 0.0, median_correction);
+}
+
+void Fused_lin_predictors::Predict(cv::Mat_<double>& predictions_reg, cv::Mat_<double>& predictions_class, const cv::Mat_<double>& hog_descriptors, const cv::Mat_<double>& geom_descriptors,
+		const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median)
+{
+	cv::Mat_<float> responses;
+	Respond(responses, hog_descriptors, geom_descriptors);
+
+	Predict(predictions_reg, predictions_class, responses, hog_median, geom_median);
+}
+
+void Fused_lin_predictors::Respond(cv::Mat_<float>& responses, const cv::Mat_<double>& hog_descriptors, const cv::Mat_<double>& geom_descriptors) const
+{
+	int num_frames = hog_descriptors.rows;
+
+	cv::Mat_<float> input(num_frames, num_hog + num_geom, 0.0f);
+	cv::Mat_<float>(hog_descriptors).copyTo(input.colRange(0, num_hog));
+	if(num_geom > 0)
+	{
+		cv::Mat_<float>(geom_descriptors).copyTo(input.colRange(num_hog, num_hog + num_geom));
+	}
+
+	// All of the AUs at once
+	cv::gemm(input, weights, 1.0, cv::Mat(), 0.0, responses);
+}
+
+void Fused_lin_predictors::Predict(cv::Mat_<double>& predictions_reg, cv::Mat_<double>& predictions_class, const cv::Mat_<float>& responses, 
+		const cv::Mat_<double>& hog_median, const cv::Mat_<double>& geom_median)
+{
+	int num_frames = responses.rows;
+
+	UpdateMedianCorrection(hog_median, geom_median);
+
+	predictions_reg.create(num_frames, num_reg_static + num_reg_dynamic);
+	predictions_class.create(num_frames, num_class_static + num_class_dynamic);
+
+	int dynamic_start = num_reg_static + num_class_static;
+
+	for(int frame = 0; frame < num_frames; ++frame)
+	{
+		const float* response = responses[frame];
+		const float* bias = biases[0];
+		const float* correction = median_correction[0];
+
+		double* reg = predictions_reg[frame];
+		double* cls = predictions_class[frame];
+
+		for(int i = 0; i < num_reg_static; ++i)
+		{
+			reg[i] = response[i] + bias[i];
+		}
+		for(int i = 0; i < num_class_static; ++i)
+		{
+			int col = num_reg_static + i;
+			cls[i] = response[col] + bias[col] > 0 ? pos_classes[i] : neg_classes[i];
+		}
+		for(int i = 0; i < num_reg_dynamic; ++i)
+		{
+			int col = dynamic_start + i;
+			reg[num_reg_static + i] = response[col] + bias[col] - correction[i];
+		}
+		for(int i = 0; i < num_class_dynamic; ++i)
+		{
+			int col = dynamic_start + num_reg_dynamic + i;
+			cls[num_class_static + i] = response[col] + bias[col] - correction[num_reg_dynamic + i] > 0 ? pos_classes[num_class_static + i] : neg_classes[num_class_static + i];
+		}
+	}
+}
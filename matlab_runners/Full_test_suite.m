@@ -33,6 +33,9 @@ extract_mpii_gaze_test
 assert(median_error < 9.5)
 cd('../');
 
+%% Threading
+compare_serial_threads;
+
 %% Demos
 cd('Demos');
 run_demo_images;
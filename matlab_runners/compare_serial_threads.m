@@ -0,0 +1,73 @@
+% Checks that the FeatureExtraction outputs do not depend on the threading,
+% by running it on the packaged videos serially and with several threads and
+% comparing the output files byte for byte
+
+exe = '"../Release/FeatureExtraction.exe"';
+
+output = './output_threads/';
+
+if(~exist(output, 'file'))
+    mkdir(output)
+end
+
+in_files = dir('../videos/*.avi');
+
+% the thread count of the parallel run
+num_threads = 4;
+
+runs = {'serial', 'threads'};
+run_args = {' -serial ', sprintf(' -threads %d ', num_threads)};
+
+% the outputs that are compared
+suffixes = {'_fp.txt', '_pose.txt', '_gaze.txt', '.params.txt', '_au.txt'};
+
+for r=1:numel(runs)
+
+    output_run = [output runs{r} '/'];
+
+    if(~exist(output_run, 'file'))
+        mkdir(output_run)
+    end
+
+    command = cat(2, exe, run_args{r});
+
+    % add all videos to single argument list (so as not to load the model anew
+    % for every video)
+    for i=1:numel(in_files)
+
+        inputFile = ['../videos/', in_files(i).name];
+        [~, name, ~] = fileparts(inputFile);
+
+        outputFile = [output_run name];
+
+        command = cat(2, command, [' -f "' inputFile '" -of "' outputFile '_fp.txt" -op "' outputFile '_pose.txt"']);
+        command = cat(2, command, [' -ogaze "' outputFile '_gaze.txt" -oparams "' outputFile '.params.txt" -oaus "' outputFile '_au.txt"']);
+    end
+
+    dos(command);
+end
+
+%% Compare the outputs of the two runs
+num_differing = 0;
+for i=1:numel(in_files)
+
+    [~, name, ~] = fileparts(in_files(i).name);
+
+    for s=1:numel(suffixes)
+
+        f_serial = fopen([output runs{1} '/' name suffixes{s}], 'r');
+        serial_bytes = fread(f_serial, inf, 'uint8=>uint8');
+        fclose(f_serial);
+
+        f_threads = fopen([output runs{2} '/' name suffixes{s}], 'r');
+        threads_bytes = fread(f_threads, inf, 'uint8=>uint8');
+        fclose(f_threads);
+
+        if(~isequal(serial_bytes, threads_bytes))
+            fprintf('%s%s differs between the serial and the %d thread run\n', name, suffixes{s}, num_threads);
+            num_differing = num_differing + 1;
+        end
+    end
+end
+
+assert(num_differing == 0);